@@ -0,0 +1,11 @@
+/*
+ * The kernels of TensorLib precompiled for the common element types, see
+ * tensor_core/precompiled.hpp.
+ */
+#include "tensor_core.hpp"
+
+namespace TL {
+
+TENSORLIB_PRECOMPILED_KERNELS()
+
+}   // namespace TL
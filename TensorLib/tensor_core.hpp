@@ -9,5 +9,31 @@
 #include "tensor_core/slice.hpp"
 #include "tensor_core/range.hpp"
 #include "tensor_core/utils.hpp"
+#include "tensor_core/thread_pool.hpp"
+#include "tensor_core/numa.hpp"
+#include "tensor_core/storage.hpp"
+#include "tensor_core/nd_loop.hpp"
+#include "tensor_core/lazy.hpp"
+#include "tensor_core/async.hpp"
+#include "tensor_core/sparse.hpp"
+#include "tensor_core/linalg.hpp"
+#include "tensor_core/nn.hpp"
+#include "tensor_core/math.hpp"
+#include "tensor_core/normalization.hpp"
+#include "tensor_core/sorting.hpp"
+#include "tensor_core/indexing.hpp"
+#include "tensor_core/concatenate.hpp"
+#include "tensor_core/scan.hpp"
+#include "tensor_core/einsum.hpp"
+#include "tensor_core/random.hpp"
+#include "tensor_core/tensor_io.hpp"
+#include "tensor_core/batch_stream.hpp"
+#include "tensor_core/disk_tensor.hpp"
+#include "tensor_core/csv.hpp"
+#include "tensor_core/dlpack.hpp"
+#include "tensor_core/shared_memory.hpp"
+#include "tensor_core/layout.hpp"
+#include "tensor_core/dynamic_tensor.hpp"
+#include "tensor_core/precompiled.hpp"
 
 #endif // TENSORLIB_TENSOR_CORE_H_
\ No newline at end of file
@@ -0,0 +1,342 @@
+#ifndef TENSORLIB_ASYNC_H_
+#define TENSORLIB_ASYNC_H_
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace TL {
+
+template <typename T>
+class AsyncTensor;
+
+namespace internal {
+
+/**************************************************
+              AsyncState declaration
+ **************************************************/
+
+/**
+ * @brief Shared state of an AsyncTensor. Holds the eventual result and the
+ * continuations to be run once the result is set.
+ */
+template <typename T>
+class AsyncState
+{
+public:
+    AsyncState() : result(promise.get_future().share()) {}
+
+    void set_value(Tensor<T>);
+    void set_error(std::exception_ptr);
+
+    /**
+     * @brief Calls @a func once the state is ready. Calls it immediately in
+     * the calling thread when the state is already ready.
+     */
+    void on_ready(std::function<void()>);
+
+    /**
+     * @brief Returns the error when the operation failed, else nullptr. Should
+     * only be called once the state is ready.
+     */
+    std::exception_ptr error() const {
+        return err;
+    }
+
+    std::shared_future<Tensor<T>> future() const {
+        return result;
+    }
+
+private:
+    std::mutex mtx;
+    bool done = false;
+    std::exception_ptr err;
+    std::promise<Tensor<T>> promise;
+    std::shared_future<Tensor<T>> result;
+    std::vector<std::function<void()>> continuations;
+
+    void _finish();
+};
+
+/**************************************************
+              AsyncState definition
+ **************************************************/
+
+template <typename T>
+void AsyncState<T>::set_value(Tensor<T> value) {
+    promise.set_value(std::move(value));
+    _finish();
+}
+
+template <typename T>
+void AsyncState<T>::set_error(std::exception_ptr e) {
+    err = e;
+    promise.set_exception(e);
+    _finish();
+}
+
+template <typename T>
+void AsyncState<T>::_finish() {
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        done = true;
+        ready.swap(continuations);
+    }
+    for (auto& func : ready) {
+        func();
+    }
+}
+
+template <typename T>
+void AsyncState<T>::on_ready(std::function<void()> func) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!done) {
+            continuations.push_back(std::move(func));
+            return;
+        }
+    }
+    func();
+}
+
+/**
+ * @brief Removes reference and cv qualifiers, so that the type of the result
+ * of a function returning a tensor can be deduced.
+ */
+template <typename R>
+using Async_result = typename std::decay_t<R>::value_type;
+
+/**
+ * @brief Enqueues the work of TL::async(). Has access to the state of the
+ * AsyncTensor objects.
+ */
+struct AsyncLauncher
+{
+    template <typename R, typename F, typename... Ts>
+    static AsyncTensor<R> launch(F, const AsyncTensor<Ts>&...);
+};
+
+}   // namespace internal
+
+/**************************************************
+              Launching asynchronous work
+ **************************************************/
+
+/**
+ * @brief Runs @a func on the thread pool once all the given asynchronous
+ * tensors are ready, passing their values in the same order.
+ *
+ * No thread waits for the dependencies: the last dependency to finish
+ * enqueues the task, so chains of operations run back to back on the workers
+ * without going through the calling thread. If a dependency fails, @a func
+ * is not called and the error is propagated to the result.
+ *
+ * @param func Callable taking Tensor<Ts>... and returning a Tensor.
+ * @param deps... Asynchronous tensors the call depends on.
+ * @return AsyncTensor of the value returned by @a func.
+ */
+template <typename F, typename... Ts>
+auto async(F func, const AsyncTensor<Ts>&... deps)
+-> AsyncTensor<internal::Async_result<decltype(func(std::declval<Tensor<Ts>>()...))>>;
+
+/**************************************************
+              AsyncTensor declaration
+ **************************************************/
+
+/**
+ * @brief A handle to a tensor that is being computed in the background.
+ * Operations on an AsyncTensor are enqueued on the library's thread pool and
+ * return another AsyncTensor immediately.
+ */
+template <typename T>
+class AsyncTensor
+{
+public:
+    using value_type = T;
+
+    /**
+     * @brief Constructs an AsyncTensor that is already ready with the given
+     * tensor. No copy is made.
+     */
+    AsyncTensor(const Tensor<T>&);
+
+    /**
+     * @brief Returns whether the result is available, without blocking.
+     */
+    bool ready() const {
+        return state->future().wait_for(std::chrono::seconds(0))
+            == std::future_status::ready;
+    }
+
+    /**
+     * @brief Blocks until the result is available.
+     */
+    void wait() const {
+        state->future().wait();
+    }
+
+    /**
+     * @brief Blocks until the result is available and returns it.
+     * @throw Rethrows the exception thrown by the operation.
+     */
+    Tensor<T> get() const {
+        return state->future().get();
+    }
+
+    /**
+     * @brief Returns a std::shared_future that becomes ready with the result.
+     */
+    std::shared_future<Tensor<T>> future() const {
+        return state->future();
+    }
+
+    /**
+     * @brief Asynchronous version of Tensor::copy().
+     */
+    AsyncTensor copy() const;
+
+    /* ------- Binary operations with a scalar ---------- */
+
+    AsyncTensor operator+(const T&) const;
+    AsyncTensor operator-(const T&) const;
+    AsyncTensor operator*(const T&) const;
+    AsyncTensor operator/(const T&) const;
+    AsyncTensor operator%(const T&) const;
+
+    /* ------- Binary operations with a tensor ---------- */
+
+    AsyncTensor operator+(const AsyncTensor&) const;
+    AsyncTensor operator-(const AsyncTensor&) const;
+    AsyncTensor operator*(const AsyncTensor&) const;
+    AsyncTensor operator/(const AsyncTensor&) const;
+    AsyncTensor operator%(const AsyncTensor&) const;
+
+    friend struct internal::AsyncLauncher;
+
+private:
+    std::shared_ptr<internal::AsyncState<T>> state;
+
+    AsyncTensor() : state(std::make_shared<internal::AsyncState<T>>()) {}
+};
+
+/**************************************************
+              AsyncTensor definition
+ **************************************************/
+
+template <typename R, typename F, typename... Ts>
+AsyncTensor<R> internal::AsyncLauncher::launch(F func, const AsyncTensor<Ts>&... deps) {
+    AsyncTensor<R> res;
+    auto out = res.state;
+    auto run = [out, func, deps...] () mutable {
+        for (auto e : {std::exception_ptr(), deps.state->error()...}) {
+            if (e) {
+                out->set_error(e);
+                return;
+            }
+        }
+
+        try {
+            out->set_value(func(deps.state->future().get()...));
+        } catch (...) {
+            out->set_error(std::current_exception());
+        }
+    };
+
+    /* One count for each dependency plus one held until all the continuations
+    are registered, so that the task is enqueued exactly once. */
+    auto pending = std::make_shared<std::atomic<size_t>>(sizeof...(deps) + 1);
+    auto arrive = [pending, run] () {
+        if (--*pending == 0) {
+            internal::ThreadPool::instance().submit(run);
+        }
+    };
+    (deps.state->on_ready(arrive), ...);
+    arrive();
+
+    return res;
+}
+
+template <typename F, typename... Ts>
+auto async(F func, const AsyncTensor<Ts>&... deps)
+-> AsyncTensor<internal::Async_result<decltype(func(std::declval<Tensor<Ts>>()...))>> {
+    using R = internal::Async_result<decltype(func(std::declval<Tensor<Ts>>()...))>;
+    return internal::AsyncLauncher::launch<R>(std::move(func), deps...);
+}
+
+template <typename T>
+AsyncTensor<T>::AsyncTensor(const Tensor<T>& tensor) : AsyncTensor() {
+    state->set_value(tensor);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::copy() const {
+    return TL::async([] (Tensor<T> t) { return t.copy(); }, *this);
+}
+
+/* ------- Binary operations with a scalar ---------- */
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator+(const T& val) const {
+    return TL::async([val] (Tensor<T> t) { return t + val; }, *this);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator-(const T& val) const {
+    return TL::async([val] (Tensor<T> t) { return t - val; }, *this);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator*(const T& val) const {
+    return TL::async([val] (Tensor<T> t) { return t * val; }, *this);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator/(const T& val) const {
+    return TL::async([val] (Tensor<T> t) { return t / val; }, *this);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator%(const T& val) const {
+    return TL::async([val] (Tensor<T> t) { return t % val; }, *this);
+}
+
+/* ------- Binary operations with a tensor ---------- */
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator+(const AsyncTensor& rhs) const {
+    return TL::async([] (Tensor<T> a, Tensor<T> b) { return a + b; }, *this, rhs);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator-(const AsyncTensor& rhs) const {
+    return TL::async([] (Tensor<T> a, Tensor<T> b) { return a - b; }, *this, rhs);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator*(const AsyncTensor& rhs) const {
+    return TL::async([] (Tensor<T> a, Tensor<T> b) { return a * b; }, *this, rhs);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator/(const AsyncTensor& rhs) const {
+    return TL::async([] (Tensor<T> a, Tensor<T> b) { return a / b; }, *this, rhs);
+}
+
+template <typename T>
+AsyncTensor<T> AsyncTensor<T>::operator%(const AsyncTensor& rhs) const {
+    return TL::async([] (Tensor<T> a, Tensor<T> b) { return a % b; }, *this, rhs);
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_ASYNC_H_
@@ -0,0 +1,327 @@
+#ifndef TENSORLIB_BATCH_STREAM_H_
+#define TENSORLIB_BATCH_STREAM_H_
+
+#include "tensor.hpp"
+#include "tensor_io.hpp"
+#include "slice.hpp"
+#include "range.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace TL {
+
+struct BatchStreamOptions
+{
+    /* Number of batch buffers, at least 1. With 2, the next batch is read
+    while the current one is processed. */
+    size_t prefetch = 2;
+    /* Whether to visit the rows in a different order at each epoch. */
+    bool shuffle = false;
+    /* Rows shuffled together, 0 for the batch size. Larger blocks make
+    longer reads. */
+    size_t shuffle_block = 0;
+    uint64_t seed = 0;
+    /* Whether to skip the last batch when it is smaller than the others. */
+    bool drop_last = false;
+};
+
+/**************************************************
+              BatchStream declaration
+ **************************************************/
+
+/**
+ * @brief Reads a tensor file (see TL::save()) batch by batch along axis 0.
+ *
+ * A background thread reads the next batches into a ring of
+ * BatchStreamOptions::prefetch tensors allocated once, and waits when all of
+ * them are ready and not consumed yet, so that reading never runs more than
+ * the ring ahead of the consumer.
+ * @tparam T Type of the elements in the file.
+ */
+template <typename T>
+class BatchStream
+{
+public:
+    /**
+     * @brief Opens @a path and starts reading the first epoch.
+     * @throw std::runtime_error when the file cannot be read, doesn't hold
+     * elements of type T or is 0 dimensional.
+     */
+    BatchStream(const std::string& path, size_t batch_size, const BatchStreamOptions& = {});
+
+    BatchStream(const BatchStream&) = delete;
+    BatchStream& operator=(const BatchStream&) = delete;
+
+    ~BatchStream() {
+        _stop();
+        ::close(fd);
+    }
+
+    /**
+     * @brief Returns the next batch of the epoch, or nothing at the end of
+     * the epoch. The batch is a buffer of the ring: it is only valid until
+     * the next call, which gives it back to the reading thread.
+     * @throw std::runtime_error when reading the file failed.
+     */
+    std::optional<Tensor<T>> next();
+
+    /**
+     * @brief Starts a new epoch, in a new order when shuffling.
+     */
+    void reset();
+
+    /**
+     * @brief Returns the shape of the tensor in the file.
+     */
+    const std::vector<size_t>& shape() const {
+        return header.shape;
+    }
+
+    size_t num_batches() const {
+        size_t rows = header.shape[0];
+        return opts.drop_last ? rows / batch : (rows + batch - 1) / batch;
+    }
+
+    size_t epoch() const {
+        return epoch_count;
+    }
+
+private:
+    int fd;
+    internal::TensorFileHeader header;
+    size_t batch;
+    BatchStreamOptions opts;
+    size_t row_bytes;
+    size_t epoch_count = 0;
+
+    /* The ring: batch b is read into slots[b % slots.size()]. */
+    std::vector<Tensor<T>> slots;
+    std::vector<size_t> slot_rows;
+    /* Batches read, returned by next() and given back by the consumer. */
+    size_t produced = 0, returned = 0, released = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread reader;
+
+    /**
+     * @brief Runs of consecutive rows (first, count) in the order of the
+     * epoch.
+     */
+    std::vector<std::pair<size_t, size_t>> _runs() const;
+
+    void _read(size_t, size_t, T*) const;
+    void _produce(std::vector<std::pair<size_t, size_t>>);
+    void _start();
+    void _stop();
+};
+
+/**************************************************
+              BatchStream definition
+ **************************************************/
+
+template <typename T>
+BatchStream<T>::BatchStream(const std::string& path, size_t batch_size,
+                            const BatchStreamOptions& options)
+: batch(batch_size), opts(options) {
+    if (!batch || !opts.prefetch) {
+        throw std::runtime_error("Batch size and prefetch should be positive");
+    }
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        header = internal::TensorFileHeader::read(in);
+    }
+    header.check_type<T>();
+    if (header.shape.empty()) {
+        throw std::runtime_error("Cannot stream a 0 dimensional tensor");
+    }
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (!opts.shuffle) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    /* The destructor doesn't run when the constructor throws. */
+    try {
+        std::vector<size_t> slot_shape = header.shape;
+        slot_shape[0] = batch;
+        row_bytes = sizeof(T);
+        for (size_t d = 1; d < slot_shape.size(); ++d) {
+            row_bytes *= slot_shape[d];
+        }
+        for (size_t i = 0; i < opts.prefetch; ++i) {
+            slots.emplace_back(internal::Buffer<T>(batch * row_bytes / sizeof(T)), slot_shape);
+        }
+        slot_rows.assign(opts.prefetch, 0);
+        _start();
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+template <typename T>
+std::vector<std::pair<size_t, size_t>> BatchStream<T>::_runs() const {
+    size_t rows = header.shape[0];
+    if (!opts.shuffle) {
+        return {{0, rows}};
+    }
+    size_t block = opts.shuffle_block ? opts.shuffle_block : batch;
+    size_t n = (rows + block - 1) / block;
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    /* Fisher-Yates with a fixed generator, to get the same order on every
+    platform. */
+    std::mt19937_64 rng(opts.seed + 0x9E3779B97F4A7C15ULL * epoch_count);
+    for (size_t i = n; i > 1; --i) {
+        std::swap(order[i - 1], order[rng() % i]);
+    }
+
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t b : order) {
+        runs.emplace_back(b * block, std::min(block, rows - b * block));
+    }
+    return runs;
+}
+
+template <typename T>
+void BatchStream<T>::_read(size_t first, size_t count, T* dst) const {
+    char* p = reinterpret_cast<char*>(dst);
+    size_t left = count * row_bytes;
+    off_t pos = off_t(header.data_offset + first * row_bytes);
+    while (left) {
+        ssize_t r = ::pread(fd, p, left, pos);
+        if (r <= 0) {
+            throw std::runtime_error("Unexpected end of tensor file");
+        }
+        p += r;
+        pos += r;
+        left -= size_t(r);
+    }
+}
+
+template <typename T>
+void BatchStream<T>::_produce(std::vector<std::pair<size_t, size_t>> runs) {
+    size_t n = num_batches(), run = 0, offset = 0;
+    try {
+        for (size_t b = 0; b < n; ++b) {
+            {
+                /* Backpressure: wait for a slot given back by the consumer. */
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return stopping || b < released + slots.size(); });
+                if (stopping) {
+                    return;
+                }
+            }
+
+            size_t s = b % slots.size(), rows = 0;
+            T* dst = slots[s].data_ptr();
+            while (rows < batch && run < runs.size()) {
+                size_t count = std::min(batch - rows, runs[run].second - offset);
+                _read(runs[run].first + offset, count, dst + rows * (row_bytes / sizeof(T)));
+                rows += count;
+                offset += count;
+                if (offset == runs[run].second) {
+                    ++run;
+                    offset = 0;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mtx);
+            slot_rows[s] = rows;
+            produced = b + 1;
+            cv.notify_all();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mtx);
+        error = std::current_exception();
+        cv.notify_all();
+    }
+}
+
+template <typename T>
+std::optional<Tensor<T>> BatchStream<T>::next() {
+    std::unique_lock<std::mutex> lock(mtx);
+    /* The batch returned last time is given back. */
+    released = returned;
+    cv.notify_all();
+    if (returned == num_batches()) {
+        return std::nullopt;
+    }
+    cv.wait(lock, [&] { return produced > returned || error; });
+    if (produced <= returned) {
+        std::rethrow_exception(error);
+    }
+
+    size_t s = returned % slots.size();
+    ++returned;
+    if (slot_rows[s] == batch) {
+        return slots[s];
+    }
+    if (!row_bytes) {
+        /* Rows without elements, which slices can't express. */
+        std::vector<size_t> shape = header.shape;
+        shape[0] = slot_rows[s];
+        return Tensor<T>(internal::Buffer<T>(0), shape);
+    }
+    std::vector<Range> ranges{Range(0, slot_rows[s])};
+    for (size_t d = 1; d < header.shape.size(); ++d) {
+        ranges.emplace_back(0, header.shape[d]);
+    }
+    return slots[s](Slice(ranges));
+}
+
+template <typename T>
+void BatchStream<T>::reset() {
+    _stop();
+    ++epoch_count;
+    _start();
+}
+
+template <typename T>
+void BatchStream<T>::_start() {
+    produced = returned = released = 0;
+    stopping = false;
+    error = nullptr;
+    reader = std::thread(&BatchStream::_produce, this, _runs());
+}
+
+template <typename T>
+void BatchStream<T>::_stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (reader.joinable()) {
+        reader.join();
+    }
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_BATCH_STREAM_H_
@@ -0,0 +1,368 @@
+#ifndef TENSORLIB_CONCATENATE_H_
+#define TENSORLIB_CONCATENATE_H_
+
+#include "tensor.hpp"
+#include "slice.hpp"
+#include "range.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/* Elements copied by a chunk of the thread pool at least. */
+constexpr size_t join_grain = 1 << 15;
+
+/**
+ * @brief Lays out the inputs one after the other in each of the @a outer rows
+ * of @a out: row o is input 0's o-th block of len[0] elements, then input
+ * 1's o-th block, and so on. Blocks are copied in parallel.
+ */
+template <typename T>
+void join_blocks(const std::vector<Tensor<T>>& inputs, const std::vector<size_t>& len,
+                 size_t outer, T* out) {
+    size_t k = inputs.size();
+    std::vector<size_t> offset(k + 1, 0);
+    std::partial_sum(len.begin(), len.end(), offset.begin() + 1);
+    size_t row = offset[k];
+    size_t work = std::max<size_t>(row / std::max<size_t>(k, 1), 1);
+
+    ThreadPool::instance().parallel_for(outer * k, std::max<size_t>(join_grain / work, 1),
+                                        [&] (size_t b, size_t e) {
+        for (size_t u = b; u < e; ++u) {
+            size_t o = u / k, i = u % k;
+            std::copy_n(inputs[i].data_ptr() + o * len[i], len[i],
+                        out + o * row + offset[i]);
+        }
+    });
+}
+
+/**
+ * @brief Returns contiguous versions of the inputs, after checking that they
+ * have the same shape except maybe along @a axis.
+ * @throw std::runtime_error when the shapes mismatch or there is no input.
+ */
+template <typename T>
+std::vector<Tensor<T>> join_inputs(const std::vector<Tensor<T>>& tensors, long axis,
+                                   bool same_shape) {
+    if (tensors.empty()) {
+        throw std::runtime_error("Need at least one tensor to join");
+    }
+    auto shape = tensors[0].shape();
+    std::vector<Tensor<T>> res;
+    res.reserve(tensors.size());
+    for (auto& t : tensors) {
+        auto s = t.shape();
+        if (s.size() != shape.size()) {
+            throw std::runtime_error("Dimensions Mismatch");
+        }
+        for (size_t d = 0; d < s.size(); ++d) {
+            if (s[d] != shape[d] && (same_shape || long(d) != axis)) {
+                throw std::runtime_error("Dimensions Mismatch");
+            }
+        }
+        res.push_back(t.is_contiguous() ? t : t.copy());
+    }
+    return res;
+}
+
+}   // namespace internal
+
+/**************************************************
+                Joining tensors
+ **************************************************/
+
+/**
+ * @brief Joins the tensors along an existing @a axis. The result is allocated
+ * once and each input is copied in blocks, in parallel.
+ * @throw std::runtime_error when the shapes mismatch except along @a axis.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> concatenate(const std::vector<Tensor<T>>& tensors, long axis = 0) {
+    if (tensors.empty()) {
+        throw std::runtime_error("Need at least one tensor to join");
+    }
+    size_t a = internal::normalize_axis(axis, tensors[0].ndim());
+    auto inputs = internal::join_inputs(tensors, a, false);
+
+    auto shape = inputs[0].shape();
+    size_t outer, n, inner;
+    internal::split_axis(shape, a, outer, n, inner);
+
+    std::vector<size_t> len;
+    shape[a] = 0;
+    for (auto& t : inputs) {
+        len.push_back(t.shape()[a] * inner);
+        shape[a] += t.shape()[a];
+    }
+
+    internal::Buffer<T> out(outer * shape[a] * inner);
+    internal::join_blocks(inputs, len, outer, out.data());
+    return Tensor<T>(std::move(out), shape);
+}
+
+/**
+ * @brief Joins the tensors, which should all have the same shape, along a new
+ * @a axis inserted at that position.
+ * @throw std::runtime_error when the shapes mismatch.
+ * @throw std::out_of_range when the axis is bigger than ndim().
+ */
+template <typename T>
+Tensor<T> stack(const std::vector<Tensor<T>>& tensors, size_t axis = 0) {
+    if (tensors.empty()) {
+        throw std::runtime_error("Need at least one tensor to join");
+    }
+    if (axis > tensors[0].ndim()) {
+        throw std::out_of_range("Axis out of bound");
+    }
+    auto inputs = internal::join_inputs(tensors, -1, true);
+
+    auto shape = inputs[0].shape();
+    size_t outer = 1, block = 1;
+    for (size_t d = 0; d < shape.size(); ++d) {
+        (d < axis ? outer : block) *= shape[d];
+    }
+    shape.insert(shape.begin() + axis, inputs.size());
+
+    internal::Buffer<T> out(outer * inputs.size() * block);
+    internal::join_blocks(inputs, std::vector<size_t>(inputs.size(), block), outer, out.data());
+    return Tensor<T>(std::move(out), shape);
+}
+
+/**************************************************
+                Splitting tensors
+ **************************************************/
+
+/**
+ * @brief Splits the tensor along @a axis into consecutive parts of the given
+ * @a sizes. The parts are views on the tensor, no copy is made, except when
+ * another axis has length 0 and they are empty tensors of their own.
+ * @throw std::runtime_error when the sizes don't add up to the length of the
+ * axis or a size is 0.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+std::vector<Tensor<T>> split(const Tensor<T>& x, const std::vector<size_t>& sizes,
+                             long axis = 0) {
+    size_t a = internal::normalize_axis(axis, x.ndim());
+    auto shape = x.shape();
+    if (std::accumulate(sizes.begin(), sizes.end(), size_t(0)) != shape[a]
+        || std::count(sizes.begin(), sizes.end(), 0)) {
+        throw std::runtime_error("Sections should be non empty and cover the axis");
+    }
+
+    std::vector<Tensor<T>> parts;
+    if (!x.size()) {
+        /* Another axis is empty, which slices can't express. The parts hold
+        no element, fresh tensors are as good as views. */
+        for (auto s : sizes) {
+            shape[a] = s;
+            parts.emplace_back(internal::Buffer<T>(0), shape);
+        }
+        return parts;
+    }
+
+    std::vector<Range> ranges;
+    for (auto s : shape) {
+        ranges.emplace_back(0, s);
+    }
+
+    size_t low = 0;
+    for (auto s : sizes) {
+        ranges[a] = Range(low, low + s);
+        parts.push_back(x(Slice(ranges)));
+        low += s;
+    }
+    return parts;
+}
+
+/**
+ * @brief Splits the tensor along @a axis into @a sections views of equal
+ * length.
+ * @throw std::runtime_error when the length of the axis isn't divisible by
+ * @a sections.
+ */
+template <typename T>
+std::vector<Tensor<T>> split(const Tensor<T>& x, size_t sections, long axis = 0) {
+    size_t n = x.shape()[internal::normalize_axis(axis, x.ndim())];
+    if (!sections || n % sections) {
+        throw std::runtime_error("Axis cannot be split into equal sections");
+    }
+    return split(x, std::vector<size_t>(sections, n / sections), axis);
+}
+
+/**
+ * @brief Splits the tensor along @a axis into at most @a chunks views of
+ * ceil(n / chunks) entries, the last one being smaller when n isn't divisible.
+ */
+template <typename T>
+std::vector<Tensor<T>> chunk(const Tensor<T>& x, size_t chunks, long axis = 0) {
+    size_t n = x.shape()[internal::normalize_axis(axis, x.ndim())];
+    if (!chunks) {
+        throw std::runtime_error("Number of chunks should be positive");
+    }
+    size_t len = std::max<size_t>((n + chunks - 1) / chunks, 1);
+    std::vector<size_t> sizes;
+    for (size_t low = 0; low < n; low += len) {
+        sizes.push_back(std::min(len, n - low));
+    }
+    return split(x, sizes, axis);
+}
+
+/**************************************************
+              ChunkedTensor declaration
+ **************************************************/
+
+/**
+ * @brief A tensor stored as a list of buffers along axis 0, so that batches
+ * can be appended without copying what is already there. Converted to a
+ * regular tensor with a single copy by ChunkedTensor::to_tensor().
+ * @tparam T Type of the elements in the tensor.
+ */
+template <typename T>
+class ChunkedTensor
+{
+public:
+    /**
+     * @brief Constructs an empty tensor whose entries along axis 0 have the
+     * shape @a _row_shape.
+     */
+    explicit ChunkedTensor(const std::vector<size_t>& _row_shape)
+    : row_shape(_row_shape), offsets(1, 0) {}
+
+    /**
+     * @brief Constructs from a first chunk.
+     */
+    explicit ChunkedTensor(const Tensor<T>& first)
+    : ChunkedTensor(_row_shape_of(first)) {
+        append(first);
+    }
+
+    /**
+     * @brief Appends the entries of @a chunk along axis 0. The chunk is
+     * referenced, not copied, when it is contiguous.
+     * @throw std::runtime_error when the chunk's shape doesn't match.
+     */
+    ChunkedTensor& append(const Tensor<T>&);
+
+    std::vector<size_t> shape() const;
+
+    size_t ndim() const {
+        return row_shape.size() + 1;
+    }
+
+    size_t size() const;
+
+    size_t num_chunks() const {
+        return chunks.size();
+    }
+
+    /**
+     * @brief Returns the @a i -th appended chunk.
+     */
+    const Tensor<T>& chunk(size_t i) const {
+        return chunks.at(i);
+    }
+
+    /**
+     * @brief Returns the entry @a idx along axis 0, a view on its chunk.
+     * @throw std::out_of_range when index goes out of range.
+     */
+    Tensor<T> operator[](size_t) const;
+
+    /**
+     * @brief Returns the tensor as a single contiguous tensor.
+     */
+    Tensor<T> to_tensor() const;
+
+    /**
+     * @brief Merges all the chunks into a single one.
+     */
+    ChunkedTensor& compact();
+
+private:
+    std::vector<size_t> row_shape;
+    std::vector<Tensor<T>> chunks;
+    /* offsets[i] is the index along axis 0 of the first entry of chunk i. */
+    std::vector<size_t> offsets;
+
+    static std::vector<size_t> _row_shape_of(const Tensor<T>& t) {
+        auto s = t.shape();
+        if (s.empty()) {
+            throw std::runtime_error("Chunks should have at least 1 dimension");
+        }
+        return std::vector<size_t>(s.begin() + 1, s.end());
+    }
+};
+
+/**************************************************
+              ChunkedTensor definition
+ **************************************************/
+
+template <typename T>
+ChunkedTensor<T>& ChunkedTensor<T>::append(const Tensor<T>& chunk) {
+    auto s = chunk.shape();
+    if (s.empty() || !std::equal(row_shape.begin(), row_shape.end(), s.begin() + 1, s.end())) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    if (!s[0]) {
+        return *this;
+    }
+    chunks.push_back(chunk.is_contiguous() ? chunk : chunk.copy());
+    offsets.push_back(offsets.back() + s[0]);
+    return *this;
+}
+
+template <typename T>
+std::vector<size_t> ChunkedTensor<T>::shape() const {
+    std::vector<size_t> s(1, offsets.back());
+    s.insert(s.end(), row_shape.begin(), row_shape.end());
+    return s;
+}
+
+template <typename T>
+size_t ChunkedTensor<T>::size() const {
+    return std::accumulate(
+        row_shape.begin(), row_shape.end(), offsets.back(), std::multiplies<size_t>()
+    );
+}
+
+template <typename T>
+Tensor<T> ChunkedTensor<T>::operator[](size_t idx) const {
+    if (idx >= offsets.back()) {
+        throw std::out_of_range("Index out of range");
+    }
+    size_t i = std::upper_bound(offsets.begin(), offsets.end(), idx) - offsets.begin() - 1;
+    return chunks[i][idx - offsets[i]];
+}
+
+template <typename T>
+Tensor<T> ChunkedTensor<T>::to_tensor() const {
+    if (chunks.empty()) {
+        return Tensor<T>(std::vector<T>(), shape());
+    }
+    if (chunks.size() == 1) {
+        return chunks[0];
+    }
+    return concatenate(chunks, 0);
+}
+
+template <typename T>
+ChunkedTensor<T>& ChunkedTensor<T>::compact() {
+    if (chunks.size() > 1) {
+        auto all = to_tensor();
+        chunks.assign(1, all);
+        offsets = {0, all.shape()[0]};
+    }
+    return *this;
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_CONCATENATE_H_
@@ -0,0 +1,220 @@
+#ifndef TENSORLIB_CSV_H_
+#define TENSORLIB_CSV_H_
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace TL {
+
+struct CsvOptions
+{
+    char delimiter = ',';
+    /* Lines skipped at the beginning of the file, such as a header. */
+    size_t skip_rows = 0;
+};
+
+namespace internal {
+
+/* Bytes of text parsed by a chunk at least. */
+constexpr size_t csv_grain = 1 << 16;
+
+/**
+ * @brief A file mapped read only in memory.
+ */
+class MappedFile
+{
+public:
+    /**
+     * @throw std::runtime_error when the file cannot be opened or mapped.
+     */
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot open " + path);
+        }
+        sz = size_t(st.st_size);
+        if (sz) {
+            void* p = ::mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map " + path);
+            }
+            ::madvise(p, sz, MADV_SEQUENTIAL);
+            ptr = static_cast<const char*>(p);
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (ptr) {
+            ::munmap(const_cast<char*>(ptr), sz);
+        }
+    }
+
+    const char* data() const {
+        return ptr;
+    }
+
+    size_t size() const {
+        return sz;
+    }
+
+private:
+    const char* ptr = nullptr;
+    size_t sz = 0;
+};
+
+/**
+ * @brief Calls @a f(begin, end) for each line of [@a b, @a e) that isn't
+ * empty, without its line break.
+ */
+template <typename F>
+void for_each_line(const char* b, const char* e, F&& f) {
+    while (b < e) {
+        const char* nl = static_cast<const char*>(std::memchr(b, '\n', size_t(e - b)));
+        const char* end = nl ? nl : e;
+        const char* last = end;
+        if (last > b && last[-1] == '\r') {
+            --last;
+        }
+        if (last > b) {
+            f(b, last);
+        }
+        b = nl ? nl + 1 : e;
+    }
+}
+
+/**
+ * @brief Parses the @a cols fields of the line [@a b, @a e) into @a dst.
+ * @throw std::runtime_error when a field isn't a number of type T or the
+ * line hasn't @a cols fields.
+ */
+template <typename T>
+void parse_csv_line(const char* b, const char* e, char delimiter, size_t cols, T* dst, size_t row) {
+    auto blank = [] (char c) {
+        return c == ' ' || c == '\t';
+    };
+    for (size_t c = 0; c < cols; ++c) {
+        while (b < e && blank(*b)) {
+            ++b;
+        }
+        if (b < e && *b == '+') {
+            ++b;
+        }
+        auto [p, ec] = std::from_chars(b, e, dst[c]);
+        if (ec != std::errc()) {
+            throw std::runtime_error("Invalid number in CSV row " + std::to_string(row));
+        }
+        b = p;
+        while (b < e && blank(*b)) {
+            ++b;
+        }
+        if (c + 1 < cols ? (b == e || *b != delimiter) : b != e) {
+            throw std::runtime_error("Wrong number of fields in CSV row " + std::to_string(row));
+        }
+        ++b;
+    }
+}
+
+}   // namespace internal
+
+/**************************************************
+                    CSV files
+ **************************************************/
+
+/**
+ * @brief Reads a CSV file of numbers into a 2 dimensional tensor, one row
+ * per non empty line.
+ *
+ * The file is mapped in memory and split into chunks of whole lines. A
+ * first parallel pass counts the rows of each chunk, so that the second one
+ * parses the chunks in parallel straight into the tensor.
+ * @throw std::runtime_error when the file cannot be read, holds no rows, or
+ * a row isn't made of as many numbers as the first one.
+ */
+template <typename T = float>
+Tensor<T> load_csv(const std::string& path, const CsvOptions& opts = {}) {
+    static_assert(std::is_arithmetic<T>::value, "load_csv expects an arithmetic type");
+    internal::MappedFile file(path);
+    const char* b = file.data();
+    const char* e = b + file.size();
+    for (size_t i = 0; i < opts.skip_rows && b < e; ++i) {
+        const char* nl = static_cast<const char*>(std::memchr(b, '\n', size_t(e - b)));
+        b = nl ? nl + 1 : e;
+    }
+
+    /* Chunk boundaries moved forward to the start of a line. */
+    auto& pool = internal::ThreadPool::instance();
+    size_t bytes = size_t(e - b);
+    size_t chunks = std::max<size_t>(1, std::min(4 * pool.size(), bytes / internal::csv_grain));
+    std::vector<const char*> bounds{b};
+    for (size_t k = 1; k < chunks; ++k) {
+        const char* p = std::max(b + bytes * k / chunks, bounds.back());
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', size_t(e - p)));
+        bounds.push_back(nl ? nl + 1 : e);
+    }
+    bounds.push_back(e);
+
+    /* First pass: rows of each chunk and fields of its first row. */
+    std::vector<size_t> rows(chunks, 0), fields(chunks, 0);
+    pool.parallel_for(chunks, 1, [&] (size_t c0, size_t c1) {
+        for (size_t c = c0; c < c1; ++c) {
+            internal::for_each_line(bounds[c], bounds[c + 1], [&] (const char* lb, const char* le) {
+                if (!rows[c]++) {
+                    fields[c] = 1 + size_t(std::count(lb, le, opts.delimiter));
+                }
+            });
+        }
+    });
+    std::vector<size_t> first_row(chunks + 1, 0);
+    size_t cols = 0;
+    for (size_t c = 0; c < chunks; ++c) {
+        first_row[c + 1] = first_row[c] + rows[c];
+        if (!cols) {
+            cols = fields[c];
+        }
+    }
+    if (!first_row[chunks]) {
+        throw std::runtime_error("No rows in CSV file " + path);
+    }
+
+    /* Second pass: parse into the tensor. */
+    internal::Buffer<T> out(first_row[chunks] * cols);
+    T* dst = out.data();
+    pool.parallel_for(chunks, 1, [&] (size_t c0, size_t c1) {
+        for (size_t c = c0; c < c1; ++c) {
+            size_t row = first_row[c];
+            internal::for_each_line(bounds[c], bounds[c + 1], [&] (const char* lb, const char* le) {
+                internal::parse_csv_line(lb, le, opts.delimiter, cols, dst + row * cols, row);
+                ++row;
+            });
+        }
+    });
+    return Tensor<T>(std::move(out), {first_row[chunks], cols});
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_CSV_H_
@@ -0,0 +1,734 @@
+#ifndef TENSORLIB_DISK_TENSOR_H_
+#define TENSORLIB_DISK_TENSOR_H_
+
+#include "tensor.hpp"
+#include "tensor_io.hpp"
+#include "slice.hpp"
+#include "range.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace TL {
+
+namespace internal {
+
+/*
+ * Chunked tensor files split the tensor into a grid of fixed N-d chunks,
+ * stored and compressed independently, so that a slice only reads and
+ * decodes the chunks it overlaps:
+ *
+ *     "TLTC"              4 bytes   magic
+ *     kind, elem size     2 bytes   as in tensor files (see tensor_io.hpp)
+ *     reserved            2 bytes
+ *     ndim                uint32
+ *     shape               ndim x uint64
+ *     chunk shape         ndim x uint64
+ *     index               n_chunks x (offset uint64, size uint32, flags uint32)
+ *     chunks
+ *
+ * Chunks are numbered in row major order over the grid. Chunks at the end of
+ * an axis are clipped to the tensor. A chunk is stored with its bytes
+ * shuffled (byte k of every element, then byte k + 1, ...), which groups the
+ * similar high order bytes of numbers, and compressed by a byte oriented LZ77
+ * codec of the LZ4 family; or as is when that doesn't make it smaller.
+ */
+
+constexpr char chunked_file_magic[4] = {'T', 'L', 'T', 'C'};
+/* Flag of the chunks stored without compression. */
+constexpr uint32_t chunk_raw = 1;
+/* Chunks compressed by a chunk of the thread pool at a time when writing. */
+constexpr size_t chunk_write_batch = 64;
+
+constexpr size_t lz_min_match = 4;
+constexpr size_t lz_max_offset = 65535;
+constexpr size_t lz_hash_bits = 14;
+
+inline void lz_put_length(std::vector<uint8_t>& out, size_t len) {
+    for (; len >= 255; len -= 255) {
+        out.push_back(255);
+    }
+    out.push_back(uint8_t(len));
+}
+
+/**
+ * @brief Emits a sequence: @a lit literals from @a src then a match of
+ * @a len bytes @a offset bytes back, or no match when @a len is 0.
+ */
+inline void lz_put_sequence(std::vector<uint8_t>& out, const uint8_t* src, size_t lit,
+                            size_t len, size_t offset) {
+    size_t ml = len ? len - lz_min_match : 0;
+    out.push_back(uint8_t((std::min<size_t>(lit, 15) << 4) | std::min<size_t>(ml, 15)));
+    if (lit >= 15) {
+        lz_put_length(out, lit - 15);
+    }
+    out.insert(out.end(), src, src + lit);
+    if (!len) {
+        return;
+    }
+    out.push_back(uint8_t(offset));
+    out.push_back(uint8_t(offset >> 8));
+    if (ml >= 15) {
+        lz_put_length(out, ml - 15);
+    }
+}
+
+/**
+ * @brief Compresses @a n bytes. Matches are found through a hash table of
+ * the last position of 4 byte sequences; the search skips faster over data
+ * that doesn't compress.
+ */
+inline std::vector<uint8_t> lz_compress(const uint8_t* src, size_t n) {
+    std::vector<uint8_t> out;
+    out.reserve(n / 2 + 16);
+    std::vector<uint32_t> table(size_t(1) << lz_hash_bits, UINT32_MAX);
+    auto hash = [] (uint32_t v) {
+        return (v * 2654435761u) >> (32 - lz_hash_bits);
+    };
+
+    size_t anchor = 0, i = 0;
+    while (i + lz_min_match <= n) {
+        uint32_t v, w;
+        std::memcpy(&v, src + i, 4);
+        uint32_t h = hash(v);
+        size_t cand = table[h];
+        table[h] = uint32_t(i);
+        if (cand != UINT32_MAX && i - cand <= lz_max_offset
+            && (std::memcpy(&w, src + cand, 4), w == v)) {
+            size_t len = lz_min_match;
+            while (i + len < n && src[cand + len] == src[i + len]) {
+                ++len;
+            }
+            lz_put_sequence(out, src + anchor, i - anchor, len, i - cand);
+            i += len;
+            anchor = i;
+        }
+        else {
+            i += 1 + ((i - anchor) >> 6);
+        }
+    }
+    lz_put_sequence(out, src + anchor, n - anchor, 0, 0);
+    return out;
+}
+
+/**
+ * @brief Decompresses @a n bytes into the @a size bytes at @a dst.
+ * @throw std::runtime_error when the data is corrupted.
+ */
+inline void lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t size) {
+    auto corrupted = [] {
+        throw std::runtime_error("Corrupted chunk");
+    };
+    auto length = [&] (size_t& ip, size_t len) {
+        if (len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= n) {
+                    corrupted();
+                }
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        return len;
+    };
+
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        uint8_t token = src[ip++];
+        size_t lit = length(ip, token >> 4);
+        if (lit > n - ip || lit > size - op) {
+            corrupted();
+        }
+        std::memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n) {
+            break;
+        }
+
+        if (n - ip < 2) {
+            corrupted();
+        }
+        size_t offset = src[ip] | (size_t(src[ip + 1]) << 8);
+        ip += 2;
+        size_t len = length(ip, token & 15) + lz_min_match;
+        if (!offset || offset > op || len > size - op) {
+            corrupted();
+        }
+        /* Byte by byte: the match may overlap what it writes. */
+        for (size_t k = 0; k < len; ++k, ++op) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    if (op != size) {
+        corrupted();
+    }
+}
+
+inline void byte_shuffle(const uint8_t* src, size_t n, size_t elem, uint8_t* dst) {
+    for (size_t b = 0; b < elem; ++b) {
+        for (size_t i = 0; i < n; ++i) {
+            dst[b * n + i] = src[i * elem + b];
+        }
+    }
+}
+
+inline void byte_unshuffle(const uint8_t* src, size_t n, size_t elem, uint8_t* dst) {
+    for (size_t b = 0; b < elem; ++b) {
+        for (size_t i = 0; i < n; ++i) {
+            dst[i * elem + b] = src[b * n + i];
+        }
+    }
+}
+
+/**
+ * @brief Grid of chunks over a shape.
+ */
+struct ChunkGrid
+{
+    std::vector<size_t> shape, chunk, grid;
+
+    ChunkGrid() = default;
+
+    ChunkGrid(const std::vector<size_t>& _shape, const std::vector<size_t>& _chunk)
+    : shape(_shape), chunk(_chunk) {
+        if (chunk.size() != shape.size()) {
+            throw std::runtime_error("Dimensions Mismatch");
+        }
+        for (size_t d = 0; d < shape.size(); ++d) {
+            if (!chunk[d]) {
+                throw std::runtime_error("Chunk shape should be positive");
+            }
+            grid.push_back((shape[d] + chunk[d] - 1) / chunk[d]);
+        }
+    }
+
+    size_t count() const {
+        return std::accumulate(grid.begin(), grid.end(), size_t(1), std::multiplies<size_t>());
+    }
+
+    /**
+     * @brief Coordinates on the grid of chunk @a id.
+     */
+    std::vector<size_t> coords(size_t id) const {
+        std::vector<size_t> c(grid.size());
+        for (size_t d = grid.size(); d-- > 0;) {
+            c[d] = id % grid[d];
+            id /= grid[d];
+        }
+        return c;
+    }
+
+    /**
+     * @brief Shape of the chunk at @a c, clipped to the tensor.
+     */
+    std::vector<size_t> extent(const std::vector<size_t>& c) const {
+        std::vector<size_t> e(c.size());
+        for (size_t d = 0; d < c.size(); ++d) {
+            e[d] = std::min(chunk[d], shape[d] - c[d] * chunk[d]);
+        }
+        return e;
+    }
+};
+
+struct ChunkEntry
+{
+    uint64_t offset;
+    uint32_t size;
+    uint32_t flags;
+};
+
+/**
+ * @brief Encodes the @a n elements of a chunk.
+ */
+template <typename T>
+std::vector<uint8_t> encode_chunk(const T* src, size_t n, uint32_t& flags) {
+    std::vector<uint8_t> shuffled(n * sizeof(T));
+    byte_shuffle(reinterpret_cast<const uint8_t*>(src), n, sizeof(T), shuffled.data());
+    auto packed = lz_compress(shuffled.data(), shuffled.size());
+    if (packed.size() < shuffled.size()) {
+        flags = 0;
+        return packed;
+    }
+    flags = chunk_raw;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(src);
+    return std::vector<uint8_t>(bytes, bytes + n * sizeof(T));
+}
+
+template <typename T>
+void decode_chunk(const uint8_t* src, size_t size, uint32_t flags, T* dst, size_t n) {
+    if (flags & chunk_raw) {
+        if (size != n * sizeof(T)) {
+            throw std::runtime_error("Corrupted chunk");
+        }
+        std::memcpy(static_cast<void*>(dst), src, size);
+        return;
+    }
+    std::vector<uint8_t> shuffled(n * sizeof(T));
+    lz_decompress(src, size, shuffled.data(), shuffled.size());
+    byte_unshuffle(shuffled.data(), n, sizeof(T), reinterpret_cast<uint8_t*>(dst));
+}
+
+/**
+ * @brief Copies the elements of the box @a extent of a row major array of
+ * shape @a shape starting at @a origin to or from a contiguous array.
+ */
+template <typename T>
+void copy_box(const std::vector<size_t>& shape, const std::vector<size_t>& origin,
+              const std::vector<size_t>& extent, T* array, T* box, bool to_box) {
+    size_t nd = shape.size();
+    if (!nd) {
+        to_box ? *box = *array : *array = *box;
+        return;
+    }
+    if (std::count(extent.begin(), extent.end(), 0)) {
+        return;
+    }
+    std::vector<size_t> stride(nd, 1);
+    for (size_t d = nd - 1; d > 0; --d) {
+        stride[d - 1] = stride[d] * shape[d];
+    }
+    std::vector<size_t> idx(nd, 0);
+    size_t row = extent[nd - 1];
+    while (true) {
+        size_t off = 0;
+        for (size_t d = 0; d < nd; ++d) {
+            off += (origin[d] + idx[d]) * stride[d];
+        }
+        if (to_box) {
+            std::copy_n(array + off, row, box);
+        }
+        else {
+            std::copy_n(box, row, array + off);
+        }
+        box += row;
+
+        long d = long(nd) - 2;
+        for (; d >= 0 && ++idx[d] == extent[d]; --d) {
+            idx[d] = 0;
+        }
+        if (d < 0) {
+            return;
+        }
+    }
+}
+
+}   // namespace internal
+
+/**************************************************
+                Chunked tensor files
+ **************************************************/
+
+/**
+ * @brief Writes the tensor to the chunked file @a path, split into chunks of
+ * shape @a chunk_shape. Chunks are encoded in parallel.
+ * @throw std::runtime_error when the file cannot be written, the chunk
+ * shape doesn't match the tensor or makes chunks of 4 GiB or more.
+ */
+template <typename T>
+void save_chunked(const std::string& path, const Tensor<T>& x,
+                  const std::vector<size_t>& chunk_shape) {
+    internal::ChunkGrid g(x.shape(), chunk_shape);
+    /* The index records the size of each encoded chunk, at most its raw
+    size, in 32 bits. */
+    size_t chunk_bytes = sizeof(T);
+    for (size_t d = 0; d < g.chunk.size(); ++d) {
+        chunk_bytes *= std::min(g.chunk[d], g.shape[d]);
+    }
+    if (chunk_bytes > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Chunks should be smaller than 4 GiB");
+    }
+    auto c = x.is_contiguous() ? x : x.copy();
+    T* data = const_cast<T*>(c.data_ptr());
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    uint8_t kind_size[4] = {uint8_t(internal::dtype_kind<T>()), uint8_t(sizeof(T)), 0, 0};
+    uint32_t ndim = uint32_t(x.ndim());
+    out.write(internal::chunked_file_magic, 4);
+    out.write(reinterpret_cast<const char*>(kind_size), 4);
+    out.write(reinterpret_cast<const char*>(&ndim), sizeof(ndim));
+    for (auto* v : {&g.shape, &g.chunk}) {
+        for (auto s : *v) {
+            uint64_t d = s;
+            out.write(reinterpret_cast<const char*>(&d), sizeof(d));
+        }
+    }
+
+    size_t n = g.count();
+    std::vector<internal::ChunkEntry> index(n);
+    uint64_t offset = uint64_t(out.tellp()) + n * sizeof(internal::ChunkEntry);
+    out.seekp(std::streamoff(offset));
+
+    std::vector<std::vector<uint8_t>> encoded(internal::chunk_write_batch);
+    for (size_t b0 = 0; b0 < n; b0 += internal::chunk_write_batch) {
+        size_t b1 = std::min(n, b0 + internal::chunk_write_batch);
+        internal::ThreadPool::instance().parallel_for(b1 - b0, 1, [&] (size_t b, size_t e) {
+            std::vector<T> box;
+            for (size_t k = b; k < e; ++k) {
+                auto cc = g.coords(b0 + k);
+                auto ext = g.extent(cc);
+                std::vector<size_t> origin(cc.size());
+                for (size_t d = 0; d < cc.size(); ++d) {
+                    origin[d] = cc[d] * g.chunk[d];
+                }
+                box.resize(std::accumulate(ext.begin(), ext.end(), size_t(1),
+                                           std::multiplies<size_t>()));
+                internal::copy_box(g.shape, origin, ext, data, box.data(), true);
+                encoded[k] = internal::encode_chunk(box.data(), box.size(), index[b0 + k].flags);
+            }
+        });
+        for (size_t k = b0; k < b1; ++k) {
+            auto& bytes = encoded[k - b0];
+            index[k].offset = offset;
+            index[k].size = uint32_t(bytes.size());
+            out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+            offset += bytes.size();
+        }
+    }
+
+    out.seekp(std::streamoff(12 + 16 * size_t(ndim)));
+    for (auto& e : index) {
+        out.write(reinterpret_cast<const char*>(&e.offset), sizeof(e.offset));
+        out.write(reinterpret_cast<const char*>(&e.size), sizeof(e.size));
+        out.write(reinterpret_cast<const char*>(&e.flags), sizeof(e.flags));
+    }
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+/**************************************************
+              DiskTensor declaration
+ **************************************************/
+
+/**
+ * @brief A tensor stored in a chunked file (see TL::save_chunked()), read on
+ * demand.
+ *
+ * Slicing reads and decodes only the chunks that the slice overlaps, in
+ * parallel. Decoded chunks are kept in a cache, the least recently used
+ * being dropped first once the cache holds more than its capacity.
+ * @tparam T Type of the elements in the file.
+ */
+template <typename T>
+class DiskTensor
+{
+public:
+    /**
+     * @brief Opens @a path, keeping up to @a cache_bytes of decoded chunks.
+     * @throw std::runtime_error when the file cannot be read or doesn't hold
+     * elements of type T.
+     */
+    explicit DiskTensor(const std::string& path, size_t cache_bytes = size_t(256) << 20);
+
+    DiskTensor(const DiskTensor&) = delete;
+    DiskTensor& operator=(const DiskTensor&) = delete;
+
+    ~DiskTensor() {
+        ::close(fd);
+    }
+
+    const std::vector<size_t>& shape() const {
+        return grid.shape;
+    }
+
+    const std::vector<size_t>& chunk_shape() const {
+        return grid.chunk;
+    }
+
+    size_t ndim() const {
+        return grid.shape.size();
+    }
+
+    size_t size() const {
+        return std::accumulate(grid.shape.begin(), grid.shape.end(), size_t(1),
+                               std::multiplies<size_t>());
+    }
+
+    /**
+     * @brief Reads the slice of the tensor, with the semantics of
+     * Tensor::operator()(const Slice&) but returning a new tensor.
+     * @throw std::out_of_range when the slice goes out of the tensor.
+     */
+    Tensor<T> operator()(const Slice&) const;
+
+    template <typename... Dims, typename = std::enable_if_t<Slice_valid<Dims...>()>>
+    Tensor<T> operator()(Dims... dims) const {
+        return (*this)(Slice(dims...));
+    }
+
+    /**
+     * @brief Reads the whole tensor.
+     */
+    Tensor<T> read() const;
+
+    /**
+     * @brief Returns the number of chunks read from the file since opening,
+     * cache misses included only.
+     */
+    size_t chunks_read() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return reads;
+    }
+
+private:
+    using Chunk = std::shared_ptr<const std::vector<T>>;
+
+    int fd;
+    internal::ChunkGrid grid;
+    std::vector<internal::ChunkEntry> index;
+
+    /* LRU cache of the decoded chunks, most recent first. */
+    size_t capacity;
+    mutable size_t cached = 0;
+    mutable std::list<std::pair<size_t, Chunk>> lru;
+    mutable std::unordered_map<size_t, typename std::list<std::pair<size_t, Chunk>>::iterator> where;
+    mutable size_t reads = 0;
+    mutable std::mutex mtx;
+
+    /**
+     * @brief Returns the decoded chunk @a id, from the cache or the file.
+     */
+    Chunk _chunk(size_t) const;
+};
+
+/**************************************************
+              DiskTensor definition
+ **************************************************/
+
+template <typename T>
+DiskTensor<T>::DiskTensor(const std::string& path, size_t cache_bytes)
+: capacity(cache_bytes) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[4];
+    uint8_t kind_size[4];
+    uint32_t ndim;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(kind_size), 4);
+    in.read(reinterpret_cast<char*>(&ndim), sizeof(ndim));
+    if (!in || std::memcmp(magic, internal::chunked_file_magic, 4)) {
+        throw std::runtime_error("Not a chunked tensor file");
+    }
+    if (char(kind_size[0]) != internal::dtype_kind<T>() || kind_size[1] != sizeof(T)) {
+        throw std::runtime_error("Type of the tensor file mismatch");
+    }
+
+    std::vector<size_t> shape(ndim), chunk(ndim);
+    for (auto* v : {&shape, &chunk}) {
+        for (auto& s : *v) {
+            uint64_t d;
+            in.read(reinterpret_cast<char*>(&d), sizeof(d));
+            s = size_t(d);
+        }
+    }
+    grid = internal::ChunkGrid(shape, chunk);
+    index.resize(grid.count());
+    for (auto& e : index) {
+        in.read(reinterpret_cast<char*>(&e.offset), sizeof(e.offset));
+        in.read(reinterpret_cast<char*>(&e.size), sizeof(e.size));
+        in.read(reinterpret_cast<char*>(&e.flags), sizeof(e.flags));
+    }
+    if (!in) {
+        throw std::runtime_error("Not a chunked tensor file");
+    }
+
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+}
+
+template <typename T>
+typename DiskTensor<T>::Chunk DiskTensor<T>::_chunk(size_t id) const {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = where.find(id);
+        if (it != where.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+        ++reads;
+    }
+
+    /* Read and decode out of the lock, so that chunks are decoded in
+    parallel. Two threads may decode the same chunk, both get it. */
+    const auto& e = index[id];
+    std::vector<uint8_t> bytes(e.size);
+    size_t done = 0;
+    while (done < bytes.size()) {
+        ssize_t r = ::pread(fd, bytes.data() + done, bytes.size() - done, off_t(e.offset + done));
+        if (r <= 0) {
+            throw std::runtime_error("Unexpected end of tensor file");
+        }
+        done += size_t(r);
+    }
+    auto ext = grid.extent(grid.coords(id));
+    auto chunk = std::make_shared<std::vector<T>>(
+        std::accumulate(ext.begin(), ext.end(), size_t(1), std::multiplies<size_t>())
+    );
+    internal::decode_chunk(bytes.data(), bytes.size(), e.flags, chunk->data(), chunk->size());
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!where.count(id)) {
+        lru.emplace_front(id, chunk);
+        where[id] = lru.begin();
+        cached += chunk->size() * sizeof(T);
+        while (cached > capacity && lru.size() > 1) {
+            cached -= lru.back().second->size() * sizeof(T);
+            where.erase(lru.back().first);
+            lru.pop_back();
+        }
+    }
+    return chunk;
+}
+
+template <typename T>
+Tensor<T> DiskTensor<T>::operator()(const Slice& sl) const {
+    size_t nd = ndim();
+    if (sl.ranges.size() != nd) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+
+    /* Along each axis, the positions of the result falling in each chunk:
+    runs[d] holds (chunk, first position, end position). */
+    std::vector<size_t> out_shape(nd);
+    std::vector<std::vector<std::array<size_t, 3>>> runs(nd);
+    for (size_t d = 0; d < nd; ++d) {
+        const Range& r = sl.ranges[d];
+        if (r.low >= r.high) {
+            throw std::runtime_error("`low` range should be lesser than the `high` range");
+        }
+        if (r.high > grid.shape[d]) {
+            throw std::out_of_range("Index out of range");
+        }
+        out_shape[d] = r.count();
+        long first = long(r.first());
+        for (size_t i = 0; i < out_shape[d]; ++i) {
+            size_t c = size_t(first + long(i) * r.step) / grid.chunk[d];
+            if (runs[d].empty() || runs[d].back()[0] != c) {
+                runs[d].push_back({c, i, i + 1});
+            }
+            else {
+                runs[d].back()[2] = i + 1;
+            }
+        }
+    }
+
+    /* A 0 dimensional tensor is a single chunk of one element. */
+    if (!nd) {
+        return Tensor<T>(_chunk(0)->data()[0]);
+    }
+
+    /* One task per overlapped chunk. */
+    size_t tasks = 1;
+    for (auto& r : runs) {
+        tasks *= r.size();
+    }
+    size_t total = std::accumulate(out_shape.begin(), out_shape.end(), size_t(1),
+                                   std::multiplies<size_t>());
+    internal::Buffer<T> out(total);
+    T* dst = out.data();
+    std::vector<size_t> out_stride(nd, 1);
+    for (size_t d = nd; d-- > 1;) {
+        out_stride[d - 1] = out_stride[d] * out_shape[d];
+    }
+
+    internal::ThreadPool::instance().parallel_for(tasks, 1, [&] (size_t b, size_t e) {
+        for (size_t t = b; t < e; ++t) {
+            /* The run of each axis of this task, and the chunk they make. */
+            std::vector<size_t> which(nd), cc(nd);
+            size_t rest = t, id = 0;
+            for (size_t d = nd; d-- > 0;) {
+                which[d] = rest % runs[d].size();
+                rest /= runs[d].size();
+                cc[d] = runs[d][which[d]][0];
+            }
+            for (size_t d = 0; d < nd; ++d) {
+                id = id * grid.grid[d] + cc[d];
+            }
+            auto chunk = _chunk(id);
+            auto ext = grid.extent(cc);
+            std::vector<size_t> ch_stride(nd, 1);
+            for (size_t d = nd; d-- > 1;) {
+                ch_stride[d - 1] = ch_stride[d] * ext[d];
+            }
+
+            /* Walk the positions of the result in the task. */
+            std::vector<size_t> pos(nd);
+            for (size_t d = 0; d < nd; ++d) {
+                pos[d] = runs[d][which[d]][1];
+            }
+            auto src_index = [&] (size_t d, size_t i) {
+                const Range& r = sl.ranges[d];
+                return size_t(long(r.first()) + long(i) * r.step) - cc[d] * grid.chunk[d];
+            };
+            const auto& last = runs[nd - 1][which[nd - 1]];
+            size_t row = last[2] - last[1];
+            long step = sl.ranges[nd - 1].step;
+            while (true) {
+                size_t so = 0, oo = 0;
+                for (size_t d = 0; d < nd; ++d) {
+                    so += src_index(d, pos[d]) * ch_stride[d];
+                    oo += pos[d] * out_stride[d];
+                }
+                const T* s = chunk->data() + so;
+                if (step == 1) {
+                    std::copy_n(s, row, dst + oo);
+                }
+                else {
+                    for (size_t i = 0; i < row; ++i) {
+                        dst[oo + i] = s[long(i) * step];
+                    }
+                }
+
+                long d = long(nd) - 2;
+                for (; d >= 0; --d) {
+                    if (++pos[d] < runs[d][which[d]][2]) {
+                        break;
+                    }
+                    pos[d] = runs[d][which[d]][1];
+                }
+                if (d < 0) {
+                    break;
+                }
+            }
+        }
+    });
+    return Tensor<T>(std::move(out), out_shape);
+}
+
+template <typename T>
+Tensor<T> DiskTensor<T>::read() const {
+    std::vector<Range> ranges;
+    for (auto s : grid.shape) {
+        ranges.emplace_back(0, s);
+    }
+    return (*this)(Slice(ranges));
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_DISK_TENSOR_H_
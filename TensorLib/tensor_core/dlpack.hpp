@@ -0,0 +1,162 @@
+#ifndef TENSORLIB_DLPACK_H_
+#define TENSORLIB_DLPACK_H_
+
+#include "tensor.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/*
+ * The DLPack structures, from <dlpack/dlpack.h> when available. Otherwise
+ * the part of the header used here is declared with the same layout and
+ * include guard, so that including the real header afterwards is harmless.
+ */
+#if __has_include(<dlpack/dlpack.h>)
+#include <dlpack/dlpack.h>
+#elif !defined(DLPACK_DLPACK_H_)
+#define DLPACK_DLPACK_H_
+
+extern "C" {
+
+typedef enum {
+    kDLCPU = 1,
+    kDLCUDA = 2,
+    kDLCUDAHost = 3,
+} DLDeviceType;
+
+typedef struct {
+    DLDeviceType device_type;
+    int32_t device_id;
+} DLDevice;
+
+typedef enum {
+    kDLInt = 0U,
+    kDLUInt = 1U,
+    kDLFloat = 2U,
+} DLDataTypeCode;
+
+typedef struct {
+    uint8_t code;
+    uint8_t bits;
+    uint16_t lanes;
+} DLDataType;
+
+typedef struct {
+    void* data;
+    DLDevice device;
+    int32_t ndim;
+    DLDataType dtype;
+    int64_t* shape;
+    /* In elements, NULL for row major order. */
+    int64_t* strides;
+    uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor {
+    DLTensor dl_tensor;
+    void* manager_ctx;
+    void (*deleter)(struct DLManagedTensor* self);
+} DLManagedTensor;
+
+}   // extern "C"
+
+#endif
+
+namespace TL {
+
+namespace internal {
+
+template <typename T>
+DLDataType dlpack_dtype() {
+    static_assert(std::is_arithmetic<T>::value, "DLPack holds arithmetic types");
+    uint8_t code = std::is_floating_point<T>::value ? kDLFloat
+        : std::is_signed<T>::value ? kDLInt : kDLUInt;
+    return DLDataType{code, uint8_t(8 * sizeof(T)), 1};
+}
+
+/**
+ * @brief What a DLManagedTensor exported by TL::to_dlpack() keeps alive: the
+ * tensor, sharing its elements, and the shape and strides it points to.
+ */
+template <typename T>
+struct DLPack_context
+{
+    Tensor<T> tensor;
+    std::vector<int64_t> shape, strides;
+    DLManagedTensor managed;
+};
+
+}   // namespace internal
+
+/**************************************************
+                    DLPack
+ **************************************************/
+
+/**
+ * @brief Exports the tensor to DLPack without copying it. The elements stay
+ * alive until the consumer calls the deleter of the result.
+ */
+template <typename T>
+DLManagedTensor* to_dlpack(const Tensor<T>& x) {
+    auto* ctx = new internal::DLPack_context<T>{x, {}, {}, {}};
+    for (size_t d = 0; d < x.ndim(); ++d) {
+        ctx->shape.push_back(int64_t(x.shape()[d]));
+        ctx->strides.push_back(int64_t(x.strides()[d]));
+    }
+
+    DLTensor& t = ctx->managed.dl_tensor;
+    t.data = const_cast<T*>(x.data_ptr());
+    t.device = DLDevice{kDLCPU, 0};
+    t.ndim = int32_t(x.ndim());
+    t.dtype = internal::dlpack_dtype<T>();
+    t.shape = ctx->shape.data();
+    t.strides = ctx->strides.data();
+    t.byte_offset = 0;
+    ctx->managed.manager_ctx = ctx;
+    ctx->managed.deleter = [] (DLManagedTensor* self) {
+        delete static_cast<internal::DLPack_context<T>*>(self->manager_ctx);
+    };
+    return &ctx->managed;
+}
+
+/**
+ * @brief Imports a DLPack tensor without copying it, taking ownership of
+ * @a managed: its deleter is called once no tensor uses the elements.
+ * @throw std::runtime_error when the tensor isn't in CPU memory or doesn't
+ * hold elements of type T; @a managed is then left to the caller.
+ */
+template <typename T>
+Tensor<T> from_dlpack(DLManagedTensor* managed) {
+    const DLTensor& t = managed->dl_tensor;
+    if (t.device.device_type != kDLCPU && t.device.device_type != kDLCUDAHost) {
+        throw std::runtime_error("DLPack tensor isn't in CPU memory");
+    }
+    DLDataType dtype = internal::dlpack_dtype<T>();
+    if (t.dtype.code != dtype.code || t.dtype.bits != dtype.bits || t.dtype.lanes != 1) {
+        throw std::runtime_error("Type of the DLPack tensor mismatch");
+    }
+
+    std::vector<size_t> shape(t.shape, t.shape + t.ndim);
+    std::vector<long> strides(shape.size(), 1);
+    if (t.strides) {
+        strides.assign(t.strides, t.strides + t.ndim);
+    }
+    else {
+        for (size_t d = shape.size(); d-- > 1;) {
+            strides[d - 1] = strides[d] * long(shape[d]);
+        }
+    }
+    T* ptr = reinterpret_cast<T*>(static_cast<char*>(t.data) + t.byte_offset);
+    std::function<void(T*)> release;
+    if (managed->deleter) {
+        release = [managed] (T*) { managed->deleter(managed); };
+    }
+    return Tensor<T>(ptr, shape, strides, std::move(release));
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_DLPACK_H_
@@ -0,0 +1,406 @@
+#ifndef TENSORLIB_DYNAMIC_TENSOR_H_
+#define TENSORLIB_DYNAMIC_TENSOR_H_
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+#include "storage.hpp"
+#include "linalg.hpp"
+#include "tensor_io.hpp"
+#include "dlpack.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace TL {
+
+/**
+ * @brief Type of the elements of a TL::DynamicTensor.
+ */
+enum class DType {
+    Int8, Int16, Int32, Int64,
+    UInt8, UInt16, UInt32, UInt64,
+    Float32, Float64
+};
+
+namespace internal {
+
+/* Elements per task of type conversions. */
+constexpr size_t cast_grain = 1 << 14;
+
+/* A tensor of each DType, in the same order. */
+using Dynamic_variant = std::variant<
+    Tensor<int8_t>, Tensor<int16_t>, Tensor<int32_t>, Tensor<int64_t>,
+    Tensor<uint8_t>, Tensor<uint16_t>, Tensor<uint32_t>, Tensor<uint64_t>,
+    Tensor<float>, Tensor<double>
+>;
+
+/**
+ * @brief Stands for the type T in generic lambdas given to dispatch().
+ */
+template <typename T>
+struct Type_tag
+{
+    using type = T;
+};
+
+/**
+ * @brief Returns @a f(Type_tag<T>()), T being the element type of @a dtype.
+ * This is where an operation on a TL::DynamicTensor picks its statically
+ * typed kernel, once for all the elements.
+ */
+template <typename F>
+decltype(auto) dispatch(DType dtype, F&& f) {
+    switch (dtype) {
+    case DType::Int8: return f(Type_tag<int8_t>());
+    case DType::Int16: return f(Type_tag<int16_t>());
+    case DType::Int32: return f(Type_tag<int32_t>());
+    case DType::Int64: return f(Type_tag<int64_t>());
+    case DType::UInt8: return f(Type_tag<uint8_t>());
+    case DType::UInt16: return f(Type_tag<uint16_t>());
+    case DType::UInt32: return f(Type_tag<uint32_t>());
+    case DType::UInt64: return f(Type_tag<uint64_t>());
+    case DType::Float32: return f(Type_tag<float>());
+    case DType::Float64: return f(Type_tag<double>());
+    }
+    throw std::runtime_error("Unknown dtype");
+}
+
+/**
+ * @brief Returns the DType of the elements of @a kind ('f' floating point,
+ * 'i' signed, 'u' unsigned) and @a size bytes.
+ * @throw std::runtime_error when there is none.
+ */
+inline DType dtype_from(char kind, size_t size) {
+    if (kind == 'f' && (size == 4 || size == 8)) {
+        return size == 4 ? DType::Float32 : DType::Float64;
+    }
+    int log = size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : size == 8 ? 3 : -1;
+    if ((kind != 'i' && kind != 'u') || log < 0) {
+        throw std::runtime_error("Unsupported dtype");
+    }
+    return DType(int(kind == 'i' ? DType::Int8 : DType::UInt8) + log);
+}
+
+}   // namespace internal
+
+/**************************************************
+                      DType
+ **************************************************/
+
+/**
+ * @brief Returns the DType of elements of type T.
+ */
+template <typename T>
+constexpr DType dtype_of() {
+    static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                  "DType is defined for arithmetic types");
+    if constexpr (std::is_floating_point<T>::value) {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "No DType for this floating point type");
+        return sizeof(T) == 4 ? DType::Float32 : DType::Float64;
+    }
+    else {
+        constexpr int log = sizeof(T) == 1 ? 0 : sizeof(T) == 2 ? 1 : sizeof(T) == 4 ? 2 : 3;
+        return DType(int(std::is_signed<T>::value ? DType::Int8 : DType::UInt8) + log);
+    }
+}
+
+/**
+ * @brief Returns the size in bytes of an element of type @a dtype.
+ */
+inline size_t dtype_size(DType dtype) {
+    return internal::dispatch(dtype, [] (auto tag) {
+        return sizeof(typename decltype(tag)::type);
+    });
+}
+
+/**
+ * @brief Returns the name of @a dtype, as in "float32".
+ */
+inline std::string dtype_name(DType dtype) {
+    return internal::dispatch(dtype, [] (auto tag) {
+        using T = typename decltype(tag)::type;
+        std::string kind = std::is_floating_point<T>::value ? "float"
+            : std::is_signed<T>::value ? "int" : "uint";
+        return kind + std::to_string(8 * sizeof(T));
+    });
+}
+
+/**
+ * @brief Returns the type in which elements of types @a a and @a b are
+ * combined: the larger of two floating point or same signedness types, a
+ * signed type holding both a signed and an unsigned one, and float64 when an
+ * integer type wouldn't fit in float32 or in int64.
+ */
+inline DType promote_types(DType a, DType b) {
+    if (a == b) {
+        return a;
+    }
+    auto kind = [] (DType t) {
+        return t >= DType::Float32 ? 'f' : t >= DType::UInt8 ? 'u' : 'i';
+    };
+    char ka = kind(a), kb = kind(b);
+    size_t sa = dtype_size(a), sb = dtype_size(b);
+    if (ka == kb) {
+        return sa > sb ? a : b;
+    }
+    if (ka == 'f' || kb == 'f') {
+        size_t sf = ka == 'f' ? sa : sb, si = ka == 'f' ? sb : sa;
+        return sf == 8 || si >= 4 ? DType::Float64 : DType::Float32;
+    }
+    size_t ss = ka == 'i' ? sa : sb, su = ka == 'i' ? sb : sa;
+    if (ss > su) {
+        return ka == 'i' ? a : b;
+    }
+    return su < 8 ? internal::dtype_from('i', 2 * su) : DType::Float64;
+}
+
+/**
+ * @brief Returns a row major copy of @a x with its elements converted to U,
+ * in parallel.
+ */
+template <typename U, typename T>
+Tensor<U> astype(const Tensor<T>& x) {
+    auto c = x.is_contiguous() ? x : x.copy();
+    internal::Buffer<U> buf(c.size());
+    const T* src = c.data_ptr();
+    U* dst = buf.data();
+    internal::ThreadPool::instance().parallel_for(c.size(), internal::cast_grain, [&] (size_t b, size_t e) {
+        std::transform(src + b, src + e, dst + b, [] (T v) { return static_cast<U>(v); });
+    });
+    if (!c.ndim()) {
+        return Tensor<U>(buf[0]);
+    }
+    return Tensor<U>(std::move(buf), c.shape());
+}
+
+/*** DynamicTensor declaration ***/
+
+/**
+ * @brief A tensor whose element type is only known at run time, such as
+ * one read from a file. It holds a TL::Tensor of one of the DType types,
+ * sharing its elements, and its operations pick the kernel of that type once
+ * per call, so that elements are never touched through an indirection.
+ * Other operations are written with visit() and a generic lambda.
+ */
+class DynamicTensor
+{
+public:
+    DynamicTensor() = delete;
+
+    template <typename T>
+    DynamicTensor(Tensor<T> x) : tensor(std::move(x)) {}
+
+    /**
+     * @brief Constructs a tensor of type @a dtype and shape @a shape, filled
+     * with zeros.
+     */
+    DynamicTensor(DType dtype, const std::vector<size_t>& shape)
+    : tensor(internal::dispatch(dtype, [&] (auto tag) -> internal::Dynamic_variant {
+        using T = typename decltype(tag)::type;
+        if (shape.empty()) {
+            return Tensor<T>(T(0));
+        }
+        return Tensor<T>(internal::Buffer<T>(size_of(shape)), shape);
+    })) {}
+
+    /**
+     * @brief Returns @a f(x), x being the TL::Tensor held.
+     */
+    template <typename F>
+    decltype(auto) visit(F&& f) {
+        return std::visit(std::forward<F>(f), tensor);
+    }
+
+    template <typename F>
+    decltype(auto) visit(F&& f) const {
+        return std::visit(std::forward<F>(f), tensor);
+    }
+
+    DType dtype() const {
+        return DType(tensor.index());
+    }
+
+    std::vector<size_t> shape() const {
+        return visit([] (const auto& x) { return x.shape(); });
+    }
+
+    std::vector<long> strides() const {
+        return visit([] (const auto& x) { return x.strides(); });
+    }
+
+    size_t ndim() const {
+        return visit([] (const auto& x) { return x.ndim(); });
+    }
+
+    size_t size() const {
+        return visit([] (const auto& x) { return x.size(); });
+    }
+
+    bool is_contiguous() const {
+        return visit([] (const auto& x) { return x.is_contiguous(); });
+    }
+
+    /**
+     * @brief Returns whether the elements are of type T.
+     */
+    template <typename T>
+    bool holds() const {
+        return std::holds_alternative<Tensor<T>>(tensor);
+    }
+
+    /**
+     * @brief Returns the tensor, of elements of type T.
+     * @throw std::runtime_error when they are of another type.
+     */
+    template <typename T>
+    Tensor<T>& get() {
+        if (!holds<T>()) {
+            throw std::runtime_error("DType mismatch: the tensor holds " + dtype_name(dtype()));
+        }
+        return std::get<Tensor<T>>(tensor);
+    }
+
+    template <typename T>
+    const Tensor<T>& get() const {
+        return const_cast<DynamicTensor*>(this)->get<T>();
+    }
+
+    /**
+     * @brief Returns the tensor with its elements converted to @a dtype,
+     * or the tensor itself when they are of that type.
+     */
+    DynamicTensor astype(DType dtype) const {
+        if (dtype == this->dtype()) {
+            return *this;
+        }
+        return visit([&] (const auto& x) {
+            return internal::dispatch(dtype, [&] (auto tag) -> DynamicTensor {
+                return TL::astype<typename decltype(tag)::type>(x);
+            });
+        });
+    }
+
+    DynamicTensor copy() const {
+        return visit([] (const auto& x) -> DynamicTensor { return x.copy(); });
+    }
+
+private:
+    static size_t size_of(const std::vector<size_t>& shape) {
+        size_t n = 1;
+        for (auto s : shape) {
+            n *= s;
+        }
+        return n;
+    }
+
+    internal::Dynamic_variant tensor;
+};
+
+namespace internal {
+
+/**
+ * @brief Applies @a op to @a a and @a b converted to their promoted type.
+ */
+template <typename F>
+DynamicTensor dynamic_binary(const DynamicTensor& a, const DynamicTensor& b, F&& op) {
+    DType t = promote_types(a.dtype(), b.dtype());
+    DynamicTensor x = a.astype(t), y = b.astype(t);
+    return x.visit([&] (auto& lhs) -> DynamicTensor {
+        using T = typename std::decay_t<decltype(lhs)>::value_type;
+        return op(lhs, y.get<T>());
+    });
+}
+
+}   // namespace internal
+
+/* ------- Binary operations, in the promoted type ---------- */
+
+inline DynamicTensor operator+(const DynamicTensor& a, const DynamicTensor& b) {
+    return internal::dynamic_binary(a, b, [] (auto& x, auto& y) { return x + y; });
+}
+
+inline DynamicTensor operator-(const DynamicTensor& a, const DynamicTensor& b) {
+    return internal::dynamic_binary(a, b, [] (auto& x, auto& y) { return x - y; });
+}
+
+inline DynamicTensor operator*(const DynamicTensor& a, const DynamicTensor& b) {
+    return internal::dynamic_binary(a, b, [] (auto& x, auto& y) { return x * y; });
+}
+
+/**
+ * @brief Element-wise division, in the promoted type: integer tensors are
+ * divided as integers.
+ */
+inline DynamicTensor operator/(const DynamicTensor& a, const DynamicTensor& b) {
+    return internal::dynamic_binary(a, b, [] (auto& x, auto& y) { return x / y; });
+}
+
+/**
+ * @brief Matrix product, see TL::matmul().
+ */
+inline DynamicTensor matmul(const DynamicTensor& a, const DynamicTensor& b) {
+    return internal::dynamic_binary(a, b, [] (auto& x, auto& y) { return TL::matmul(x, y); });
+}
+
+inline std::ostream& operator<<(std::ostream& out, const DynamicTensor& x) {
+    return x.visit([&] (const auto& t) -> std::ostream& { return out << t; });
+}
+
+/* ------- I/O of tensors of any type ---------- */
+
+/**
+ * @brief Writes the tensor to the file @a path, see TL::save().
+ */
+inline void save(const std::string& path, const DynamicTensor& x) {
+    x.visit([&] (const auto& t) { save(path, t); });
+}
+
+/**
+ * @brief Reads the tensor saved in the file @a path, of the type recorded
+ * in the file.
+ * @throw std::runtime_error when the file cannot be read or holds elements
+ * of no DType.
+ */
+inline DynamicTensor load_dynamic(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    auto h = internal::TensorFileHeader::read(in);
+    in.close();
+    return internal::dispatch(internal::dtype_from(h.kind, h.elem_size), [&] (auto tag) -> DynamicTensor {
+        return load<typename decltype(tag)::type>(path);
+    });
+}
+
+inline DLManagedTensor* to_dlpack(const DynamicTensor& x) {
+    return x.visit([] (const auto& t) { return to_dlpack(t); });
+}
+
+/**
+ * @brief Imports a DLPack tensor of any DType without copying it, see
+ * TL::from_dlpack<T>().
+ * @throw std::runtime_error when it isn't in CPU memory or holds elements
+ * of no DType.
+ */
+inline DynamicTensor from_dlpack(DLManagedTensor* managed) {
+    const DLDataType& t = managed->dl_tensor.dtype;
+    char kind = t.code == kDLFloat ? 'f' : t.code == kDLInt ? 'i' : t.code == kDLUInt ? 'u' : 0;
+    if (!kind || t.lanes != 1 || t.bits % 8) {
+        throw std::runtime_error("Unsupported dtype");
+    }
+    return internal::dispatch(internal::dtype_from(kind, t.bits / 8), [&] (auto tag) -> DynamicTensor {
+        return from_dlpack<typename decltype(tag)::type>(managed);
+    });
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_DYNAMIC_TENSOR_H_
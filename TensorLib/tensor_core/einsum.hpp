@@ -0,0 +1,523 @@
+#ifndef TENSORLIB_EINSUM_H_
+#define TENSORLIB_EINSUM_H_
+
+#include "tensor.hpp"
+#include "linalg.hpp"
+#include "nd_loop.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/*
+ * einsum is evaluated as a sequence of pairwise contractions. The order is
+ * the one minimizing the number of multiply-adds plus the size of the
+ * intermediates, found exactly by dynamic programming over the subsets of
+ * operands when there are few of them, greedily otherwise.
+ *
+ * A pairwise contraction sorts the labels of its operands into batch labels
+ * (in both and kept), contracted labels (in both, not kept) and free labels
+ * of each side, and becomes a loop of GEMMs over the batch labels. Each group
+ * of labels is fused into a single strided axis when the layout allows it, so
+ * that no operand is permuted in memory; otherwise only that operand is
+ * copied in the order the GEMM needs. Labels present in a single operand and
+ * not kept are summed out before the contraction.
+ */
+
+/* Operand counts up to this size get an optimal contraction order. */
+constexpr size_t einsum_optimal_max = 10;
+/* Multiply-adds done by a chunk of the thread pool at least. */
+constexpr size_t einsum_grain = 1 << 15;
+
+/**
+ * @brief Index of a subscript label in [0, 52), -1 when the character isn't
+ * a letter.
+ */
+inline int label_bit(char c) {
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a';
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return 26 + (c - 'A');
+    }
+    return -1;
+}
+
+inline uint64_t label_mask(const std::string& labels) {
+    uint64_t m = 0;
+    for (char c : labels) {
+        m |= uint64_t(1) << label_bit(c);
+    }
+    return m;
+}
+
+/**
+ * @brief An operand or intermediate of an einsum: a strided array with a
+ * label per axis, each label appearing once.
+ */
+template <typename T>
+struct Einsum_term
+{
+    std::string labels;
+    std::vector<size_t> dims;
+    std::vector<long> strides;
+    const T* ptr;
+    /* Set when the term owns its (contiguous) data. */
+    std::shared_ptr<Buffer<T>> buf;
+
+    bool has(char c) const {
+        return labels.find(c) != std::string::npos;
+    }
+
+    size_t dim(char c) const {
+        return dims[labels.find(c)];
+    }
+
+    long stride(char c) const {
+        return strides[labels.find(c)];
+    }
+};
+
+/**
+ * @brief Visits the elements of a strided array of shape @a dims and assigns
+ * (or adds) them to another strided array. Destination strides of 0 sum the
+ * corresponding axes.
+ */
+template <typename T>
+void strided_apply(const std::vector<size_t>& dims, const T* src, const std::vector<long>& ss,
+                   T* dst, const std::vector<long>& ds, bool accumulate) {
+    nd_loop<T, 2>(dims, {dst, const_cast<T*>(src)}, {&ds, &ss},
+        [=] (std::array<T*, 2> p, size_t n, const std::array<long, 2>& s) {
+            if (accumulate) {
+                for (size_t i = 0; i < n; ++i) {
+                    p[0][long(i) * s[0]] += p[1][long(i) * s[1]];
+                }
+            }
+            else {
+                for (size_t i = 0; i < n; ++i) {
+                    p[0][long(i) * s[0]] = p[1][long(i) * s[1]];
+                }
+            }
+        }
+    );
+}
+
+/**
+ * @brief Copies the term into a contiguous one with the labels @a order,
+ * summing the labels missing from @a order.
+ */
+template <typename T>
+Einsum_term<T> reduce_to(const Einsum_term<T>& t, const std::string& order) {
+    Einsum_term<T> res;
+    res.labels = order;
+    size_t size = 1;
+    for (char c : order) {
+        res.dims.push_back(t.dim(c));
+        size *= res.dims.back();
+    }
+    res.strides.assign(order.size(), 1);
+    for (size_t i = order.size(); i-- > 1;) {
+        res.strides[i - 1] = res.strides[i] * long(res.dims[i]);
+    }
+    res.buf = std::make_shared<Buffer<T>>(size);
+    res.ptr = res.buf->data();
+
+    std::vector<long> ds;
+    for (char c : t.labels) {
+        ds.push_back(res.has(c) ? res.stride(c) : 0);
+    }
+    strided_apply(t.dims, t.ptr, t.strides, res.buf->data(), ds, order.size() < t.labels.size());
+    return res;
+}
+
+/**
+ * @brief Size and stride of the axes of @a group seen as a single axis, when
+ * the layout of the term allows it.
+ */
+template <typename T>
+bool fuse(const Einsum_term<T>& t, const std::string& group, size_t& size, long& stride) {
+    size = 1;
+    stride = 0;
+    for (size_t i = group.size(); i-- > 0;) {
+        size_t d = t.dim(group[i]);
+        if (d == 1) {
+            continue;
+        }
+        if (size == 1) {
+            stride = t.stride(group[i]);
+        }
+        else if (t.stride(group[i]) != stride * long(size)) {
+            return false;
+        }
+        size *= d;
+    }
+    return true;
+}
+
+/**
+ * @brief Orders the labels by decreasing stride in the term, the order in
+ * which they are most likely to fuse.
+ */
+template <typename T>
+void by_stride(std::string& group, const Einsum_term<T>& t) {
+    std::stable_sort(group.begin(), group.end(), [&] (char a, char b) {
+        return t.stride(a) > t.stride(b);
+    });
+}
+
+/**
+ * @brief Contracts two terms, keeping the labels in @a keep.
+ */
+template <typename T>
+Einsum_term<T> contract(Einsum_term<T> A, Einsum_term<T> B, uint64_t keep) {
+    auto kept = [keep] (char c) {
+        return (keep >> label_bit(c)) & 1;
+    };
+
+    std::string a_need, b_need;
+    for (char c : A.labels) {
+        if (B.has(c) || kept(c)) {
+            a_need += c;
+        }
+    }
+    for (char c : B.labels) {
+        if (A.has(c) || kept(c)) {
+            b_need += c;
+        }
+    }
+    if (a_need.size() < A.labels.size()) {
+        A = reduce_to(A, a_need);
+    }
+    if (b_need.size() < B.labels.size()) {
+        B = reduce_to(B, b_need);
+    }
+
+    std::string batch, K, M, N;
+    for (char c : A.labels) {
+        (B.has(c) ? (kept(c) ? batch : K) : M) += c;
+    }
+    for (char c : B.labels) {
+        if (!A.has(c)) {
+            N += c;
+        }
+    }
+    by_stride(M, A);
+    by_stride(K, A);
+    by_stride(N, B);
+
+    size_t m, n, k;
+    long rs_a, cs_a, rs_b, cs_b;
+    if (!fuse(A, M, m, rs_a) || !fuse(A, K, k, cs_a)) {
+        A = reduce_to(A, batch + M + K);
+        fuse(A, M, m, rs_a);
+        fuse(A, K, k, cs_a);
+    }
+    if (!fuse(B, K, k, rs_b) || !fuse(B, N, n, cs_b)) {
+        B = reduce_to(B, batch + K + N);
+        fuse(B, K, k, rs_b);
+        fuse(B, N, n, cs_b);
+    }
+
+    Einsum_term<T> res;
+    res.labels = batch + M + N;
+    for (char c : res.labels) {
+        res.dims.push_back(A.has(c) ? A.dim(c) : B.dim(c));
+    }
+    res.strides.assign(res.labels.size(), 1);
+    for (size_t i = res.labels.size(); i-- > 1;) {
+        res.strides[i - 1] = res.strides[i] * long(res.dims[i]);
+    }
+
+    size_t nb = 1;
+    for (char c : batch) {
+        nb *= A.dim(c);
+    }
+    res.buf = std::make_shared<Buffer<T>>(nb * m * n);
+    res.ptr = res.buf->data();
+    T* out = res.buf->data();
+
+    auto run = [&] (size_t b0, size_t b1) {
+        for (size_t b = b0; b < b1; ++b) {
+            long off_a = 0, off_b = 0;
+            size_t r = b;
+            for (size_t i = batch.size(); i-- > 0;) {
+                size_t d = A.dim(batch[i]);
+                off_a += long(r % d) * A.stride(batch[i]);
+                off_b += long(r % d) * B.stride(batch[i]);
+                r /= d;
+            }
+            gemm(m, n, k, A.ptr + off_a, rs_a, cs_a, B.ptr + off_b, rs_b, cs_b,
+                 out + b * m * n, long(n), 1L);
+        }
+    };
+    auto& pool = ThreadPool::instance();
+    if (nb > 1 && m < gemm_mc * pool.size()) {
+        size_t work = std::max<size_t>(m * n * k, 1);
+        pool.parallel_for(nb, std::max<size_t>(einsum_grain / work, 1), run);
+    }
+    else {
+        run(0, nb);
+    }
+    return res;
+}
+
+/**
+ * @brief Order of the pairwise contractions of operands with label sets
+ * @a labels, as pairs of subsets of operands merged one after the other.
+ */
+inline std::vector<std::pair<uint64_t, uint64_t>> einsum_path(
+    const std::vector<uint64_t>& labels, uint64_t out, const std::array<double, 52>& extent
+) {
+    size_t n = labels.size();
+    std::vector<std::pair<uint64_t, uint64_t>> path;
+    auto size_of = [&] (uint64_t m) {
+        double s = 1;
+        for (size_t b = 0; b < 52; ++b) {
+            if ((m >> b) & 1) {
+                s *= extent[b];
+            }
+        }
+        return s;
+    };
+
+    if (n <= einsum_optimal_max) {
+        size_t full = (size_t(1) << n) - 1;
+        std::vector<uint64_t> lab(full + 1, 0), keep(full + 1, 0);
+        for (size_t S = 1; S <= full; ++S) {
+            size_t low = S & (~S + 1);
+            lab[S] = lab[S ^ low] | labels[__builtin_ctzll(low)];
+        }
+        for (size_t S = 1; S <= full; ++S) {
+            keep[S] = lab[S] & (out | lab[full ^ S]);
+        }
+
+        std::vector<double> cost(full + 1, std::numeric_limits<double>::infinity());
+        std::vector<size_t> best(full + 1, 0);
+        for (size_t S = 1; S <= full; ++S) {
+            if (!(S & (S - 1))) {
+                cost[S] = 0;
+                continue;
+            }
+            for (size_t sub = (S - 1) & S; sub; sub = (sub - 1) & S) {
+                size_t rest = S ^ sub;
+                if (sub < rest) {
+                    continue;
+                }
+                double c = cost[sub] + cost[rest] + size_of(keep[sub] | keep[rest])
+                    + size_of(keep[S]);
+                if (c < cost[S]) {
+                    cost[S] = c;
+                    best[S] = sub;
+                }
+            }
+        }
+
+        std::function<void(size_t)> emit = [&] (size_t S) {
+            if (!(S & (S - 1))) {
+                return;
+            }
+            emit(best[S]);
+            emit(S ^ best[S]);
+            path.emplace_back(best[S], S ^ best[S]);
+        };
+        emit(full);
+        return path;
+    }
+
+    /* Greedy: merge the cheapest pair until one term is left. */
+    std::vector<uint64_t> items, item_labels;
+    for (size_t i = 0; i < n; ++i) {
+        items.push_back(uint64_t(1) << i);
+        item_labels.push_back(labels[i]);
+    }
+    auto keep_of = [&] (size_t skip_a, size_t skip_b, uint64_t lab) {
+        uint64_t others = out;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (i != skip_a && i != skip_b) {
+                others |= item_labels[i];
+            }
+        }
+        return lab & others;
+    };
+    while (items.size() > 1) {
+        double best = std::numeric_limits<double>::infinity();
+        size_t bi = 0, bj = 1;
+        for (size_t i = 0; i < items.size(); ++i) {
+            for (size_t j = i + 1; j < items.size(); ++j) {
+                double c = size_of(keep_of(i, i, item_labels[i]) | keep_of(j, j, item_labels[j]))
+                    + size_of(keep_of(i, j, item_labels[i] | item_labels[j]));
+                if (c < best) {
+                    best = c;
+                    bi = i;
+                    bj = j;
+                }
+            }
+        }
+        path.emplace_back(items[bi], items[bj]);
+        items[bi] |= items[bj];
+        item_labels[bi] = keep_of(bi, bj, item_labels[bi] | item_labels[bj]);
+        items.erase(items.begin() + bj);
+        item_labels.erase(item_labels.begin() + bj);
+    }
+    return path;
+}
+
+}   // namespace internal
+
+/**************************************************
+                    einsum
+ **************************************************/
+
+/**
+ * @brief Einstein summation over the operands, e.g. "bij,bjk->bik" for a
+ * batched matrix product, "ii->" for a trace or "ij->ji" for a transpose.
+ *
+ * Subscripts are letters, one per axis of each operand; a label repeated in
+ * an operand takes its diagonal. Without "->", the output has the labels
+ * appearing once, in alphabetical order. Labels missing from the output are
+ * summed. Ellipses and broadcasting are not supported.
+ * @throw std::runtime_error when the subscripts are invalid or the sizes of a
+ * label mismatch.
+ */
+template <typename T>
+Tensor<T> einsum(const std::string& subscripts, const std::vector<Tensor<T>>& operands) {
+    std::string spec;
+    for (char c : subscripts) {
+        if (c != ' ') {
+            spec += c;
+        }
+    }
+    size_t arrow = spec.find("->");
+    std::string lhs = spec.substr(0, arrow);
+    std::vector<std::string> inputs(1);
+    for (char c : lhs) {
+        if (c == ',') {
+            inputs.emplace_back();
+        }
+        else if (internal::label_bit(c) < 0) {
+            throw std::runtime_error("Invalid einsum subscripts");
+        }
+        else {
+            inputs.back() += c;
+        }
+    }
+    if (inputs.size() != operands.size() || operands.size() > 64) {
+        throw std::runtime_error("Number of operands mismatch the subscripts");
+    }
+
+    std::array<int, 52> count{};
+    for (auto& s : inputs) {
+        for (char c : s) {
+            ++count[internal::label_bit(c)];
+        }
+    }
+    std::string output;
+    if (arrow == std::string::npos) {
+        for (auto& s : inputs) {
+            for (char c : s) {
+                if (count[internal::label_bit(c)] == 1) {
+                    output += c;
+                }
+            }
+        }
+        std::sort(output.begin(), output.end());
+    }
+    else {
+        output = spec.substr(arrow + 2);
+        for (char c : output) {
+            int b = internal::label_bit(c);
+            if (b < 0 || !count[b] || std::count(output.begin(), output.end(), c) > 1) {
+                throw std::runtime_error("Invalid einsum subscripts");
+            }
+        }
+    }
+
+    /* Terms of the operands, repeated labels taking the diagonal. */
+    std::array<double, 52> extent;
+    std::array<bool, 52> seen{};
+    std::vector<internal::Einsum_term<T>> terms;
+    std::vector<uint64_t> labels;
+    for (size_t i = 0; i < operands.size(); ++i) {
+        auto& x = operands[i];
+        if (inputs[i].size() != x.ndim()) {
+            throw std::runtime_error("Number of subscripts mismatch the dimension");
+        }
+        auto shape = x.shape();
+        auto strides = x.strides();
+        internal::Einsum_term<T> t;
+        t.ptr = x.data_ptr();
+        for (size_t d = 0; d < shape.size(); ++d) {
+            char c = inputs[i][d];
+            int b = internal::label_bit(c);
+            if (seen[b] && size_t(extent[b]) != shape[d]) {
+                throw std::runtime_error("Dimensions Mismatch");
+            }
+            seen[b] = true;
+            extent[b] = double(shape[d]);
+            if (t.has(c)) {
+                t.strides[t.labels.find(c)] += strides[d];
+                continue;
+            }
+            t.labels += c;
+            t.dims.push_back(shape[d]);
+            t.strides.push_back(strides[d]);
+        }
+        labels.push_back(internal::label_mask(t.labels));
+        terms.push_back(std::move(t));
+    }
+
+    uint64_t out_mask = internal::label_mask(output);
+    std::map<uint64_t, internal::Einsum_term<T>> partial;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        partial.emplace(uint64_t(1) << i, std::move(terms[i]));
+    }
+    for (auto [a, b] : internal::einsum_path(labels, out_mask, extent)) {
+        uint64_t others = out_mask;
+        for (size_t i = 0; i < labels.size(); ++i) {
+            if (!(((a | b) >> i) & 1)) {
+                others |= labels[i];
+            }
+        }
+        auto& A = partial.at(a);
+        auto& B = partial.at(b);
+        uint64_t keep = (internal::label_mask(A.labels) | internal::label_mask(B.labels)) & others;
+        auto res = internal::contract(A, B, keep);
+        partial.erase(a);
+        partial.erase(b);
+        partial.emplace(a | b, std::move(res));
+    }
+
+    auto& last = partial.begin()->second;
+    if (!(last.labels == output && last.buf)) {
+        last = internal::reduce_to(last, output);
+    }
+    if (output.empty()) {
+        return Tensor<T>((*last.buf)[0]);
+    }
+    return Tensor<T>(std::move(*last.buf), last.dims);
+}
+
+/**
+ * @brief einsum with the operands passed as arguments,
+ * e.g. einsum("bij,bjk->bik", A, B).
+ */
+template <typename T, typename... Ts>
+Tensor<T> einsum(const std::string& subscripts, const Tensor<T>& first, const Ts&... rest) {
+    return einsum(subscripts, std::vector<Tensor<T>>{first, rest...});
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_EINSUM_H_
@@ -0,0 +1,391 @@
+#ifndef TENSORLIB_INDEXING_H_
+#define TENSORLIB_INDEXING_H_
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/* Elements copied by a chunk of the thread pool at least. */
+constexpr size_t index_grain = 1 << 14;
+/* Distance, in indices, at which the source of a random access is prefetched. */
+constexpr size_t prefetch_distance = 8;
+
+template <typename T>
+inline void prefetch(const T* p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+/**
+ * @brief Returns a contiguous version of @a index after checking that all of
+ * its values are below @a bound.
+ * @throw std::out_of_range when an index is out of bound.
+ */
+inline Tensor<size_t> checked_index(const Tensor<size_t>& index, size_t bound) {
+    auto c = index.is_contiguous() ? index : index.copy();
+    const size_t* p = c.data_ptr();
+    if (std::any_of(p, p + c.size(), [bound] (size_t i) { return i >= bound; })) {
+        throw std::out_of_range("Index out of range");
+    }
+    return c;
+}
+
+/**
+ * @brief Checks that @a index has the shape of @a x except along @a axis.
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T>
+void check_along_axis(const Tensor<T>& x, const std::vector<size_t>& index, size_t axis) {
+    auto shape = x.shape();
+    if (shape.size() != index.size()) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    for (size_t i = 0; i < shape.size(); ++i) {
+        if (i != axis && shape[i] != index[i]) {
+            throw std::runtime_error("Dimensions Mismatch");
+        }
+    }
+}
+
+/**
+ * @brief Runs @a func(in, out) on a contiguous version of @a x and writes the
+ * result back into @a x when it isn't contiguous.
+ */
+template <typename T, typename F>
+Tensor<T>& update_inplace(Tensor<T>& x, F func) {
+    if (x.is_contiguous()) {
+        func(x.data_ptr());
+        return x;
+    }
+    auto tmp = x.copy();
+    func(tmp.data_ptr());
+    return x._apply(tmp, [] (T& o, const T& t) { o = t; });
+}
+
+/**
+ * @brief Scatters the updates of every (row, lane) of an (outer, m, inner)
+ * index into the (outer, n, inner) destination with @a op(dst, src).
+ *
+ * Destinations along the axis are split into one range per thread, each
+ * thread scanning all the updates and applying only the ones landing in its
+ * range. No two threads write the same element, so there are no atomics, and
+ * updates to the same element are applied in index order, as serially.
+ */
+template <typename T, typename Op>
+void scatter_rows(T* dst, const T* src, const size_t* idx, size_t outer, size_t n,
+                  size_t m, size_t inner, bool row_index, Op op) {
+    auto& pool = ThreadPool::instance();
+    size_t parts = outer >= pool.size() ? 1 : std::max<size_t>(std::min(pool.size(), n), 1);
+    size_t work = std::max<size_t>(m * inner, 1);
+    pool.parallel_for(outer * parts, std::max<size_t>(index_grain / work, 1),
+                      [&] (size_t b, size_t e) {
+        for (size_t u = b; u < e; ++u) {
+            size_t o = u / parts, p = u % parts;
+            size_t lo = n * p / parts, hi = n * (p + 1) / parts;
+            T* d = dst + o * n * inner;
+            const T* s = src + o * m * inner;
+            for (size_t i = 0; i < m; ++i) {
+                if (row_index) {
+                    /* One index for the whole row. */
+                    size_t r = idx[i];
+                    if (r >= lo && r < hi) {
+                        T* dr = d + r * inner;
+                        const T* sr = s + i * inner;
+                        for (size_t k = 0; k < inner; ++k) {
+                            op(dr[k], sr[k]);
+                        }
+                    }
+                    continue;
+                }
+                const size_t* ir = idx + (o * m + i) * inner;
+                for (size_t k = 0; k < inner; ++k) {
+                    size_t r = ir[k];
+                    if (r >= lo && r < hi) {
+                        op(d[r * inner + k], s[i * inner + k]);
+                    }
+                }
+            }
+        }
+    });
+}
+
+}   // namespace internal
+
+/**************************************************
+              Indexing with index tensors
+ **************************************************/
+
+/*
+ * Indices are given as Tensor<size_t> and are checked against the shape
+ * before anything is written. Axes are counted from the end when negative.
+ */
+
+/**
+ * @brief Elements of @a x at the flat (row major) positions of @a index. The
+ * result has the shape of @a index.
+ * @throw std::out_of_range when an index is out of range.
+ */
+template <typename T>
+Tensor<T> take(const Tensor<T>& x, const Tensor<size_t>& index) {
+    auto idx = internal::checked_index(index, x.size());
+    auto c = x.is_contiguous() ? x : x.copy();
+    const T* src = c.data_ptr();
+    const size_t* ip = idx.data_ptr();
+    internal::Buffer<T> out(idx.size());
+
+    size_t m = idx.size();
+    internal::ThreadPool::instance().parallel_for(m, internal::index_grain, [&] (size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            if (i + internal::prefetch_distance < e) {
+                internal::prefetch(src + ip[i + internal::prefetch_distance]);
+            }
+            out[i] = src[ip[i]];
+        }
+    });
+    if (index.ndim() == 0) {
+        return Tensor<T>(out[0]);
+    }
+    return Tensor<T>(std::move(out), index.shape());
+}
+
+/**
+ * @brief Selects the entries given by the 1 dimensional @a index along
+ * @a axis. Each entry is copied as a block when @a x is contiguous, e.g. the
+ * selected rows of a matrix.
+ * @throw std::out_of_range when an index or the axis is out of range.
+ */
+template <typename T>
+Tensor<T> index_select(const Tensor<T>& x, long axis, const Tensor<size_t>& index) {
+    if (index.ndim() != 1) {
+        throw std::runtime_error("Index should be 1 dimensional");
+    }
+    size_t outer, n, inner;
+    internal::split_axis(x.shape(), axis, outer, n, inner);
+    auto idx = internal::checked_index(index, n);
+    auto c = x.is_contiguous() ? x : x.copy();
+    const T* src = c.data_ptr();
+    const size_t* ip = idx.data_ptr();
+
+    size_t m = idx.size();
+    internal::Buffer<T> out(outer * m * inner);
+    internal::ThreadPool::instance().parallel_for(outer * m,
+        std::max<size_t>(internal::index_grain / std::max<size_t>(inner, 1), 1),
+        [&] (size_t b, size_t e) {
+        for (size_t u = b; u < e; ++u) {
+            size_t o = u / m, i = u % m;
+            if (u + internal::prefetch_distance < e) {
+                size_t v = u + internal::prefetch_distance;
+                internal::prefetch(src + ((v / m) * n + ip[v % m]) * inner);
+            }
+            std::copy_n(src + (o * n + ip[i]) * inner, inner, out.data() + u * inner);
+        }
+    });
+
+    auto shape = x.shape();
+    shape[internal::normalize_axis(axis, shape.size())] = m;
+    return Tensor<T>(std::move(out), shape);
+}
+
+/**
+ * @brief Adds the entries of @a src along @a axis to the entries of @a x given
+ * by the 1 dimensional @a index, in place. Repeated indices accumulate. @a src
+ * has the shape of @a x with the length of @a index along @a axis.
+ * @throw std::out_of_range when an index or the axis is out of range.
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T>
+Tensor<T>& index_add(Tensor<T>& x, long axis, const Tensor<size_t>& index,
+                     const Tensor<T>& src) {
+    if (index.ndim() != 1) {
+        throw std::runtime_error("Index should be 1 dimensional");
+    }
+    size_t outer, n, inner;
+    internal::split_axis(x.shape(), axis, outer, n, inner);
+    auto shape = x.shape();
+    shape[internal::normalize_axis(axis, shape.size())] = index.size();
+    if (src.shape() != shape) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    auto idx = internal::checked_index(index, n);
+    auto s = src.is_contiguous() ? src : src.copy();
+
+    return internal::update_inplace(x, [&] (T* dst) {
+        internal::scatter_rows(dst, s.data_ptr(), idx.data_ptr(), outer, n, idx.size(),
+            inner, true, [] (T& d, const T& v) { d += v; });
+    });
+}
+
+/**
+ * @brief Gathers along @a axis: out[.., i, ..] = x[.., index[.., i, ..], ..].
+ * @a index has the shape of @a x except along @a axis, and gives the shape
+ * of the result.
+ * @throw std::out_of_range when an index or the axis is out of range.
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T>
+Tensor<T> gather(const Tensor<T>& x, long axis, const Tensor<size_t>& index) {
+    size_t outer, n, inner;
+    internal::split_axis(x.shape(), axis, outer, n, inner);
+    size_t a = internal::normalize_axis(axis, x.ndim());
+    internal::check_along_axis(x, index.shape(), a);
+    size_t m = index.shape()[a];
+    auto idx = internal::checked_index(index, n);
+    auto c = x.is_contiguous() ? x : x.copy();
+    const T* src = c.data_ptr();
+    const size_t* ip = idx.data_ptr();
+
+    internal::Buffer<T> out(idx.size());
+    internal::ThreadPool::instance().parallel_for(outer * m,
+        std::max<size_t>(internal::index_grain / std::max<size_t>(inner, 1), 1),
+        [&] (size_t b, size_t e) {
+        for (size_t u = b; u < e; ++u) {
+            const T* s = src + (u / m) * n * inner;
+            const size_t* ir = ip + u * inner;
+            T* d = out.data() + u * inner;
+            for (size_t k = 0; k < inner; ++k) {
+                d[k] = s[ir[k] * inner + k];
+            }
+        }
+    });
+    return Tensor<T>(std::move(out), index.shape());
+}
+
+/**
+ * @brief Scatters along @a axis, in place: x[.., index[.., i, ..], ..] =
+ * src[.., i, ..]. @a index and @a src have the same shape, which is the shape
+ * of @a x except along @a axis. For repeated indices the last one wins.
+ * @throw std::out_of_range when an index or the axis is out of range.
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T>
+Tensor<T>& scatter(Tensor<T>& x, long axis, const Tensor<size_t>& index,
+                   const Tensor<T>& src) {
+    size_t outer, n, inner;
+    internal::split_axis(x.shape(), axis, outer, n, inner);
+    size_t a = internal::normalize_axis(axis, x.ndim());
+    internal::check_along_axis(x, index.shape(), a);
+    size_t m = index.shape()[a];
+    if (src.shape() != index.shape()) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    auto idx = internal::checked_index(index, n);
+    auto s = src.is_contiguous() ? src : src.copy();
+
+    return internal::update_inplace(x, [&] (T* dst) {
+        internal::scatter_rows(dst, s.data_ptr(), idx.data_ptr(), outer, n, m, inner,
+            false, [] (T& d, const T& v) { d = v; });
+    });
+}
+
+/**
+ * @brief Same as TL::scatter() but adds to the destination, so that repeated
+ * indices accumulate.
+ */
+template <typename T>
+Tensor<T>& scatter_add(Tensor<T>& x, long axis, const Tensor<size_t>& index,
+                       const Tensor<T>& src) {
+    size_t outer, n, inner;
+    internal::split_axis(x.shape(), axis, outer, n, inner);
+    size_t a = internal::normalize_axis(axis, x.ndim());
+    internal::check_along_axis(x, index.shape(), a);
+    size_t m = index.shape()[a];
+    if (src.shape() != index.shape()) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    auto idx = internal::checked_index(index, n);
+    auto s = src.is_contiguous() ? src : src.copy();
+
+    return internal::update_inplace(x, [&] (T* dst) {
+        internal::scatter_rows(dst, s.data_ptr(), idx.data_ptr(), outer, n, m, inner,
+            false, [] (T& d, const T& v) { d += v; });
+    });
+}
+
+/**************************************************
+                Boolean mask selection
+ **************************************************/
+
+/**
+ * @brief Returns, as a 1 dimensional tensor in row major order, the elements
+ * of @a x where @a mask is non zero. @a mask has the shape of @a x and any
+ * arithmetic type, e.g. Tensor<bool> or Tensor<uint8_t>.
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T, typename M>
+Tensor<T> masked_select(const Tensor<T>& x, const Tensor<M>& mask) {
+    if (x.shape() != mask.shape()) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    auto c = x.is_contiguous() ? x : x.copy();
+    auto mc = mask.is_contiguous() ? mask : mask.copy();
+    const T* src = c.data_ptr();
+    const M* mp = mc.data_ptr();
+
+    /* Counts the selected elements of each block, then each block writes at
+    the offset given by the prefix sum of the counts. */
+    size_t N = x.size(), bs = internal::index_grain;
+    size_t blocks = (N + bs - 1) / bs;
+    std::vector<size_t> offsets(blocks + 1);
+    auto& pool = internal::ThreadPool::instance();
+    pool.parallel_for(blocks, 1, [&] (size_t b, size_t e) {
+        for (size_t k = b; k < e; ++k) {
+            size_t cnt = 0;
+            for (size_t i = k * bs; i < std::min(N, (k + 1) * bs); ++i) {
+                cnt += mp[i] != M();
+            }
+            offsets[k + 1] = cnt;
+        }
+    });
+    for (size_t k = 0; k < blocks; ++k) {
+        offsets[k + 1] += offsets[k];
+    }
+
+    internal::Buffer<T> out(offsets[blocks]);
+    pool.parallel_for(blocks, 1, [&] (size_t b, size_t e) {
+        for (size_t k = b; k < e; ++k) {
+            T* d = out.data() + offsets[k];
+            for (size_t i = k * bs; i < std::min(N, (k + 1) * bs); ++i) {
+                if (mp[i] != M()) {
+                    *d++ = src[i];
+                }
+            }
+        }
+    });
+    return Tensor<T>(std::move(out), {offsets[blocks]});
+}
+
+/**
+ * @brief Sets the elements of @a x where @a mask is non zero to @a value, in
+ * place.
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T, typename M>
+Tensor<T>& masked_fill(Tensor<T>& x, const Tensor<M>& mask, const T& value) {
+    if (x.shape() != mask.shape()) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    auto mc = mask.is_contiguous() ? mask : mask.copy();
+    const M* mp = mc.data_ptr();
+    return internal::update_inplace(x, [&] (T* dst) {
+        internal::ThreadPool::instance().parallel_for(x.size(), internal::index_grain,
+                                            [&] (size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) {
+                dst[i] = mp[i] != M() ? value : dst[i];
+            }
+        });
+    });
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_INDEXING_H_
@@ -0,0 +1,204 @@
+#ifndef TENSORLIB_LAYOUT_H_
+#define TENSORLIB_LAYOUT_H_
+
+#include "tensor.hpp"
+#include "tensor_descriptor.hpp"
+#include "thread_pool.hpp"
+#include "storage.hpp"
+#include "nd_loop.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/* Side of the square tiles of layout conversions, and elements per task. */
+constexpr size_t layout_tile = 32;
+constexpr size_t layout_grain = 1 << 14;
+
+/**
+ * @brief Copies the elements of shape @a shape from @a src, of strides
+ * @a ss, to @a dst, of strides @a ds, in parallel. When the axes the two
+ * operands walk contiguously differ, as in a transpose, the copy goes through
+ * square tiles of these two axes, so that both the reads and the writes of a
+ * tile stay within a few cache lines.
+ */
+template <typename T>
+void tiled_copy(const std::vector<size_t>& shape, T* dst, const std::vector<long>& ds,
+                const T* src, const std::vector<long>& ss) {
+    auto dims = loop_dims<2>(shape, {&ds, &ss});
+    if (dims.empty()) {
+        *dst = *src;
+        return;
+    }
+    if (!dims[0].n) {
+        return;
+    }
+
+    /* The inner axis is the one of the smallest stride of dst; tile it
+    against the one of the smallest stride of src. */
+    Loop_dim<2> inner = dims.back();
+    dims.pop_back();
+    Loop_dim<2> cross{1, {0, 0}};
+    auto it = std::min_element(dims.begin(), dims.end(), [] (const Loop_dim<2>& a, const Loop_dim<2>& b) {
+        return std::abs(a.s[1]) < std::abs(b.s[1]);
+    });
+    if (it != dims.end() && std::abs(it->s[1]) < std::abs(inner.s[1])) {
+        cross = *it;
+        dims.erase(it);
+    }
+
+    size_t outer = 1;
+    for (const auto& l : dims) {
+        outer *= l.n;
+    }
+    const size_t ci = (inner.n + layout_tile - 1) / layout_tile;
+    const size_t cc = (cross.n + layout_tile - 1) / layout_tile;
+    const size_t per_tile = std::min(inner.n, layout_tile) * std::min(cross.n, layout_tile);
+    const size_t grain = std::max<size_t>(1, layout_grain / per_tile);
+
+    ThreadPool::instance().parallel_for(outer * cc * ci, grain, [&] (size_t b, size_t e) {
+        for (size_t t = b; t < e; ++t) {
+            size_t ti = t % ci, tc = t / ci % cc, o = t / ci / cc;
+            T* d = dst;
+            const T* s = src;
+            for (size_t k = dims.size(); k-- > 0;) {
+                size_t i = o % dims[k].n;
+                o /= dims[k].n;
+                d += long(i) * dims[k].s[0];
+                s += long(i) * dims[k].s[1];
+            }
+            size_t i0 = ti * layout_tile, i1 = std::min(inner.n, i0 + layout_tile);
+            size_t c0 = tc * layout_tile, c1 = std::min(cross.n, c0 + layout_tile);
+            for (size_t c = c0; c < c1; ++c) {
+                T* dr = d + long(c) * cross.s[0];
+                const T* sr = s + long(c) * cross.s[1];
+                if (inner.s[0] == 1 && inner.s[1] == 1) {
+                    std::copy(sr + i0, sr + i1, dr + i0);
+                    continue;
+                }
+                for (size_t i = i0; i < i1; ++i) {
+                    dr[long(i) * inner.s[0]] = sr[long(i) * inner.s[1]];
+                }
+            }
+        }
+    });
+}
+
+/**
+ * @brief Copies between a tensor of logical shape @a shape and strides
+ * @a ps at @a plain and its Layout::Blocked form of strides @a bs at
+ * @a blocked, towards the latter when @a to_blocked. Axis 1 is seen as
+ * (C / block, block) on both sides, and the last partial block separately.
+ */
+template <typename T>
+void blocked_copy(const std::vector<size_t>& shape, T* plain, const std::vector<long>& ps,
+                  T* blocked, const std::vector<long>& bs, size_t block, bool to_blocked) {
+    const size_t full = shape[1] / block, tail = shape[1] % block;
+    auto split = [&] (size_t nb, size_t len, std::vector<size_t>& sh,
+                      std::vector<long>& p, std::vector<long>& q) {
+        sh = {shape[0], nb, len};
+        p = {ps[0], ps[1] * long(block), ps[1]};
+        q = {bs[0], bs[1], bs.back()};
+        for (size_t d = 2; d < shape.size(); ++d) {
+            sh.push_back(shape[d]);
+            p.push_back(ps[d]);
+            q.push_back(bs[d]);
+        }
+    };
+
+    std::vector<size_t> sh;
+    std::vector<long> p, q;
+    for (int part = 0; part < 2; ++part) {
+        if (part == 0 ? !full : !tail) {
+            continue;
+        }
+        split(part == 0 ? full : 1, part == 0 ? block : tail, sh, p, q);
+        T* pp = plain + (part == 0 ? 0 : long(full * block) * ps[1]);
+        T* bp = blocked + (part == 0 ? 0 : long(full) * bs[1]);
+        if (to_blocked) {
+            tiled_copy<T>(sh, bp, q, pp, p);
+        }
+        else {
+            tiled_copy<T>(sh, pp, p, bp, q);
+        }
+    }
+}
+
+}   // namespace internal
+
+/**************************************************
+                  Layout conversion
+ **************************************************/
+
+/**
+ * @brief Returns the tensor with its elements in layout @a layout, which
+ * shares them with @a x when they already are, or else a copy. For
+ * Layout::Blocked, channels (axis 1) go in blocks of @a block, and the
+ * result has the physical shape (N, C / block, ..., block); converting it
+ * back gives the logical shape again.
+ * @throw std::runtime_error when blocking a tensor of less than 2 axes or
+ * with a @a block of 0, or when @a x is part of a blocked tensor that
+ * doesn't hold its channels.
+ */
+template <typename T>
+Tensor<T> to_layout(const Tensor<T>& x, Layout layout, size_t block = 16) {
+    const bool from_blocked = x.layout() == Layout::Blocked;
+    std::vector<size_t> shape = x.logical_shape();
+    if (from_blocked) {
+        /* The channels should fill all the blocks but the last. */
+        bool whole = x.ndim() >= 3;
+        if (whole) {
+            size_t blocks = x.shape()[1], b = x.shape().back();
+            whole = blocks && shape[1] <= blocks * b && shape[1] > (blocks - 1) * b;
+        }
+        if (!whole) {
+            throw std::runtime_error("Partial view of a blocked tensor");
+        }
+    }
+
+    if (layout == Layout::Blocked) {
+        if (shape.size() < 2 || !block) {
+            throw std::runtime_error("Blocked layout needs 2 axes and a block");
+        }
+        if (from_blocked && x.shape().back() == block && x.is_contiguous()) {
+            return x;
+        }
+        if (from_blocked) {
+            return to_layout(to_layout(x, Layout::RowMajor), Layout::Blocked, block);
+        }
+
+        std::vector<size_t> phys(shape);
+        phys[1] = (shape[1] + block - 1) / block;
+        phys.push_back(block);
+        internal::TensorDescriptor desc(phys, Layout::Blocked, shape[1]);
+        internal::Buffer<T> buf(desc.size());
+        internal::blocked_copy<T>(shape, const_cast<T*>(x.data_ptr()), x.strides(),
+                                  buf.data(), desc.strides(), block, true);
+        return Tensor<T>(internal::Storage<T>(std::move(buf)), desc, x.format);
+    }
+
+    internal::TensorDescriptor desc(shape, layout);
+    if (!from_blocked && x.strides() == desc.strides()) {
+        return x;
+    }
+    internal::Buffer<T> buf(desc.size());
+    if (from_blocked) {
+        internal::blocked_copy<T>(shape, buf.data(), desc.strides(),
+                                  const_cast<T*>(x.data_ptr()), x.strides(),
+                                  x.shape().back(), false);
+    }
+    else {
+        internal::tiled_copy<T>(shape, buf.data(), desc.strides(), x.data_ptr(), x.strides());
+    }
+    return Tensor<T>(internal::Storage<T>(std::move(buf)), desc, x.format);
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_LAYOUT_H_
@@ -0,0 +1,556 @@
+#ifndef TENSORLIB_LAZY_H_
+#define TENSORLIB_LAZY_H_
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/**
+ * @brief Operations that can be recorded in a lazy computation graph.
+ */
+enum class LazyOp { Leaf, Neg, Add, Sub, Mul, Div, Mod };
+
+/**
+ * @brief A node in the lazy computation graph. Binary operations either take
+ * two inputs or a single input and the scalar @a value as their rhs.
+ */
+template <typename T>
+struct LazyNode
+{
+    LazyOp op;
+    std::vector<std::shared_ptr<const LazyNode>> inputs;
+    bool scalar_rhs = false;
+    T value = T();
+    std::vector<size_t> shape;
+    /* Holds the tensor for LazyOp::Leaf nodes. */
+    std::shared_ptr<const Tensor<T>> leaf;
+};
+
+template <typename T>
+std::enable_if_t<std::is_integral<T>::value, T> lazy_mod(const T& a, const T& b) {
+    return a % b;
+}
+
+template <typename T>
+std::enable_if_t<!std::is_integral<T>::value, T> lazy_mod(const T& a, const T& b) {
+    using std::fmod;
+    return fmod(a, b);
+}
+
+/**
+ * @brief Runs @a op over @a n elements of @a lhs and @a rhs, writing to
+ * @a out. @a out is allowed to alias any of the inputs.
+ */
+template <typename T>
+void lazy_kernel(LazyOp op, T* out, const T* lhs, const T* rhs, size_t n) {
+    switch (op) {
+    case LazyOp::Add:
+        for (size_t i = 0; i < n; ++i) out[i] = lhs[i] + rhs[i];
+        break;
+    case LazyOp::Sub:
+        for (size_t i = 0; i < n; ++i) out[i] = lhs[i] - rhs[i];
+        break;
+    case LazyOp::Mul:
+        for (size_t i = 0; i < n; ++i) out[i] = lhs[i] * rhs[i];
+        break;
+    case LazyOp::Div:
+        for (size_t i = 0; i < n; ++i) out[i] = lhs[i] / rhs[i];
+        break;
+    case LazyOp::Mod:
+        for (size_t i = 0; i < n; ++i) out[i] = lazy_mod(lhs[i], rhs[i]);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Scalar rhs version of @a lazy_kernel.
+ */
+template <typename T>
+void lazy_kernel(LazyOp op, T* out, const T* lhs, const T& rhs, size_t n) {
+    switch (op) {
+    case LazyOp::Neg:
+        for (size_t i = 0; i < n; ++i) out[i] = -lhs[i];
+        break;
+    case LazyOp::Add:
+        for (size_t i = 0; i < n; ++i) out[i] = lhs[i] + rhs;
+        break;
+    case LazyOp::Sub:
+        for (size_t i = 0; i < n; ++i) out[i] = lhs[i] - rhs;
+        break;
+    case LazyOp::Mul:
+        for (size_t i = 0; i < n; ++i) out[i] = lhs[i] * rhs;
+        break;
+    case LazyOp::Div:
+        for (size_t i = 0; i < n; ++i) out[i] = lhs[i] / rhs;
+        break;
+    case LazyOp::Mod:
+        for (size_t i = 0; i < n; ++i) out[i] = lazy_mod(lhs[i], rhs);
+        break;
+    default:
+        break;
+    }
+}
+
+/**************************************************
+              LazyProgram declaration
+ **************************************************/
+
+/**
+ * @brief A lazy graph lowered to a flat list of instructions that is run
+ * block by block.
+ *
+ * Building the program does the graph optimizations:
+ *  - Dead nodes: Only the nodes reachable from the outputs are lowered.
+ *  - Common subexpressions: Nodes with the same op and the same (lowered)
+ *    inputs are lowered only once. Leaves are the same when they view the
+ *    same elements.
+ *  - Fusion: Every element-wise node becomes one instruction of a single
+ *    fused loop, so intermediates live only in small per-thread blocks.
+ *  - Buffer reuse: The blocks are assigned like registers. A block is freed
+ *    after the last use of its value and the next instruction can write to
+ *    it in-place.
+ */
+template <typename T>
+class LazyProgram
+{
+public:
+    /* Number of elements processed by one instruction at a time. */
+    static constexpr size_t block = 1024;
+
+    explicit LazyProgram(const std::vector<std::shared_ptr<const LazyNode<T>>>&);
+
+    /**
+     * @brief Runs the program in parallel over the thread pool.
+     * @return The tensors for each of the outputs.
+     */
+    std::vector<Tensor<T>> run() const;
+
+    /**
+     * @brief Returns the number of instructions, including the leaves.
+     */
+    size_t num_instructions() const {
+        return code.size();
+    }
+
+    /**
+     * @brief Returns the number of temporary blocks needed per thread.
+     */
+    size_t num_slots() const {
+        return n_slots;
+    }
+
+private:
+    struct Instruction {
+        LazyOp op;
+        size_t lhs = 0, rhs = 0;
+        bool scalar_rhs = false;
+        T value = T();
+        /* Contiguous elements for leaves. */
+        const T* leaf = nullptr;
+        /* Block holding the result for the other instructions. */
+        long slot = -1;
+    };
+
+    std::vector<Instruction> code;
+    std::vector<size_t> outputs;
+    std::vector<size_t> shape;
+    size_t n_slots = 0;
+    /* Keeps the contiguous copies of the non contiguous leaves alive. */
+    std::vector<Tensor<T>> materialized;
+
+    size_t _lower(
+        const LazyNode<T>*,
+        std::unordered_map<const LazyNode<T>*, size_t>&,
+        std::unordered_map<std::string, size_t>&
+    );
+
+    void _allocate_slots();
+};
+
+/**************************************************
+              LazyProgram definition
+ **************************************************/
+
+template <typename T>
+LazyProgram<T>::LazyProgram(
+    const std::vector<std::shared_ptr<const LazyNode<T>>>& nodes
+) {
+    if (nodes.empty()) {
+        return;
+    }
+
+    shape = nodes[0]->shape;
+    std::unordered_map<const LazyNode<T>*, size_t> lowered;
+    std::unordered_map<std::string, size_t> seen;
+    for (auto& node : nodes) {
+        if (node->shape != shape) {
+            throw std::runtime_error("Dimensions Mismatch");
+        }
+        outputs.push_back(_lower(node.get(), lowered, seen));
+    }
+    _allocate_slots();
+}
+
+template <typename T>
+size_t LazyProgram<T>::_lower(
+    const LazyNode<T>* node,
+    std::unordered_map<const LazyNode<T>*, size_t>& lowered,
+    std::unordered_map<std::string, size_t>& seen
+) {
+    auto found = lowered.find(node);
+    if (found != lowered.end()) {
+        return found->second;
+    }
+
+    /* Key that identifies the value computed by the node. */
+    std::string key(1, static_cast<char>(node->op));
+    auto put = [&key] (const void* p, size_t n) {
+        key.append(static_cast<const char*>(p), n);
+    };
+
+    Instruction ins;
+    ins.op = node->op;
+    if (node->op == LazyOp::Leaf) {
+        const T* ptr = node->leaf->data_ptr();
+        put(&ptr, sizeof(ptr));
+        for (auto st : node->leaf->strides()) {
+            put(&st, sizeof(st));
+        }
+    }
+    else {
+        ins.lhs = _lower(node->inputs[0].get(), lowered, seen);
+        put(&ins.lhs, sizeof(ins.lhs));
+        ins.scalar_rhs = node->scalar_rhs;
+        if (node->scalar_rhs) {
+            ins.value = node->value;
+            key.push_back('s');
+            put(&node->value, sizeof(T));
+        }
+        else {
+            ins.rhs = _lower(node->inputs[1].get(), lowered, seen);
+            size_t rhs = ins.rhs;
+            /* a + b and b + a are the same subexpression. */
+            if ((ins.op == LazyOp::Add || ins.op == LazyOp::Mul) && rhs < ins.lhs) {
+                key.resize(key.size() - sizeof(ins.lhs));
+                put(&rhs, sizeof(rhs));
+                rhs = ins.lhs;
+            }
+            put(&rhs, sizeof(rhs));
+        }
+    }
+
+    auto same = seen.find(key);
+    if (same != seen.end()) {
+        return lowered[node] = same->second;
+    }
+
+    if (node->op == LazyOp::Leaf) {
+        if (node->leaf->is_contiguous()) {
+            ins.leaf = node->leaf->data_ptr();
+        }
+        else {
+            materialized.push_back(node->leaf->copy());
+            ins.leaf = materialized.back().data_ptr();
+        }
+    }
+
+    code.push_back(ins);
+    seen[key] = code.size() - 1;
+    return lowered[node] = code.size() - 1;
+}
+
+template <typename T>
+void LazyProgram<T>::_allocate_slots() {
+    std::vector<size_t> last_use(code.size(), 0);
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i].op != LazyOp::Leaf) {
+            last_use[code[i].lhs] = i;
+            if (!code[i].scalar_rhs) {
+                last_use[code[i].rhs] = i;
+            }
+        }
+    }
+    /* Outputs are copied out after the whole block is computed. */
+    for (auto out : outputs) {
+        last_use[out] = code.size();
+    }
+
+    std::vector<long> free_slots;
+    std::vector<bool> released(code.size(), false);
+    for (size_t i = 0; i < code.size(); ++i) {
+        auto& ins = code[i];
+        if (ins.op == LazyOp::Leaf) {
+            continue;
+        }
+
+        /* Inputs dying here hand their blocks over, so that this instruction
+        can write to the same block it reads from. */
+        for (size_t in : {ins.lhs, ins.scalar_rhs ? ins.lhs : ins.rhs}) {
+            if (last_use[in] == i && code[in].slot >= 0 && !released[in]) {
+                free_slots.push_back(code[in].slot);
+                released[in] = true;
+            }
+        }
+
+        if (free_slots.empty()) {
+            ins.slot = n_slots++;
+        }
+        else {
+            ins.slot = free_slots.back();
+            free_slots.pop_back();
+        }
+    }
+}
+
+template <typename T>
+std::vector<Tensor<T>> LazyProgram<T>::run() const {
+    std::vector<Tensor<T>> result;
+    std::vector<T*> out_ptrs;
+    size_t n = 1;
+    for (auto s : shape) {
+        n *= s;
+    }
+    for (size_t k = 0; k < outputs.size(); ++k) {
+        result.emplace_back(internal::Buffer<T>(n), shape);
+        out_ptrs.push_back(result.back().data_ptr());
+    }
+    if (!n || code.empty()) {
+        return result;
+    }
+
+    size_t n_blocks = (n + block - 1) / block;
+    ThreadPool::instance().parallel_for(n_blocks, 16, [&] (size_t b0, size_t b1) {
+        std::vector<T> scratch(n_slots * block);
+        auto src = [&] (size_t i, size_t base) -> const T* {
+            return code[i].leaf ? code[i].leaf + base
+                                : scratch.data() + code[i].slot * block;
+        };
+
+        for (size_t b = b0; b < b1; ++b) {
+            size_t base = b * block;
+            size_t len = std::min(block, n - base);
+            for (auto& ins : code) {
+                if (ins.op == LazyOp::Leaf) {
+                    continue;
+                }
+                T* dst = scratch.data() + ins.slot * block;
+                if (ins.scalar_rhs) {
+                    lazy_kernel(ins.op, dst, src(ins.lhs, base), ins.value, len);
+                }
+                else {
+                    lazy_kernel(ins.op, dst, src(ins.lhs, base), src(ins.rhs, base), len);
+                }
+            }
+            for (size_t k = 0; k < outputs.size(); ++k) {
+                const T* from = src(outputs[k], base);
+                std::copy(from, from + len, out_ptrs[k] + base);
+            }
+        }
+    });
+
+    return result;
+}
+
+}   // namespace internal
+
+/**************************************************
+              LazyTensor declaration
+ **************************************************/
+
+/**
+ * @brief A handle to a node of a deferred computation graph.
+ *
+ * Operations on a LazyTensor only record the operation. The graph is
+ * optimized and computed in a handful of fused passes on LazyTensor::eval()
+ * or TL::eval(). The tensors used as leaves are read at evaluation time.
+ */
+template <typename T>
+class LazyTensor
+{
+public:
+    /**
+     * @brief Constructs a leaf node referring to the given tensor. No copy is
+     * made.
+     */
+    explicit LazyTensor(const Tensor<T>&);
+
+    /**
+     * @brief Returns the shape of the tensor this node would compute.
+     */
+    std::vector<size_t> shape() const {
+        return node->shape;
+    }
+
+    size_t ndim() const {
+        return node->shape.size();
+    }
+
+    /**
+     * @brief Optimizes the graph rooted at this node, computes it and returns
+     * the result as a new contiguous tensor.
+     */
+    Tensor<T> eval() const;
+
+    /* ------- Element-wise operations ---------- */
+
+    LazyTensor operator-() const;
+
+    LazyTensor operator+(const LazyTensor&) const;
+    LazyTensor operator-(const LazyTensor&) const;
+    LazyTensor operator*(const LazyTensor&) const;
+    LazyTensor operator/(const LazyTensor&) const;
+    LazyTensor operator%(const LazyTensor&) const;
+
+    LazyTensor operator+(const T&) const;
+    LazyTensor operator-(const T&) const;
+    LazyTensor operator*(const T&) const;
+    LazyTensor operator/(const T&) const;
+    LazyTensor operator%(const T&) const;
+
+    template <typename U>
+    friend std::vector<Tensor<U>> eval(const std::vector<LazyTensor<U>>&);
+
+private:
+    std::shared_ptr<const internal::LazyNode<T>> node;
+
+    explicit LazyTensor(std::shared_ptr<const internal::LazyNode<T>> _node)
+    : node(std::move(_node)) {}
+
+    LazyTensor _binary(internal::LazyOp, const LazyTensor&) const;
+    LazyTensor _binary(internal::LazyOp, const T&) const;
+};
+
+/**
+ * @brief Returns a lazy handle to the given tensor.
+ */
+template <typename T>
+LazyTensor<T> lazy(const Tensor<T>& tensor) {
+    return LazyTensor<T>(tensor);
+}
+
+/**
+ * @brief Evaluates several lazy tensors of same shape together, sharing the
+ * common subexpressions between them in a single fused pass.
+ */
+template <typename T>
+std::vector<Tensor<T>> eval(const std::vector<LazyTensor<T>>& tensors) {
+    std::vector<std::shared_ptr<const internal::LazyNode<T>>> nodes;
+    for (auto& t : tensors) {
+        nodes.push_back(t.node);
+    }
+    return internal::LazyProgram<T>(nodes).run();
+}
+
+/**************************************************
+              LazyTensor definition
+ **************************************************/
+
+template <typename T>
+LazyTensor<T>::LazyTensor(const Tensor<T>& tensor) {
+    auto leaf = std::make_shared<internal::LazyNode<T>>();
+    leaf->op = internal::LazyOp::Leaf;
+    leaf->shape = tensor.shape();
+    leaf->leaf = std::make_shared<const Tensor<T>>(tensor);
+    node = leaf;
+}
+
+template <typename T>
+Tensor<T> LazyTensor<T>::eval() const {
+    return TL::eval(std::vector<LazyTensor>{*this})[0];
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::_binary(internal::LazyOp op, const LazyTensor& rhs) const {
+    if (shape() != rhs.shape()) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+
+    auto res = std::make_shared<internal::LazyNode<T>>();
+    res->op = op;
+    res->inputs = {node, rhs.node};
+    res->shape = node->shape;
+    return LazyTensor(res);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::_binary(internal::LazyOp op, const T& val) const {
+    auto res = std::make_shared<internal::LazyNode<T>>();
+    res->op = op;
+    res->inputs = {node};
+    res->scalar_rhs = true;
+    res->value = val;
+    res->shape = node->shape;
+    return LazyTensor(res);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator-() const {
+    return _binary(internal::LazyOp::Neg, T());
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator+(const LazyTensor& rhs) const {
+    return _binary(internal::LazyOp::Add, rhs);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator-(const LazyTensor& rhs) const {
+    return _binary(internal::LazyOp::Sub, rhs);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator*(const LazyTensor& rhs) const {
+    return _binary(internal::LazyOp::Mul, rhs);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator/(const LazyTensor& rhs) const {
+    return _binary(internal::LazyOp::Div, rhs);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator%(const LazyTensor& rhs) const {
+    return _binary(internal::LazyOp::Mod, rhs);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator+(const T& val) const {
+    return _binary(internal::LazyOp::Add, val);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator-(const T& val) const {
+    return _binary(internal::LazyOp::Sub, val);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator*(const T& val) const {
+    return _binary(internal::LazyOp::Mul, val);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator/(const T& val) const {
+    return _binary(internal::LazyOp::Div, val);
+}
+
+template <typename T>
+LazyTensor<T> LazyTensor<T>::operator%(const T& val) const {
+    return _binary(internal::LazyOp::Mod, val);
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_LAZY_H_
@@ -0,0 +1,169 @@
+#ifndef TENSORLIB_LINALG_H_
+#define TENSORLIB_LINALG_H_
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/**************************************************
+                    GEMM
+ **************************************************/
+
+/* Block sizes of the GEMM, in elements. A (MC x KC) block of A and a
+(KC x NC) panel of B are packed so that they stay in the L2 cache. */
+constexpr size_t gemm_mc = 64;
+constexpr size_t gemm_kc = 256;
+constexpr size_t gemm_nc = 512;
+
+/**
+ * @brief Computes C = A * B (or C += A * B when @a accumulate is set) for
+ * arbitrarily strided matrices.
+ *
+ * A is (M x K), B is (K x N) and C is (M x N). The strides are in elements
+ * and are allowed to be negative or 0, so that transposed and broadcast
+ * operands can be passed without making a copy. Blocks of M are computed in
+ * parallel when not called from inside another parallel region.
+ */
+template <typename T>
+void gemm(
+    size_t M, size_t N, size_t K,
+    const T* A, long rs_a, long cs_a,
+    const T* B, long rs_b, long cs_b,
+    T* C, long rs_c, long cs_c,
+    bool accumulate = false
+) {
+    if (!M || !N) {
+        return;
+    }
+    if (!accumulate) {
+        for (size_t i = 0; i < M; ++i) {
+            for (size_t j = 0; j < N; ++j) {
+                C[long(i) * rs_c + long(j) * cs_c] = T();
+            }
+        }
+    }
+    if (!K) {
+        return;
+    }
+
+    size_t m_blocks = (M + gemm_mc - 1) / gemm_mc;
+    ThreadPool::instance().parallel_for(m_blocks, 1, [&] (size_t b0, size_t b1) {
+        std::vector<T> a_pack(gemm_mc * gemm_kc);
+        std::vector<T> b_pack(gemm_kc * gemm_nc);
+        std::vector<T> c_tile(gemm_mc * gemm_nc);
+
+        for (size_t j0 = 0; j0 < N; j0 += gemm_nc) {
+            size_t nc = std::min(gemm_nc, N - j0);
+            for (size_t p0 = 0; p0 < K; p0 += gemm_kc) {
+                size_t kc = std::min(gemm_kc, K - p0);
+
+                /* Pack the panel of B row major, so that the innermost loop
+                runs over contiguous elements. */
+                for (size_t p = 0; p < kc; ++p) {
+                    const T* src = B + long(p0 + p) * rs_b + long(j0) * cs_b;
+                    T* dst = b_pack.data() + p * nc;
+                    if (cs_b == 1) {
+                        std::copy(src, src + nc, dst);
+                    }
+                    else {
+                        for (size_t j = 0; j < nc; ++j) {
+                            dst[j] = src[long(j) * cs_b];
+                        }
+                    }
+                }
+
+                for (size_t b = b0; b < b1; ++b) {
+                    size_t i0 = b * gemm_mc;
+                    size_t mc = std::min(gemm_mc, M - i0);
+
+                    for (size_t i = 0; i < mc; ++i) {
+                        for (size_t p = 0; p < kc; ++p) {
+                            a_pack[i * kc + p] = A[long(i0 + i) * rs_a + long(p0 + p) * cs_a];
+                        }
+                    }
+
+                    std::fill(c_tile.begin(), c_tile.begin() + mc * nc, T());
+                    for (size_t i = 0; i < mc; ++i) {
+                        T* c_row = c_tile.data() + i * nc;
+                        const T* a_row = a_pack.data() + i * kc;
+                        for (size_t p = 0; p < kc; ++p) {
+                            const T a = a_row[p];
+                            const T* b_row = b_pack.data() + p * nc;
+                            for (size_t j = 0; j < nc; ++j) {
+                                c_row[j] += a * b_row[j];
+                            }
+                        }
+                    }
+
+                    for (size_t i = 0; i < mc; ++i) {
+                        T* dst = C + long(i0 + i) * rs_c + long(j0) * cs_c;
+                        const T* src = c_tile.data() + i * nc;
+                        for (size_t j = 0; j < nc; ++j) {
+                            dst[long(j) * cs_c] += src[j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+}   // namespace internal
+
+/**
+ * @brief Matrix product of two tensors of dimension 1 or 2. A 1 dimensional
+ * lhs is treated as a row and a 1 dimensional rhs as a column, and the
+ * corresponding dimension is removed from the result.
+ * @throw std::runtime_error when the inner dimensions mismatch.
+ */
+template <typename T>
+Tensor<T> matmul(const Tensor<T>& lhs, const Tensor<T>& rhs) {
+    if (!lhs.ndim() || !rhs.ndim() || lhs.ndim() > 2 || rhs.ndim() > 2) {
+        throw std::runtime_error("matmul expects tensors of dimension 1 or 2");
+    }
+
+    auto a_shape = lhs.shape(), b_shape = rhs.shape();
+    auto a_strides = lhs.strides(), b_strides = rhs.strides();
+    if (lhs.ndim() == 1) {
+        a_shape.insert(a_shape.begin(), 1);
+        a_strides.insert(a_strides.begin(), 0);
+    }
+    if (rhs.ndim() == 1) {
+        b_shape.push_back(1);
+        b_strides.push_back(0);
+    }
+    if (a_shape[1] != b_shape[0]) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+
+    size_t M = a_shape[0], K = a_shape[1], N = b_shape[1];
+    internal::Buffer<T> out(M * N);
+    internal::gemm(
+        M, N, K,
+        lhs.data_ptr(), a_strides[0], a_strides[1],
+        rhs.data_ptr(), b_strides[0], b_strides[1],
+        out.data(), long(N), 1L
+    );
+
+    std::vector<size_t> shape;
+    if (lhs.ndim() == 2) {
+        shape.push_back(M);
+    }
+    if (rhs.ndim() == 2) {
+        shape.push_back(N);
+    }
+    if (shape.empty()) {
+        return Tensor<T>(out[0]);
+    }
+    return Tensor<T>(std::move(out), shape);
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_LINALG_H_
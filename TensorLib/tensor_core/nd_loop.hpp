@@ -0,0 +1,130 @@
+#ifndef TENSORLIB_ND_LOOP_H_
+#define TENSORLIB_ND_LOOP_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstddef>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/**************************************************
+                  N-d loop engine
+ **************************************************/
+
+/*
+ * Element-wise kernels over strided operands of the same shape go through
+ * nd_loop(), which turns the N-d loop into as few nested loops as possible:
+ * axes of length 1 are dropped, the axes are ordered so that the smallest
+ * stride of the first operand is innermost, and adjacent axes that every
+ * operand walks as one (outer stride = inner stride * inner length) are
+ * merged. A contiguous view of any shape thus runs as a single loop, and a
+ * slice of whole rows such as A(Slice(R(0, 100), R(1000))) too.
+ */
+
+/**
+ * @brief Length of a loop and the strides of each of the N operands along
+ * it, in elements.
+ */
+template <size_t N>
+struct Loop_dim
+{
+    size_t n;
+    std::array<long, N> s;
+};
+
+/**
+ * @brief Returns the loops, outermost first, visiting the elements of
+ * operands of shape @a shape and strides @a strides, or a single loop of
+ * length 0 when there are no elements.
+ */
+template <size_t N>
+std::vector<Loop_dim<N>> loop_dims(const std::vector<size_t>& shape,
+                                   const std::array<const std::vector<long>*, N>& strides) {
+    std::vector<Loop_dim<N>> dims;
+    for (size_t d = 0; d < shape.size(); ++d) {
+        if (shape[d] == 0) {
+            return {Loop_dim<N>{0, {}}};
+        }
+        if (shape[d] == 1) {
+            continue;
+        }
+        Loop_dim<N> l{shape[d], {}};
+        for (size_t k = 0; k < N; ++k) {
+            l.s[k] = (*strides[k])[d];
+        }
+        dims.push_back(l);
+    }
+
+    /* Stable, so that axes of equal strides keep their order. */
+    std::stable_sort(dims.begin(), dims.end(), [] (const Loop_dim<N>& a, const Loop_dim<N>& b) {
+        return std::abs(a.s[0]) > std::abs(b.s[0]);
+    });
+
+    std::vector<Loop_dim<N>> merged;
+    for (const auto& l : dims) {
+        bool fuse = !merged.empty();
+        for (size_t k = 0; k < N && fuse; ++k) {
+            fuse = merged.back().s[k] == l.s[k] * long(l.n);
+        }
+        if (fuse) {
+            merged.back().n *= l.n;
+            merged.back().s = l.s;
+        }
+        else {
+            merged.push_back(l);
+        }
+    }
+    return merged;
+}
+
+/**
+ * @brief Visits the elements of N strided operands of shape @a shape, in no
+ * particular order, through @a kernel(ptrs, n, s): the i-th element of the
+ * inner loop of operand k is at ptrs[k][i * s[k]], for i in [0, n). Kernels
+ * typically test s for unit strides to run a contiguous loop.
+ */
+template <typename T, size_t N, typename F>
+void nd_loop(const std::vector<size_t>& shape, std::array<T*, N> ptrs,
+             const std::array<const std::vector<long>*, N>& strides, F&& kernel) {
+    auto dims = loop_dims<N>(shape, strides);
+    if (dims.empty()) {
+        kernel(ptrs, size_t(1), std::array<long, N>{});
+        return;
+    }
+    if (!dims[0].n) {
+        return;
+    }
+
+    const Loop_dim<N> inner = dims.back();
+    dims.pop_back();
+    std::vector<size_t> idx(dims.size(), 0);
+    while (true) {
+        kernel(ptrs, inner.n, inner.s);
+        long d = long(dims.size()) - 1;
+        for (; d >= 0; --d) {
+            for (size_t k = 0; k < N; ++k) {
+                ptrs[k] += dims[d].s[k];
+            }
+            if (++idx[d] < dims[d].n) {
+                break;
+            }
+            for (size_t k = 0; k < N; ++k) {
+                ptrs[k] -= dims[d].s[k] * long(dims[d].n);
+            }
+            idx[d] = 0;
+        }
+        if (d < 0) {
+            return;
+        }
+    }
+}
+
+}   // namespace internal
+
+}   // namespace TL
+
+#endif  // TENSORLIB_ND_LOOP_H_
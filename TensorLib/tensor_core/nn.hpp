@@ -0,0 +1,437 @@
+#ifndef TENSORLIB_NN_H_
+#define TENSORLIB_NN_H_
+
+#include "tensor.hpp"
+#include "linalg.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/**
+ * @brief Geometry of a 2 dimensional convolution or pooling window. A 1
+ * dimensional one is a 2 dimensional one with unit height.
+ */
+struct ConvShape
+{
+    size_t N, C, H, W;          /* input */
+    size_t K, kh, kw;           /* output channels and window */
+    size_t sh, sw, ph, pw, dh, dw;
+    size_t groups;
+    size_t OH, OW;              /* output */
+
+    void compute_output() {
+        long eh = long(dh * (kh - 1) + 1), ew = long(dw * (kw - 1) + 1);
+        long oh = (long(H + 2 * ph) - eh) / long(sh) + 1;
+        long ow = (long(W + 2 * pw) - ew) / long(sw) + 1;
+        if (!sh || !sw || !dh || !dw || !kh || !kw || oh <= 0 || ow <= 0) {
+            throw std::runtime_error("Invalid convolution window for the input shape");
+        }
+        OH = oh;
+        OW = ow;
+    }
+
+    /**
+     * @brief Range [lo, hi) of outputs along an axis for which the input
+     * index o * s + k * d - p stays inside [0, n).
+     */
+    static void valid(size_t n, size_t s, size_t k, size_t d, size_t p,
+                      size_t out, size_t& lo, size_t& hi) {
+        long off = long(k * d) - long(p);
+        long l = off >= 0 ? 0 : (-off + long(s) - 1) / long(s);
+        long h = (long(n) - off + long(s) - 1) / long(s);
+        lo = std::min<long>(std::max<long>(l, 0), out);
+        hi = std::max<long>(std::min<long>(h, out), lo);
+    }
+};
+
+/**
+ * @brief Lays the receptive fields of outputs [p0, p1) of one group of one
+ * image out as the columns of a (C/groups * kh * kw) x (p1 - p0) matrix.
+ */
+template <typename T>
+void im2col(const ConvShape& s, const T* in, T* col, size_t p0, size_t p1) {
+    size_t cg = s.C / s.groups, n = p1 - p0;
+    for (size_t c = 0; c < cg; ++c) {
+        for (size_t ky = 0; ky < s.kh; ++ky) {
+            for (size_t kx = 0; kx < s.kw; ++kx) {
+                T* dst = col + ((c * s.kh + ky) * s.kw + kx) * n;
+                std::fill(dst, dst + n, T());
+
+                size_t y0, y1, x0, x1;
+                ConvShape::valid(s.H, s.sh, ky, s.dh, s.ph, s.OH, y0, y1);
+                ConvShape::valid(s.W, s.sw, kx, s.dw, s.pw, s.OW, x0, x1);
+                long off = long(kx * s.dw) - long(s.pw);
+                for (size_t oy = std::max(y0, p0 / s.OW); oy < y1 && oy * s.OW < p1; ++oy) {
+                    const T* src = in + (c * s.H + oy * s.sh + ky * s.dh - s.ph) * s.W;
+                    /* The part of the output row inside [p0, p1). */
+                    size_t first = oy * s.OW;
+                    size_t a = std::max(x0, p0 > first ? p0 - first : 0);
+                    size_t b = std::min(x1, p1 - first);
+                    for (size_t ox = a; ox < b; ++ox) {
+                        dst[first + ox - p0] = src[long(ox * s.sw) + off];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Number of output rows computed together by the direct convolution. */
+constexpr size_t conv_tile_rows = 8;
+
+/* Fewest outputs per task when the GEMM of an image is split over them. */
+constexpr size_t conv_tile_cols = 64;
+
+/**
+ * @brief Direct convolution of one output channel of one image. The output is
+ * computed a tile of rows at a time, accumulating every input channel and
+ * kernel tap into the tile while it is in the cache. Bounds are resolved per
+ * tap, so that the innermost loop has no branches.
+ */
+template <typename T>
+void conv_direct(const ConvShape& s, const T* in, const T* w, T bias, T* out) {
+    size_t cg = s.C / s.groups;
+    for (size_t t0 = 0; t0 < s.OH; t0 += conv_tile_rows) {
+        size_t t1 = std::min(s.OH, t0 + conv_tile_rows);
+        std::fill(out + t0 * s.OW, out + t1 * s.OW, bias);
+
+        for (size_t c = 0; c < cg; ++c) {
+            for (size_t ky = 0; ky < s.kh; ++ky) {
+                size_t y0, y1;
+                ConvShape::valid(s.H, s.sh, ky, s.dh, s.ph, s.OH, y0, y1);
+                y0 = std::max(y0, t0);
+                y1 = std::min(y1, t1);
+                for (size_t kx = 0; kx < s.kw; ++kx) {
+                    const T wv = w[(c * s.kh + ky) * s.kw + kx];
+                    size_t x0, x1;
+                    ConvShape::valid(s.W, s.sw, kx, s.dw, s.pw, s.OW, x0, x1);
+                    long off = long(kx * s.dw) - long(s.pw);
+                    for (size_t oy = y0; oy < y1; ++oy) {
+                        const T* src = in + (c * s.H + oy * s.sh + ky * s.dh - s.ph) * s.W;
+                        T* dst = out + oy * s.OW;
+                        for (size_t ox = x0; ox < x1; ++ox) {
+                            dst[ox] += wv * src[long(ox * s.sw) + off];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Convolution over contiguous (N, C, H, W) input and (K, C/groups,
+ * kh, kw) weight into contiguous (N, K, OH, OW) output.
+ *
+ * Uses im2col + GEMM when the reduction of each output (C/groups * kh * kw)
+ * and the output channels per group are large enough for GEMM to pay off,
+ * else the direct tiled kernel, which is the better one for depthwise and
+ * small convolutions.
+ */
+template <typename T>
+void conv(const ConvShape& s, const T* in, const T* w, const T* bias, T* out) {
+    size_t cg = s.C / s.groups, kg = s.K / s.groups;
+    size_t R = cg * s.kh * s.kw, P = s.OH * s.OW;
+    auto& pool = ThreadPool::instance();
+
+    if (R >= 32 && kg >= 8) {
+        /* Parallel over the images and groups, and when there are fewer of
+        them than threads, over tiles of outputs of each as well: every task
+        lays out the columns of its tile and runs the GEMM on them. */
+        size_t jobs = s.N * s.groups, tiles = 1;
+        if (jobs < pool.size()) {
+            tiles = std::min((pool.size() + jobs - 1) / jobs,
+                             (P + conv_tile_cols - 1) / conv_tile_cols);
+        }
+        size_t pt = (P + tiles - 1) / tiles;
+        pool.parallel_for(jobs * tiles, 1, [&] (size_t t0, size_t t1) {
+            std::vector<T> col(R * pt);
+            for (size_t t = t0; t < t1; ++t) {
+                size_t j = t / tiles, n = j / s.groups, g = j % s.groups;
+                size_t p0 = t % tiles * pt, p1 = std::min(P, p0 + pt);
+                if (p0 >= p1) {
+                    continue;
+                }
+                im2col(s, in + (n * s.C + g * cg) * s.H * s.W, col.data(), p0, p1);
+                T* o = out + (n * s.K + g * kg) * P + p0;
+                for (size_t k = 0; k < kg; ++k) {
+                    std::fill(o + k * P, o + k * P + (p1 - p0), bias ? bias[g * kg + k] : T());
+                }
+                gemm(kg, p1 - p0, R, w + g * kg * R, long(R), 1L,
+                     col.data(), long(p1 - p0), 1L, o, long(P), 1L, true);
+            }
+        });
+        return;
+    }
+
+    pool.parallel_for(s.N * s.K, 1, [&] (size_t j0, size_t j1) {
+        for (size_t j = j0; j < j1; ++j) {
+            size_t n = j / s.K, k = j % s.K, g = k / kg;
+            conv_direct(s, in + (n * s.C + g * cg) * s.H * s.W, w + k * R,
+                        bias ? bias[k] : T(), out + j * P);
+        }
+    });
+}
+
+/**
+ * @brief Max (@a is_max) or average pooling over contiguous (N, C, H, W)
+ * input. Padded elements are ignored, so the average is over the elements
+ * that are inside the input.
+ */
+template <typename T>
+void pool2d(const ConvShape& s, const T* in, T* out, bool is_max) {
+    size_t P = s.OH * s.OW;
+    ThreadPool::instance().parallel_for(s.N * s.C, 1, [&] (size_t j0, size_t j1) {
+        std::vector<size_t> count(is_max ? 0 : P);
+        for (size_t j = j0; j < j1; ++j) {
+            const T* plane = in + j * s.H * s.W;
+            T* o = out + j * P;
+            std::fill(o, o + P, is_max ? std::numeric_limits<T>::lowest() : T());
+            std::fill(count.begin(), count.end(), 0);
+
+            for (size_t ky = 0; ky < s.kh; ++ky) {
+                size_t y0, y1;
+                ConvShape::valid(s.H, s.sh, ky, s.dh, s.ph, s.OH, y0, y1);
+                for (size_t kx = 0; kx < s.kw; ++kx) {
+                    size_t x0, x1;
+                    ConvShape::valid(s.W, s.sw, kx, s.dw, s.pw, s.OW, x0, x1);
+                    long off = long(kx * s.dw) - long(s.pw);
+                    for (size_t oy = y0; oy < y1; ++oy) {
+                        const T* src = plane + (oy * s.sh + ky * s.dh - s.ph) * s.W;
+                        T* dst = o + oy * s.OW;
+                        if (is_max) {
+                            for (size_t ox = x0; ox < x1; ++ox) {
+                                dst[ox] = std::max(dst[ox], src[long(ox * s.sw) + off]);
+                            }
+                        }
+                        else {
+                            size_t* cnt = count.data() + oy * s.OW;
+                            for (size_t ox = x0; ox < x1; ++ox) {
+                                dst[ox] += src[long(ox * s.sw) + off];
+                                ++cnt[ox];
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (!is_max) {
+                for (size_t p = 0; p < P; ++p) {
+                    o[p] /= static_cast<T>(count[p]);
+                }
+            }
+        }
+    });
+}
+
+template <typename T>
+Tensor<T> conv_nd(
+    const Tensor<T>& input, const Tensor<T>& weight, const Tensor<T>* bias,
+    size_t nd, std::array<size_t, 2> stride, std::array<size_t, 2> padding,
+    std::array<size_t, 2> dilation, size_t groups
+) {
+    if (input.ndim() != nd + 2 || weight.ndim() != nd + 2) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+
+    auto ish = input.shape(), wsh = weight.shape();
+    ConvShape s;
+    s.N = ish[0];
+    s.C = ish[1];
+    s.H = nd == 2 ? ish[2] : 1;
+    s.W = ish.back();
+    s.K = wsh[0];
+    s.kh = nd == 2 ? wsh[2] : 1;
+    s.kw = wsh.back();
+    s.sh = stride[0]; s.sw = stride[1];
+    s.ph = padding[0]; s.pw = padding[1];
+    s.dh = dilation[0]; s.dw = dilation[1];
+    s.groups = groups;
+
+    if (!groups || s.C % groups || s.K % groups || wsh[1] != s.C / groups) {
+        throw std::runtime_error("Channels and groups mismatch");
+    }
+    if (bias && (bias->ndim() != 1 || bias->shape()[0] != s.K)) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    s.compute_output();
+
+    auto in = input.is_contiguous() ? input : input.copy();
+    auto w = weight.is_contiguous() ? weight : weight.copy();
+    auto b = !bias ? input : bias->is_contiguous() ? *bias : bias->copy();
+
+    internal::Buffer<T> out(s.N * s.K * s.OH * s.OW);
+    conv(s, in.data_ptr(), w.data_ptr(), bias ? b.data_ptr() : nullptr, out.data());
+
+    if (nd == 2) {
+        return Tensor<T>(std::move(out), {s.N, s.K, s.OH, s.OW});
+    }
+    return Tensor<T>(std::move(out), {s.N, s.K, s.OW});
+}
+
+template <typename T>
+Tensor<T> pool_nd(
+    const Tensor<T>& input, size_t nd, std::array<size_t, 2> kernel,
+    std::array<size_t, 2> stride, std::array<size_t, 2> padding, bool is_max
+) {
+    if (input.ndim() != nd + 2) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+
+    auto ish = input.shape();
+    ConvShape s;
+    s.N = ish[0];
+    s.C = ish[1];
+    s.H = nd == 2 ? ish[2] : 1;
+    s.W = ish.back();
+    s.K = s.C;
+    s.kh = kernel[0]; s.kw = kernel[1];
+    /* Stride defaults to the window. */
+    s.sh = stride[0] ? stride[0] : kernel[0];
+    s.sw = stride[1] ? stride[1] : kernel[1];
+    s.ph = padding[0]; s.pw = padding[1];
+    s.dh = s.dw = 1;
+    s.groups = s.C;
+    if (s.ph >= s.kh || s.pw >= s.kw) {
+        throw std::runtime_error("Padding should be smaller than the window");
+    }
+    s.compute_output();
+
+    auto in = input.is_contiguous() ? input : input.copy();
+    internal::Buffer<T> out(s.N * s.C * s.OH * s.OW);
+    pool2d(s, in.data_ptr(), out.data(), is_max);
+
+    if (nd == 2) {
+        return Tensor<T>(std::move(out), {s.N, s.C, s.OH, s.OW});
+    }
+    return Tensor<T>(std::move(out), {s.N, s.C, s.OW});
+}
+
+}   // namespace internal
+
+/**************************************************
+                Convolution
+ **************************************************/
+
+/**
+ * @brief 2 dimensional convolution (cross correlation) of a batch of images.
+ * @param input Tensor of shape (N, C, H, W).
+ * @param weight Tensor of shape (K, C / groups, kh, kw).
+ * @param stride, padding, dilation Along (H, W). Padding is with zeros.
+ * @param groups Number of groups the channels are split into. groups == C
+ * gives a depthwise convolution.
+ * @return Tensor of shape (N, K, OH, OW).
+ * @throw std::runtime_error when the shapes, channels and groups mismatch.
+ */
+template <typename T>
+Tensor<T> conv2d(
+    const Tensor<T>& input, const Tensor<T>& weight,
+    std::array<size_t, 2> stride = {1, 1}, std::array<size_t, 2> padding = {0, 0},
+    std::array<size_t, 2> dilation = {1, 1}, size_t groups = 1
+) {
+    return internal::conv_nd<T>(input, weight, nullptr, 2, stride, padding, dilation, groups);
+}
+
+/**
+ * @brief 2 dimensional convolution with a bias of shape (K) added to each
+ * output channel.
+ */
+template <typename T>
+Tensor<T> conv2d(
+    const Tensor<T>& input, const Tensor<T>& weight, const Tensor<T>& bias,
+    std::array<size_t, 2> stride = {1, 1}, std::array<size_t, 2> padding = {0, 0},
+    std::array<size_t, 2> dilation = {1, 1}, size_t groups = 1
+) {
+    return internal::conv_nd<T>(input, weight, &bias, 2, stride, padding, dilation, groups);
+}
+
+/**
+ * @brief 1 dimensional convolution of a batch of sequences.
+ * @param input Tensor of shape (N, C, L).
+ * @param weight Tensor of shape (K, C / groups, kl).
+ * @return Tensor of shape (N, K, OL).
+ */
+template <typename T>
+Tensor<T> conv1d(
+    const Tensor<T>& input, const Tensor<T>& weight,
+    size_t stride = 1, size_t padding = 0, size_t dilation = 1, size_t groups = 1
+) {
+    return internal::conv_nd<T>(
+        input, weight, nullptr, 1, {1, stride}, {0, padding}, {1, dilation}, groups
+    );
+}
+
+/**
+ * @brief 1 dimensional convolution with a bias of shape (K).
+ */
+template <typename T>
+Tensor<T> conv1d(
+    const Tensor<T>& input, const Tensor<T>& weight, const Tensor<T>& bias,
+    size_t stride = 1, size_t padding = 0, size_t dilation = 1, size_t groups = 1
+) {
+    return internal::conv_nd<T>(
+        input, weight, &bias, 1, {1, stride}, {0, padding}, {1, dilation}, groups
+    );
+}
+
+/**************************************************
+                  Pooling
+ **************************************************/
+
+/**
+ * @brief 2 dimensional max pooling of a batch of images.
+ * @param input Tensor of shape (N, C, H, W).
+ * @param kernel Window along (H, W).
+ * @param stride Defaults to the window when 0.
+ * @param padding Padded elements never win.
+ * @return Tensor of shape (N, C, OH, OW).
+ */
+template <typename T>
+Tensor<T> max_pool2d(
+    const Tensor<T>& input, std::array<size_t, 2> kernel,
+    std::array<size_t, 2> stride = {0, 0}, std::array<size_t, 2> padding = {0, 0}
+) {
+    return internal::pool_nd(input, 2, kernel, stride, padding, true);
+}
+
+/**
+ * @brief 2 dimensional average pooling. Padded elements are not counted.
+ */
+template <typename T>
+Tensor<T> avg_pool2d(
+    const Tensor<T>& input, std::array<size_t, 2> kernel,
+    std::array<size_t, 2> stride = {0, 0}, std::array<size_t, 2> padding = {0, 0}
+) {
+    return internal::pool_nd(input, 2, kernel, stride, padding, false);
+}
+
+/**
+ * @brief 1 dimensional max pooling of a batch of sequences of shape (N, C, L).
+ */
+template <typename T>
+Tensor<T> max_pool1d(
+    const Tensor<T>& input, size_t kernel, size_t stride = 0, size_t padding = 0
+) {
+    return internal::pool_nd(input, 1, {1, kernel}, {1, stride}, {0, padding}, true);
+}
+
+/**
+ * @brief 1 dimensional average pooling of a batch of sequences of shape (N, C, L).
+ */
+template <typename T>
+Tensor<T> avg_pool1d(
+    const Tensor<T>& input, size_t kernel, size_t stride = 0, size_t padding = 0
+) {
+    return internal::pool_nd(input, 1, {1, kernel}, {1, stride}, {0, padding}, false);
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_NN_H_
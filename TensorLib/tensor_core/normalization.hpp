@@ -0,0 +1,541 @@
+#ifndef TENSORLIB_NORMALIZATION_H_
+#define TENSORLIB_NORMALIZATION_H_
+
+#include "tensor.hpp"
+#include "math.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/*
+ * The kernels below work on one row at a time when the axis is the last one,
+ * and on a panel of up to @a norm_lanes neighbouring rows at a time when it
+ * isn't, so that the innermost loops always run over contiguous elements.
+ * Rows (or panels) are distributed over the thread pool.
+ */
+
+/* Independent accumulators of the row reductions. Floating point sums are
+not reassociated by the compiler, so they only vectorize when split this way. */
+constexpr size_t row_acc = 8;
+/* Elements of a row reduced at once by the online softmax. */
+constexpr size_t norm_block = 1024;
+/* Rows processed side by side when reducing along an inner axis. */
+constexpr size_t norm_lanes = 256;
+/* Elements processed by a chunk of the thread pool at least. */
+constexpr size_t norm_grain = 1 << 14;
+
+template <typename T>
+inline T exp_fn(T x) {
+    if constexpr (Has_fast_math<T>()) {
+        return exp_kernel(x);
+    }
+    else {
+        return std::exp(x);
+    }
+}
+
+template <typename T>
+inline T max_fn(T a, T b) {
+    if constexpr (Has_fast_math<T>()) {
+        return select(a > b, a, b);
+    }
+    else {
+        return std::max(a, b);
+    }
+}
+
+template <typename T>
+T row_max(const T* x, size_t n) {
+    T acc[row_acc];
+    std::fill(acc, acc + row_acc, -std::numeric_limits<T>::infinity());
+    size_t i = 0;
+    for (; i + row_acc <= n; i += row_acc) {
+        for (size_t j = 0; j < row_acc; ++j) {
+            acc[j] = max_fn(x[i + j], acc[j]);
+        }
+    }
+    for (; i < n; ++i) {
+        acc[0] = max_fn(x[i], acc[0]);
+    }
+    return *std::max_element(acc, acc + row_acc);
+}
+
+template <typename T>
+T row_sum(const T* x, size_t n) {
+    T acc[row_acc] = {};
+    size_t i = 0;
+    for (; i + row_acc <= n; i += row_acc) {
+        for (size_t j = 0; j < row_acc; ++j) {
+            acc[j] += x[i + j];
+        }
+    }
+    for (; i < n; ++i) {
+        acc[0] += x[i];
+    }
+    T s = T();
+    for (size_t j = 0; j < row_acc; ++j) {
+        s += acc[j];
+    }
+    return s;
+}
+
+/**
+ * @brief Writes e^(x - m) to @a e and returns its sum.
+ */
+template <typename T>
+T row_exp_sum(const T* x, T* e, size_t n, T m) {
+    for (size_t i = 0; i < n; ++i) {
+        e[i] = exp_fn(x[i] - m);
+    }
+    return row_sum(e, n);
+}
+
+/**
+ * @brief Online maximum and sum of e^(x - max) of a row, in a single pass
+ * over blocks small enough to be reread from the L1 cache. The running sum is
+ * rescaled whenever the maximum grows. When @a e has @a n elements it gets
+ * e^(x - m_k) where m_k is the running maximum after block k, which is also
+ * written to @a block_max.
+ */
+template <typename T>
+void online_softmax(const T* x, size_t n, T& m, T& s, T* e = nullptr,
+                    std::vector<T>* block_max = nullptr) {
+    T scratch[norm_block];
+    m = -std::numeric_limits<T>::infinity();
+    s = T();
+    for (size_t i = 0; i < n; i += norm_block) {
+        size_t len = std::min(norm_block, n - i);
+        T nm = max_fn(m, row_max(x + i, len));
+        if (nm != -std::numeric_limits<T>::infinity()) {
+            s = s * exp_fn(m - nm) + row_exp_sum(x + i, e ? e + i : scratch, len, nm);
+            m = nm;
+        }
+        else if (e) {
+            std::fill(e + i, e + i + len, T());
+        }
+        if (block_max) {
+            block_max->push_back(m);
+        }
+    }
+}
+
+template <typename T>
+void softmax_row(const T* x, T* y, size_t n) {
+    T m, s;
+    std::vector<T> block_max;
+    if (n > norm_block) {
+        block_max.reserve((n + norm_block - 1) / norm_block);
+    }
+    online_softmax(x, n, m, s, y, n > norm_block ? &block_max : nullptr);
+
+    /* Blocks were exponentiated against the maximum known at that time. */
+    for (size_t i = 0, k = 0; i < n; i += norm_block, ++k) {
+        size_t len = std::min(norm_block, n - i);
+        T scale = (n > norm_block ? exp_fn(block_max[k] - m) : T(1)) / s;
+        for (size_t j = i; j < i + len; ++j) {
+            y[j] *= scale;
+        }
+    }
+}
+
+template <typename T>
+void log_softmax_row(const T* x, T* y, size_t n) {
+    T m, s;
+    online_softmax(x, n, m, s);
+    T shift = m + std::log(s);
+    for (size_t i = 0; i < n; ++i) {
+        y[i] = x[i] - shift;
+    }
+}
+
+template <typename T>
+void logsumexp_row(const T* x, T* y, size_t n) {
+    T m, s;
+    online_softmax(x, n, m, s);
+    *y = m + std::log(s);
+}
+
+/**
+ * @brief Maximum and sum of e^(x - max) of @a w rows laid out as the columns
+ * of an (n x w) panel with row stride @a ld. Writes the exponentials to @a y
+ * when given.
+ */
+template <typename T>
+void softmax_lanes_stats(const T* x, T* y, size_t n, size_t ld, size_t w, T* m, T* s) {
+    std::fill(m, m + w, -std::numeric_limits<T>::infinity());
+    std::fill(s, s + w, T());
+    for (size_t i = 0; i < n; ++i) {
+        const T* r = x + i * ld;
+        for (size_t j = 0; j < w; ++j) {
+            m[j] = max_fn(r[j], m[j]);
+        }
+    }
+    for (size_t j = 0; j < w; ++j) {
+        if (m[j] == -std::numeric_limits<T>::infinity()) {
+            m[j] = T();
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const T* r = x + i * ld;
+        if (y) {
+            T* e = y + i * ld;
+            for (size_t j = 0; j < w; ++j) {
+                e[j] = exp_fn(r[j] - m[j]);
+                s[j] += e[j];
+            }
+        }
+        else {
+            for (size_t j = 0; j < w; ++j) {
+                s[j] += exp_fn(r[j] - m[j]);
+            }
+        }
+    }
+}
+
+template <typename T>
+void softmax_lanes(const T* x, T* y, size_t n, size_t ld, size_t w) {
+    T m[norm_lanes], s[norm_lanes];
+    softmax_lanes_stats(x, y, n, ld, w, m, s);
+    for (size_t j = 0; j < w; ++j) {
+        s[j] = T(1) / s[j];
+    }
+    for (size_t i = 0; i < n; ++i) {
+        T* r = y + i * ld;
+        for (size_t j = 0; j < w; ++j) {
+            r[j] *= s[j];
+        }
+    }
+}
+
+template <typename T>
+void log_softmax_lanes(const T* x, T* y, size_t n, size_t ld, size_t w) {
+    T m[norm_lanes], s[norm_lanes];
+    softmax_lanes_stats<T>(x, nullptr, n, ld, w, m, s);
+    for (size_t j = 0; j < w; ++j) {
+        m[j] += std::log(s[j]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const T* r = x + i * ld;
+        T* o = y + i * ld;
+        for (size_t j = 0; j < w; ++j) {
+            o[j] = r[j] - m[j];
+        }
+    }
+}
+
+template <typename T>
+void logsumexp_lanes(const T* x, T* y, size_t n, size_t ld, size_t w) {
+    T m[norm_lanes], s[norm_lanes];
+    softmax_lanes_stats<T>(x, nullptr, n, ld, w, m, s);
+    for (size_t j = 0; j < w; ++j) {
+        y[j] = m[j] + std::log(s[j]);
+    }
+}
+
+/**
+ * @brief Mean and reciprocal standard deviation of a row in a single pass.
+ * The sums are taken relative to the first element, which keeps the
+ * subtraction of the variance formula accurate when the mean is large.
+ */
+template <typename T>
+void row_moments(const T* x, size_t n, T eps, T& mean, T& rstd) {
+    T k = x[0];
+    T s1[row_acc] = {}, s2[row_acc] = {};
+    size_t i = 0;
+    for (; i + row_acc <= n; i += row_acc) {
+        for (size_t j = 0; j < row_acc; ++j) {
+            T d = x[i + j] - k;
+            s1[j] += d;
+            s2[j] += d * d;
+        }
+    }
+    for (; i < n; ++i) {
+        T d = x[i] - k;
+        s1[0] += d;
+        s2[0] += d * d;
+    }
+    T d = row_sum(s1, row_acc) / T(n);
+    T var = std::max(row_sum(s2, row_acc) / T(n) - d * d, T());
+    mean = k + d;
+    rstd = T(1) / std::sqrt(var + eps);
+}
+
+/**
+ * @brief Writes (x - mean) * rstd * weight + bias. @a weight and @a bias may
+ * be null.
+ */
+template <typename T>
+void normalize_row(const T* x, T* y, size_t n, T mean, T rstd,
+                   const T* weight, const T* bias) {
+    for (size_t i = 0; i < n; ++i) {
+        T v = (x[i] - mean) * rstd;
+        y[i] = weight ? v * weight[i] : v;
+    }
+    if (bias) {
+        for (size_t i = 0; i < n; ++i) {
+            y[i] += bias[i];
+        }
+    }
+}
+
+template <typename T>
+void layer_norm_lanes(const T* x, T* y, size_t n, size_t ld, size_t w, T eps,
+                      const T* weight, const T* bias) {
+    T k[norm_lanes], s1[norm_lanes] = {}, s2[norm_lanes] = {};
+    std::copy(x, x + w, k);
+    for (size_t i = 0; i < n; ++i) {
+        const T* r = x + i * ld;
+        for (size_t j = 0; j < w; ++j) {
+            T d = r[j] - k[j];
+            s1[j] += d;
+            s2[j] += d * d;
+        }
+    }
+    for (size_t j = 0; j < w; ++j) {
+        T d = s1[j] / T(n);
+        T var = std::max(s2[j] / T(n) - d * d, T());
+        k[j] += d;
+        s1[j] = T(1) / std::sqrt(var + eps);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const T* r = x + i * ld;
+        T* o = y + i * ld;
+        T a = weight ? weight[i] : T(1), b = bias ? bias[i] : T();
+        for (size_t j = 0; j < w; ++j) {
+            o[j] = (r[j] - k[j]) * s1[j] * a + b;
+        }
+    }
+}
+
+template <typename T>
+void rms_norm_lanes(const T* x, T* y, size_t n, size_t ld, size_t w, T eps,
+                    const T* weight) {
+    T s[norm_lanes] = {};
+    for (size_t i = 0; i < n; ++i) {
+        const T* r = x + i * ld;
+        for (size_t j = 0; j < w; ++j) {
+            s[j] += r[j] * r[j];
+        }
+    }
+    for (size_t j = 0; j < w; ++j) {
+        s[j] = T(1) / std::sqrt(s[j] / T(n) + eps);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const T* r = x + i * ld;
+        T* o = y + i * ld;
+        T a = weight ? weight[i] : T(1);
+        for (size_t j = 0; j < w; ++j) {
+            o[j] = r[j] * s[j] * a;
+        }
+    }
+}
+
+/**
+ * @brief Runs @a row(x, y, n) over every row along @a axis when the axis is
+ * the innermost one, else @a lanes(x, y, n, ld, w) over panels of neighbouring
+ * rows, in parallel. The output has the shape of @a x, or the shape of @a x
+ * without @a axis when @a reduce is set.
+ */
+template <typename T, typename Row, typename Lanes>
+Tensor<T> along_axis(const Tensor<T>& x, long axis, bool reduce, Row row, Lanes lanes) {
+    static_assert(std::is_floating_point<T>::value,
+        "Normalization kernels need a floating point type");
+
+    size_t outer, n, inner;
+    split_axis(x.shape(), axis, outer, n, inner);
+
+    auto c = x.is_contiguous() ? x : x.copy();
+    const T* in = c.data_ptr();
+    internal::Buffer<T> out(reduce ? outer * inner : x.size());
+    T* dst = out.data();
+
+    size_t panels = (inner + norm_lanes - 1) / norm_lanes;
+    size_t work = std::max<size_t>(n * std::min(inner, norm_lanes), 1);
+    ThreadPool::instance().parallel_for(outer * panels,
+        std::max<size_t>(norm_grain / work, 1), [&] (size_t b, size_t e) {
+        for (size_t u = b; u < e; ++u) {
+            size_t o = u / panels, j0 = (u % panels) * norm_lanes;
+            const T* src = in + o * n * inner + j0;
+            T* res = dst + (reduce ? o * inner : o * n * inner) + j0;
+            if (inner == 1) {
+                row(src, res, n);
+            }
+            else {
+                lanes(src, res, n, inner, std::min(norm_lanes, inner - j0));
+            }
+        }
+    });
+
+    auto shape = x.shape();
+    if (reduce) {
+        shape.erase(shape.begin() + normalize_axis(axis, shape.size()));
+        if (shape.empty()) {
+            return Tensor<T>(out[0]);
+        }
+    }
+    return Tensor<T>(std::move(out), shape);
+}
+
+/**
+ * @brief Returns a contiguous version of an optional affine parameter of
+ * shape (n) applied along the normalized axis.
+ * @throw std::runtime_error when the shape mismatch.
+ */
+template <typename T>
+Tensor<T> norm_param(const Tensor<T>& x, const Tensor<T>* p, long axis) {
+    if (!p) {
+        return x;       /* Not used, avoids a copy. */
+    }
+    size_t outer, n, inner;
+    split_axis(x.shape(), axis, outer, n, inner);
+    if (p->ndim() != 1 || p->shape()[0] != n) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    return p->is_contiguous() ? *p : p->copy();
+}
+
+template <typename T>
+Tensor<T> layer_norm(const Tensor<T>& x, const Tensor<T>* weight, const Tensor<T>* bias,
+                     long axis, T eps) {
+    auto w = norm_param(x, weight, axis), b = norm_param(x, bias, axis);
+    const T* wp = weight ? w.data_ptr() : nullptr;
+    const T* bp = bias ? b.data_ptr() : nullptr;
+    return along_axis(x, axis, false,
+        [=] (const T* src, T* dst, size_t n) {
+            if (!n) {
+                return;
+            }
+            T mean, rstd;
+            row_moments(src, n, eps, mean, rstd);
+            normalize_row(src, dst, n, mean, rstd, wp, bp);
+        },
+        [=] (const T* src, T* dst, size_t n, size_t ld, size_t lw) {
+            if (n) {
+                layer_norm_lanes(src, dst, n, ld, lw, eps, wp, bp);
+            }
+        });
+}
+
+template <typename T>
+Tensor<T> rms_norm(const Tensor<T>& x, const Tensor<T>* weight, long axis, T eps) {
+    auto w = norm_param(x, weight, axis);
+    const T* wp = weight ? w.data_ptr() : nullptr;
+    return along_axis(x, axis, false,
+        [=] (const T* src, T* dst, size_t n) {
+            if (!n) {
+                return;
+            }
+            for (size_t i = 0; i < n; ++i) {
+                dst[i] = src[i] * src[i];
+            }
+            T rstd = T(1) / std::sqrt(row_sum(dst, n) / T(n) + eps);
+            normalize_row(src, dst, n, T(), rstd, wp, static_cast<const T*>(nullptr));
+        },
+        [=] (const T* src, T* dst, size_t n, size_t ld, size_t lw) {
+            if (n) {
+                rms_norm_lanes(src, dst, n, ld, lw, eps, wp);
+            }
+        });
+}
+
+}   // namespace internal
+
+/**************************************************
+                    Softmax
+ **************************************************/
+
+/*
+ * The functions below take the axis to work along, negative values counting
+ * from the last axis. Each of them is a single fused kernel: the statistics
+ * and the normalization of a row are computed together instead of composed
+ * from tensor operators, and no temporary tensor is allocated.
+ */
+
+/**
+ * @brief Softmax along @a axis, e^(x - max) / sum(e^(x - max)). The maximum
+ * and the sum are computed online, in one read of each row.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> softmax(const Tensor<T>& x, long axis = -1) {
+    return internal::along_axis(x, axis, false,
+        internal::softmax_row<T>, internal::softmax_lanes<T>);
+}
+
+/**
+ * @brief Logarithm of the softmax along @a axis, x - max - log(sum(e^(x - max))).
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> log_softmax(const Tensor<T>& x, long axis = -1) {
+    return internal::along_axis(x, axis, false,
+        internal::log_softmax_row<T>, internal::log_softmax_lanes<T>);
+}
+
+/**
+ * @brief log(sum(e^x)) along @a axis, computed without overflow. The axis is
+ * removed from the shape of the result.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> logsumexp(const Tensor<T>& x, long axis = -1) {
+    return internal::along_axis(x, axis, true,
+        internal::logsumexp_row<T>, internal::logsumexp_lanes<T>);
+}
+
+/**************************************************
+                  Normalization
+ **************************************************/
+
+/**
+ * @brief Layer normalization along @a axis, (x - mean) / sqrt(var + eps).
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> layer_norm(const Tensor<T>& x, long axis = -1, T eps = T(1e-5)) {
+    return internal::layer_norm<T>(x, nullptr, nullptr, axis, eps);
+}
+
+/**
+ * @brief Layer normalization along @a axis followed by the affine transform
+ * y * weight + bias, where @a weight and @a bias have the length of the axis.
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T>
+Tensor<T> layer_norm(const Tensor<T>& x, const Tensor<T>& weight, const Tensor<T>& bias,
+                     long axis = -1, T eps = T(1e-5)) {
+    return internal::layer_norm(x, &weight, &bias, axis, eps);
+}
+
+/**
+ * @brief RMS normalization along @a axis, x / sqrt(mean(x^2) + eps).
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> rms_norm(const Tensor<T>& x, long axis = -1, T eps = T(1e-6)) {
+    return internal::rms_norm<T>(x, nullptr, axis, eps);
+}
+
+/**
+ * @brief RMS normalization along @a axis scaled by @a weight, which has the
+ * length of the axis.
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T>
+Tensor<T> rms_norm(const Tensor<T>& x, const Tensor<T>& weight, long axis = -1,
+                   T eps = T(1e-6)) {
+    return internal::rms_norm(x, &weight, axis, eps);
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_NORMALIZATION_H_
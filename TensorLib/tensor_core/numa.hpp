@@ -0,0 +1,266 @@
+#ifndef TENSORLIB_NUMA_H_
+#define TENSORLIB_NUMA_H_
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace TL {
+
+/**
+ * @brief Where the pages of the tensors allocated by the library are placed
+ * on machines with several NUMA nodes.
+ */
+enum class NumaPlacement {
+    /* On the node of the thread which first writes to the page. Buffers are
+    zeroed in parallel with the partitioning of the thread pool, so a page
+    lands on the node of the thread that later computes on it. */
+    FirstTouch,
+    /* Round robin over all the nodes. */
+    Interleave,
+    /* On a given node. */
+    Bind
+};
+
+struct NumaPolicy
+{
+    NumaPlacement placement = NumaPlacement::FirstTouch;
+    /* Node used by NumaPlacement::Bind. */
+    int node = 0;
+};
+
+/**
+ * @brief Use of huge pages for the large buffers, which cuts the TLB misses
+ * of strided accesses (e.g. column slices) over them.
+ */
+enum class HugePages {
+    /* Regular pages. */
+    None,
+    /* Aligned on 2 MB and advised to the kernel (MADV_HUGEPAGE), which backs
+    them with transparent huge pages when it can. */
+    Transparent,
+    /* From the reserved pages of hugetlbfs (MAP_HUGETLB), falling back to
+    Transparent when none is left. */
+    Explicit
+};
+
+namespace internal {
+
+/* Allocations smaller than this are zeroed by the calling thread and never
+get a placement policy. */
+constexpr size_t numa_min_bytes = 1 << 16;
+/* Elements zeroed by a chunk of the thread pool at least. */
+constexpr size_t numa_grain = 1 << 14;
+
+/* Allocations from this size are aligned on, and rounded up to, huge
+pages. */
+constexpr size_t huge_page_size = size_t(2) << 20;
+
+inline NumaPolicy& numa_policy() {
+    static NumaPolicy policy;
+    return policy;
+}
+
+inline HugePages& huge_pages() {
+    static HugePages mode = HugePages::Transparent;
+    return mode;
+}
+
+/**
+ * @brief Length of the mapping holding @a bytes. Only depends on @a bytes,
+ * so that a buffer is unmapped correctly whatever the settings became.
+ */
+inline size_t mapping_size(size_t bytes) {
+    if (bytes < huge_page_size) {
+        return bytes;
+    }
+    return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
+
+/**
+ * @brief Returns the online NUMA nodes, read once from sysfs, in increasing
+ * order. Empty when unknown.
+ */
+inline const std::vector<int>& numa_online_nodes() {
+    static const std::vector<int> nodes = [] {
+        std::vector<int> res;
+        std::ifstream file("/sys/devices/system/node/online");
+        std::string line;
+        if (!std::getline(file, line)) {
+            return res;
+        }
+        /* A list of ranges like "0-1,3". */
+        size_t pos = 0;
+        while (pos < line.size()) {
+            size_t end = line.find(',', pos);
+            std::string item = line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            size_t dash = item.find('-');
+            int first = std::stoi(item.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+            for (int node = first; node <= last; ++node) {
+                res.push_back(node);
+            }
+            if (end == std::string::npos) {
+                break;
+            }
+            pos = end + 1;
+        }
+        return res;
+    }();
+    return nodes;
+}
+
+/**
+ * @brief Applies @a policy to the pages of [ptr, ptr + bytes), which should
+ * be page aligned and not touched yet. Only online nodes go in the node mask,
+ * the kernel rejects the others. Placement is a hint: returns whether the
+ * policy was applied, which it can't be without NUMA support.
+ */
+inline bool numa_place(void* ptr, size_t bytes, const NumaPolicy& policy) {
+    if (policy.placement == NumaPlacement::FirstTouch) {
+        return true;
+    }
+#if defined(__linux__) && defined(SYS_mbind)
+    /* From <numaif.h>, to avoid depending on libnuma. */
+    const int mpol_bind = 2, mpol_interleave = 3;
+    const auto& online = numa_online_nodes();
+    if (online.empty()) {
+        return false;
+    }
+    const size_t bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(size_t(online.back()) / bits + 1, 0);
+    int mode = mpol_bind;
+    if (policy.placement == NumaPlacement::Interleave) {
+        mode = mpol_interleave;
+        for (int node : online) {
+            mask[node / bits] |= 1UL << (node % bits);
+        }
+    }
+    else if (std::binary_search(online.begin(), online.end(), policy.node)) {
+        mask[policy.node / bits] = 1UL << (policy.node % bits);
+    }
+    else {
+        return false;
+    }
+    /* The kernel reads maxnode - 1 bits. */
+    unsigned long maxnode = online.back() + 2;
+    return syscall(SYS_mbind, ptr, bytes, mode, mask.data(), maxnode, 0) == 0;
+#else
+    (void) ptr;
+    (void) bytes;
+    return false;
+#endif
+}
+
+/**
+ * @brief Zeroes @a n elements in parallel, chunk k of the range from worker k
+ * as in ThreadPool::parallel_for. This is the first touch of the pages, which
+ * places them next to the threads that work on the same chunks later.
+ */
+template <typename T>
+void first_touch(T* ptr, size_t n) {
+    ThreadPool::instance().parallel_for(n, numa_grain, [&] (size_t b, size_t e) {
+        std::memset(static_cast<void*>(ptr + b), 0, (e - b) * sizeof(T));
+    });
+}
+
+#if defined(__linux__)
+/**
+ * @brief Maps mapping_size(@a bytes) untouched bytes. From a huge page size,
+ * the mapping is aligned on huge pages and backed by them as set by
+ * set_huge_pages().
+ * @throw std::bad_alloc when the system is out of memory.
+ */
+inline void* map_pages(size_t bytes) {
+    const int prot = PROT_READ | PROT_WRITE, flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    size_t len = mapping_size(bytes);
+    if (bytes < huge_page_size || huge_pages() == HugePages::None) {
+        void* ptr = mmap(nullptr, len, prot, flags, -1, 0);
+        if (ptr == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+#if defined(MAP_HUGETLB)
+    if (huge_pages() == HugePages::Explicit) {
+        int huge = MAP_HUGETLB;
+#if defined(MAP_HUGE_2MB)
+        huge |= MAP_HUGE_2MB;
+#endif
+        void* ptr = mmap(nullptr, len, prot, flags | huge, -1, 0);
+        if (ptr != MAP_FAILED) {
+            return ptr;
+        }
+    }
+#endif
+
+    /* Map a huge page more than needed and unmap what is around the
+    aligned window. */
+    char* raw = static_cast<char*>(mmap(nullptr, len + huge_page_size, prot, flags, -1, 0));
+    if (raw == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    uintptr_t aligned = (uintptr_t(raw) + huge_page_size - 1) & ~uintptr_t(huge_page_size - 1);
+    char* ptr = reinterpret_cast<char*>(aligned);
+    if (ptr != raw) {
+        munmap(raw, ptr - raw);
+    }
+    if (size_t tail = raw + len + huge_page_size - (ptr + len)) {
+        munmap(ptr + len, tail);
+    }
+#if defined(MADV_HUGEPAGE)
+    madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+    return ptr;
+}
+#endif
+
+}   // namespace internal
+
+/**
+ * @brief Sets the placement of the buffers allocated from now on.
+ * Shouldn't be called while other threads allocate tensors.
+ */
+inline void set_numa_policy(const NumaPolicy& policy) {
+    internal::numa_policy() = policy;
+}
+
+inline NumaPolicy get_numa_policy() {
+    return internal::numa_policy();
+}
+
+/**
+ * @brief Sets the use of huge pages by the buffers of at least 2 MB
+ * allocated from now on. Defaults to HugePages::Transparent.
+ */
+inline void set_huge_pages(HugePages mode) {
+    internal::huge_pages() = mode;
+}
+
+inline HugePages get_huge_pages() {
+    return internal::huge_pages();
+}
+
+/**
+ * @brief Returns the number of NUMA nodes of the machine, 1 when unknown.
+ */
+inline size_t numa_num_nodes() {
+    return std::max<size_t>(internal::numa_online_nodes().size(), 1);
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_NUMA_H_
@@ -0,0 +1,79 @@
+#ifndef TENSORLIB_PRECOMPILED_H_
+#define TENSORLIB_PRECOMPILED_H_
+
+#include "tensor.hpp"
+#include "linalg.hpp"
+#include "math.hpp"
+#include "normalization.hpp"
+#include "sorting.hpp"
+#include "concatenate.hpp"
+#include "scan.hpp"
+#include "tensor_io.hpp"
+#include "csv.hpp"
+#include "layout.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**************************************************
+                Precompiled kernels
+ **************************************************/
+
+/*
+ * The TensorLib library (TensorLib/tensor_core.cpp) instantiates the class
+ * Tensor and the heavy kernels once for the common element types below.
+ * When TENSORLIB_PRECOMPILED is defined, as it is for the users of the
+ * TensorLib CMake target, these instantiations are declared extern, so the
+ * translation units including the headers link to the library's copies
+ * instead of compiling their own. Every other type or function is still
+ * instantiated from the headers. Without TENSORLIB_PRECOMPILED the library
+ * stays header only.
+ */
+
+/* Kernels for all the element types. */
+#define TENSORLIB_INSTANTIATE_TENSOR(prefix, T)                                        \
+    prefix template class Tensor<T>;                                                   \
+    prefix template Tensor<T> matmul<T>(const Tensor<T>&, const Tensor<T>&);           \
+    prefix template Tensor<T> cumsum<T>(const Tensor<T>&, long);                       \
+    prefix template Tensor<T> sort<T>(const Tensor<T>&, long, bool);                   \
+    prefix template Tensor<size_t> argsort<T>(const Tensor<T>&, long, bool);           \
+    prefix template Tensor<T> concatenate<T>(const std::vector<Tensor<T>>&, long);     \
+    prefix template Tensor<T> to_layout<T>(const Tensor<T>&, Layout, size_t);          \
+    prefix template void save<T>(const std::string&, const Tensor<T>&);                \
+    prefix template Tensor<T> load<T>(const std::string&);                             \
+    prefix template Tensor<T> load_csv<T>(const std::string&, const CsvOptions&);
+
+/* Kernels for floating point elements only. */
+#define TENSORLIB_INSTANTIATE_FLOAT(prefix, T)                                         \
+    TENSORLIB_INSTANTIATE_TENSOR(prefix, T)                                            \
+    prefix template Tensor<T> exp<T>(const Tensor<T>&);                                \
+    prefix template Tensor<T> log<T>(const Tensor<T>&);                                \
+    prefix template Tensor<T> tanh<T>(const Tensor<T>&);                               \
+    prefix template Tensor<T> sigmoid<T>(const Tensor<T>&);                            \
+    prefix template Tensor<T> sqrt<T>(const Tensor<T>&);                               \
+    prefix template Tensor<T> softmax<T>(const Tensor<T>&, long);                      \
+    prefix template Tensor<T> log_softmax<T>(const Tensor<T>&, long);                  \
+    prefix template Tensor<T> logsumexp<T>(const Tensor<T>&, long);                    \
+    prefix template Tensor<T> layer_norm<T>(const Tensor<T>&, long, T);                \
+    prefix template Tensor<T> rms_norm<T>(const Tensor<T>&, long, T);
+
+/**
+ * @brief Declares (@a prefix extern) or defines (empty @a prefix) the
+ * precompiled instantiations, in namespace TL.
+ */
+#define TENSORLIB_PRECOMPILED_KERNELS(prefix)                                          \
+    TENSORLIB_INSTANTIATE_FLOAT(prefix, float)                                         \
+    TENSORLIB_INSTANTIATE_FLOAT(prefix, double)                                        \
+    TENSORLIB_INSTANTIATE_TENSOR(prefix, int32_t)                                      \
+    TENSORLIB_INSTANTIATE_TENSOR(prefix, int64_t)
+
+#ifdef TENSORLIB_PRECOMPILED
+namespace TL {
+
+TENSORLIB_PRECOMPILED_KERNELS(extern)
+
+}   // namespace TL
+#endif
+
+#endif  // TENSORLIB_PRECOMPILED_H_
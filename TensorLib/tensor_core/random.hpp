@@ -0,0 +1,205 @@
+#ifndef TENSORLIB_RANDOM_H_
+#define TENSORLIB_RANDOM_H_
+
+#include "tensor.hpp"
+#include "math.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/*
+ * Random tensors are generated by Philox4x32-10, a counter-based generator:
+ * the 4 words of block i are a pure function of (i, seed). Each element is
+ * computed from the block of its index, so any partition of the tensor over
+ * the threads gives the same bits, and no generator state is shared. The 10
+ * rounds are computed for a batch of consecutive blocks at a time, one
+ * round over the whole batch after the other, so that the multiplications
+ * of independent blocks are vectorized.
+ */
+
+constexpr uint32_t philox_m0 = 0xD2511F53;
+constexpr uint32_t philox_m1 = 0xCD9E8D57;
+constexpr uint32_t philox_w0 = 0x9E3779B9;
+constexpr uint32_t philox_w1 = 0xBB67AE85;
+
+/* Blocks generated together. */
+constexpr size_t philox_batch = 64;
+/* Elements generated by a chunk of the thread pool at least. */
+constexpr size_t random_grain = 1 << 14;
+
+/**
+ * @brief Writes the 4 words of the @a count Philox4x32-10 blocks of counters
+ * @a first, @a first + 1, ... and key @a seed to @a out, block after block.
+ * @a count is at most @a philox_batch.
+ */
+inline void philox_blocks(uint64_t first, size_t count, uint64_t seed, uint32_t* out) {
+    uint32_t c0[philox_batch], c1[philox_batch], c2[philox_batch], c3[philox_batch];
+    for (size_t j = 0; j < count; ++j) {
+        c0[j] = uint32_t(first + j);
+        c1[j] = uint32_t((first + j) >> 32);
+        c2[j] = c3[j] = 0;
+    }
+    uint32_t k0 = uint32_t(seed), k1 = uint32_t(seed >> 32);
+    for (int r = 0; r < 10; ++r) {
+        for (size_t j = 0; j < count; ++j) {
+            uint64_t p0 = uint64_t(philox_m0) * c0[j];
+            uint64_t p1 = uint64_t(philox_m1) * c2[j];
+            uint32_t n0 = uint32_t(p1 >> 32) ^ c1[j] ^ k0;
+            uint32_t n2 = uint32_t(p0 >> 32) ^ c3[j] ^ k1;
+            c1[j] = uint32_t(p1);
+            c3[j] = uint32_t(p0);
+            c0[j] = n0;
+            c2[j] = n2;
+        }
+        k0 += philox_w0;
+        k1 += philox_w1;
+    }
+    for (size_t j = 0; j < count; ++j) {
+        out[4 * j] = c0[j];
+        out[4 * j + 1] = c1[j];
+        out[4 * j + 2] = c2[j];
+        out[4 * j + 3] = c3[j];
+    }
+}
+
+/**
+ * @brief Uniform number in [0, 1) from the words @a w, with the full
+ * precision of T: 24 bits from one word for float, 53 bits from two words
+ * for double.
+ */
+template <typename T>
+inline T unit_uniform(const uint32_t* w) {
+    if constexpr (sizeof(T) <= 4) {
+        return T(w[0] >> 8) * T(1.0f / 16777216.0f);
+    }
+    else {
+        uint64_t bits = ((uint64_t(w[0]) << 32) | w[1]) >> 11;
+        return T(bits) * T(1.0 / 9007199254740992.0);
+    }
+}
+
+/* Words of a block used by one uniform number of type T. */
+template <typename T>
+constexpr size_t words_per_value() {
+    return sizeof(T) <= 4 ? 1 : 2;
+}
+
+/**
+ * @brief Fills a new tensor of shape @a shape, @a per_block elements at a
+ * time: @a convert(words, values) turns the 4 words of a block into
+ * @a per_block values.
+ */
+template <typename T, typename F>
+Tensor<T> random_fill(const std::vector<size_t>& shape, uint64_t seed, size_t per_block,
+                      F convert) {
+    size_t size = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+    Buffer<T> out(size);
+    T* dst = out.data();
+    size_t blocks = (size + per_block - 1) / per_block;
+
+    ThreadPool::instance().parallel_for(blocks, random_grain / per_block, [&] (size_t b, size_t e) {
+        uint32_t words[4 * philox_batch];
+        T values[4];
+        for (size_t b0 = b; b0 < e; b0 += philox_batch) {
+            size_t count = std::min(philox_batch, e - b0);
+            philox_blocks(b0, count, seed, words);
+            for (size_t j = 0; j < count; ++j) {
+                size_t first = (b0 + j) * per_block;
+                convert(words + 4 * j, values);
+                std::copy_n(values, std::min(per_block, size - first), dst + first);
+            }
+        }
+    });
+    if (shape.empty()) {
+        return Tensor<T>(out[0]);
+    }
+    return Tensor<T>(std::move(out), shape);
+}
+
+}   // namespace internal
+
+/**************************************************
+                Random tensors
+ **************************************************/
+
+/*
+ * The tensors are a function of their shape and @a seed only: the same seed
+ * gives the same bits whatever the number of threads.
+ */
+
+/**
+ * @brief Tensor of numbers drawn uniformly from [low, high).
+ */
+template <typename T = double>
+Tensor<T> uniform(const std::vector<size_t>& shape, uint64_t seed, double low = 0,
+                  double high = 1) {
+    static_assert(std::is_floating_point<T>::value, "uniform expects a floating point type");
+    constexpr size_t wpv = internal::words_per_value<T>();
+    T a = T(low), scale = T(high - low);
+    return internal::random_fill<T>(shape, seed, 4 / wpv, [=] (const uint32_t* w, T* v) {
+        for (size_t i = 0; i < 4 / wpv; ++i) {
+            v[i] = a + scale * internal::unit_uniform<T>(w + i * wpv);
+        }
+    });
+}
+
+/**
+ * @brief Tensor of numbers drawn from the normal distribution of mean
+ * @a mean and standard deviation @a stddev, by the Box-Muller transform.
+ */
+template <typename T = double>
+Tensor<T> normal(const std::vector<size_t>& shape, uint64_t seed, double mean = 0,
+                 double stddev = 1) {
+    static_assert(std::is_floating_point<T>::value, "normal expects a floating point type");
+    constexpr size_t wpv = internal::words_per_value<T>();
+    T mu = T(mean), sigma = T(stddev);
+    return internal::random_fill<T>(shape, seed, 4 / wpv, [=] (const uint32_t* w, T* v) {
+        for (size_t i = 0; i < 4 / wpv; i += 2) {
+            /* u1 in (0, 1] so that its log is finite. */
+            T u1 = T(1) - internal::unit_uniform<T>(w + i * wpv);
+            T u2 = internal::unit_uniform<T>(w + (i + 1) * wpv);
+            T lg;
+            if constexpr (internal::Has_fast_math<T>()) {
+                lg = internal::log_kernel(u1);
+            }
+            else {
+                lg = std::log(u1);
+            }
+            T r = sigma * std::sqrt(T(-2) * lg);
+            T theta = T(6.283185307179586476925286766559) * u2;
+            v[i] = mu + r * std::cos(theta);
+            v[i + 1] = mu + r * std::sin(theta);
+        }
+    });
+}
+
+/**
+ * @brief Tensor of ones with probability @a p and zeros otherwise.
+ * @throw std::runtime_error when @a p isn't in [0, 1].
+ */
+template <typename T = double>
+Tensor<T> bernoulli(const std::vector<size_t>& shape, uint64_t seed, double p = 0.5) {
+    if (!(p >= 0 && p <= 1)) {
+        throw std::runtime_error("Probability should be in [0, 1]");
+    }
+    uint64_t threshold = uint64_t(std::ldexp(p, 32));
+    return internal::random_fill<T>(shape, seed, 4, [=] (const uint32_t* w, T* v) {
+        for (size_t i = 0; i < 4; ++i) {
+            v[i] = uint64_t(w[i]) < threshold ? T(1) : T(0);
+        }
+    });
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_RANDOM_H_
@@ -2,21 +2,53 @@
 #define TENSORLIB_RANGE_H_
 
 #include <cstddef>
+#include <stdexcept>
 
 namespace TL {
 
 /**
  * Range class that can be used to select elements in some range. Can be used
  * as param of @a TL::Slice and in a tensor constructor.
+ *
+ * A range selects every @a step -th index of [low, high). A negative step
+ * walks the same interval backwards, starting from @a high - 1, so that
+ * Range(0, n, -1) reverses an axis of length n.
  */
 struct Range {
     size_t low, high;
+    long step = 1;
 
     Range(size_t _low, size_t _high) : low(_low), high(_high) {}
     explicit Range(size_t _high) : low(0), high(_high) {}
+
+    /**
+     * @throw std::runtime_error when @a _step is 0.
+     */
+    Range(size_t _low, size_t _high, long _step)
+    : low(_low), high(_high), step(_step) {
+        if (!step) {
+            throw std::runtime_error("Range step should not be zero");
+        }
+    }
+
     bool single() const { return low + 1 == high; }
+
+    /**
+     * @brief Returns the number of indices selected by the range.
+     */
+    size_t count() const {
+        size_t s = step > 0 ? step : -step;
+        return high > low ? (high - low + s - 1) / s : 0;
+    }
+
+    /**
+     * @brief Returns the first index selected by the range.
+     */
+    size_t first() const {
+        return step > 0 ? low : high - 1;
+    }
 };
 
 }   // namespace TL
 
-#endif  // TENSORLIB_RANGE_H_
\ No newline at end of file
+#endif  // TENSORLIB_RANGE_H_
@@ -0,0 +1,276 @@
+#ifndef TENSORLIB_SCAN_H_
+#define TENSORLIB_SCAN_H_
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/*
+ * Inclusive scans along an axis. Three strategies, picked by the shape:
+ *  - Along an inner axis, the rows next to each other are scanned together
+ *    as the lanes of a panel, so the innermost loop is contiguous and
+ *    vectorized. Panels are distributed over the thread pool.
+ *  - Along the last axis with enough rows, each row is scanned by one
+ *    thread, 8 elements at a time: the block is scanned in registers
+ *    (log-steps) and then offset by the carry, so that only one operation
+ *    per block sits on the dependency chain of the carry.
+ *  - Long rows that are too few to keep the threads busy use a two-pass
+ *    blocked scan: every thread reduces its block, the block totals are
+ *    scanned serially, then every thread rescans its block starting from
+ *    the total of the blocks before it. Both passes give a block to the
+ *    same thread, so the second pass reads it from that thread's cache.
+ *
+ * For floating point sums and products, the blocked orders round differently
+ * from a serial loop, in the last bits.
+ */
+
+/* Width of the blocks scanned in registers. */
+constexpr size_t scan_width = 8;
+/* Rows processed side by side when scanning along an inner axis. */
+constexpr size_t scan_panel = 256;
+/* Elements processed by a chunk of the thread pool at least. */
+constexpr size_t scan_grain = 1 << 14;
+
+struct Scan_sum
+{
+    template <typename T>
+    T operator()(const T& a, const T& b) const { return a + b; }
+
+    template <typename T>
+    static T identity() { return T(0); }
+};
+
+struct Scan_prod
+{
+    template <typename T>
+    T operator()(const T& a, const T& b) const { return a * b; }
+
+    template <typename T>
+    static T identity() { return T(1); }
+};
+
+/* NaNs propagate: once seen, they stay the running maximum. */
+struct Scan_max
+{
+    template <typename T>
+    T operator()(const T& a, const T& b) const { return (b > a || b != b) ? b : a; }
+
+    template <typename T>
+    static T identity() {
+        return std::numeric_limits<T>::has_infinity
+            ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+    }
+};
+
+struct Scan_min
+{
+    template <typename T>
+    T operator()(const T& a, const T& b) const { return (b < a || b != b) ? b : a; }
+
+    template <typename T>
+    static T identity() {
+        return std::numeric_limits<T>::has_infinity
+            ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+    }
+};
+
+/**
+ * @brief Inclusive scan of @a n contiguous elements starting from @a carry.
+ * Returns the last value.
+ */
+template <typename T, typename Op>
+T scan_row(const T* x, T* y, size_t n, T carry, Op op) {
+    size_t i = 0;
+    for (; i + scan_width <= n; i += scan_width) {
+        T v[scan_width];
+        std::copy_n(x + i, scan_width, v);
+        for (size_t d = 1; d < scan_width; d *= 2) {
+            for (size_t j = scan_width - 1; j >= d; --j) {
+                v[j] = op(v[j - d], v[j]);
+            }
+        }
+        for (size_t j = 0; j < scan_width; ++j) {
+            y[i + j] = op(carry, v[j]);
+        }
+        carry = y[i + scan_width - 1];
+    }
+    for (; i < n; ++i) {
+        carry = y[i] = op(carry, x[i]);
+    }
+    return carry;
+}
+
+/**
+ * @brief Reduces @a n contiguous elements with independent accumulators.
+ */
+template <typename T, typename Op>
+T reduce_row(const T* x, size_t n, Op op) {
+    T acc[scan_width];
+    std::fill(acc, acc + scan_width, Op::template identity<T>());
+    size_t i = 0;
+    for (; i + scan_width <= n; i += scan_width) {
+        for (size_t j = 0; j < scan_width; ++j) {
+            acc[j] = op(acc[j], x[i + j]);
+        }
+    }
+    T res = Op::template identity<T>();
+    for (size_t j = 0; j < scan_width; ++j) {
+        res = op(res, acc[j]);
+    }
+    for (; i < n; ++i) {
+        res = op(res, x[i]);
+    }
+    return res;
+}
+
+/**
+ * @brief Scans @a w rows laid out as the columns of an (n x w) panel with row
+ * stride @a ld.
+ */
+template <typename T, typename Op>
+void scan_lanes(const T* x, T* y, size_t n, size_t ld, size_t w, Op op) {
+    std::copy_n(x, w, y);
+    for (size_t i = 1; i < n; ++i) {
+        const T* prev = y + (i - 1) * ld;
+        const T* r = x + i * ld;
+        T* o = y + i * ld;
+        for (size_t j = 0; j < w; ++j) {
+            o[j] = op(prev[j], r[j]);
+        }
+    }
+}
+
+template <typename T, typename Op>
+Tensor<T> scan(const Tensor<T>& x, long axis, Op op) {
+    size_t outer, n, inner;
+    split_axis(x.shape(), axis, outer, n, inner);
+    auto c = x.is_contiguous() ? x : x.copy();
+    const T* in = c.data_ptr();
+    Buffer<T> out(x.size());
+    T* dst = out.data();
+    auto& pool = ThreadPool::instance();
+
+    if (inner > 1) {
+        size_t panels = (inner + scan_panel - 1) / scan_panel;
+        size_t work = std::max<size_t>(n * std::min(inner, scan_panel), 1);
+        pool.parallel_for(outer * panels, std::max<size_t>(scan_grain / work, 1),
+                          [&] (size_t b, size_t e) {
+            for (size_t u = b; u < e; ++u) {
+                size_t o = u / panels, j0 = (u % panels) * scan_panel;
+                size_t off = o * n * inner + j0;
+                if (n) {
+                    scan_lanes(in + off, dst + off, n, inner,
+                               std::min(scan_panel, inner - j0), op);
+                }
+            }
+        });
+    }
+    else if (outer >= pool.size() || n < 2 * scan_grain || ThreadPool::in_parallel()) {
+        pool.parallel_for(outer, std::max<size_t>(scan_grain / std::max<size_t>(n, 1), 1),
+                          [&] (size_t b, size_t e) {
+            for (size_t o = b; o < e; ++o) {
+                scan_row(in + o * n, dst + o * n, n, Op::template identity<T>(), op);
+            }
+        });
+    }
+    else {
+        /* Two-pass blocked scan, one block of each row per thread. */
+        size_t parts = pool.size();
+        std::vector<T> carry(outer * parts);
+        auto block = [n, parts] (size_t p, size_t& lo, size_t& hi) {
+            lo = n * p / parts;
+            hi = n * (p + 1) / parts;
+        };
+
+        pool.parallel_for(parts, 1, [&] (size_t b, size_t e) {
+            for (size_t p = b; p < e; ++p) {
+                size_t lo, hi;
+                block(p, lo, hi);
+                for (size_t o = 0; o < outer; ++o) {
+                    carry[o * parts + p] = reduce_row(in + o * n + lo, hi - lo, op);
+                }
+            }
+        });
+
+        /* Exclusive scan of the block totals. */
+        for (size_t o = 0; o < outer; ++o) {
+            T acc = Op::template identity<T>();
+            for (size_t p = 0; p < parts; ++p) {
+                T total = carry[o * parts + p];
+                carry[o * parts + p] = acc;
+                acc = op(acc, total);
+            }
+        }
+
+        pool.parallel_for(parts, 1, [&] (size_t b, size_t e) {
+            for (size_t p = b; p < e; ++p) {
+                size_t lo, hi;
+                block(p, lo, hi);
+                for (size_t o = 0; o < outer; ++o) {
+                    scan_row(in + o * n + lo, dst + o * n + lo, hi - lo,
+                             carry[o * parts + p], op);
+                }
+            }
+        });
+    }
+    return Tensor<T>(std::move(out), x.shape());
+}
+
+}   // namespace internal
+
+/**************************************************
+                    Scans
+ **************************************************/
+
+/*
+ * Inclusive scans along @a axis, negative values counting from the last axis.
+ * The result has the shape of the input.
+ */
+
+/**
+ * @brief Cumulative sum along @a axis.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> cumsum(const Tensor<T>& x, long axis = -1) {
+    return internal::scan(x, axis, internal::Scan_sum());
+}
+
+/**
+ * @brief Cumulative product along @a axis.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> cumprod(const Tensor<T>& x, long axis = -1) {
+    return internal::scan(x, axis, internal::Scan_prod());
+}
+
+/**
+ * @brief Running maximum along @a axis. A NaN stays the maximum once reached.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> cummax(const Tensor<T>& x, long axis = -1) {
+    return internal::scan(x, axis, internal::Scan_max());
+}
+
+/**
+ * @brief Running minimum along @a axis. A NaN stays the minimum once reached.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> cummin(const Tensor<T>& x, long axis = -1) {
+    return internal::scan(x, axis, internal::Scan_min());
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_SCAN_H_
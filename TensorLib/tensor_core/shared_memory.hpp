@@ -0,0 +1,447 @@
+#ifndef TENSORLIB_SHARED_MEMORY_H_
+#define TENSORLIB_SHARED_MEMORY_H_
+
+#include "tensor.hpp"
+#include "tensor_io.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace TL {
+
+namespace internal {
+
+/*
+ * Shared memory tensors live in POSIX shared memory segments, which other
+ * processes open by name:
+ *
+ *     "TLSM"              4 bytes   magic
+ *     kind, elem size     2 bytes   as in tensor files (see tensor_io.hpp)
+ *     reserved            2 bytes
+ *     ndim                uint32
+ *     reserved            4 bytes
+ *     shape               ndim x uint64
+ *     strides             ndim x int64, in elements
+ *     elements            from the next multiple of 64 bytes
+ *
+ * Rings of tensors have a control block instead, followed by the slots.
+ */
+
+constexpr char shm_tensor_magic[4] = {'T', 'L', 'S', 'M'};
+constexpr char shm_ring_magic[4] = {'T', 'L', 'S', 'R'};
+constexpr size_t shm_align = 64;
+
+inline size_t shm_round(size_t bytes) {
+    return (bytes + shm_align - 1) / shm_align * shm_align;
+}
+
+/**
+ * @brief Writes @a magic to @a at with release semantics, once the rest of
+ * the header is written: a process that reads it back with shm_published()
+ * also sees that header.
+ */
+inline void shm_publish(std::atomic<uint32_t>& at, const char (&magic)[4]) {
+    uint32_t m;
+    std::memcpy(&m, magic, 4);
+    at.store(m, std::memory_order_release);
+}
+
+inline bool shm_published(const std::atomic<uint32_t>& at, const char (&magic)[4]) {
+    uint32_t m;
+    std::memcpy(&m, magic, 4);
+    return at.load(std::memory_order_acquire) == m;
+}
+
+/* The magic at the beginning of a segment, which mappings align on pages. */
+inline std::atomic<uint32_t>& shm_magic(const char* segment) {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(const_cast<char*>(segment));
+}
+
+/**
+ * @brief A shared memory segment mapped in the process, unmapped with the
+ * last tensor using it.
+ */
+class ShmMapping
+{
+public:
+    /**
+     * @brief Creates the segment @a name of @a bytes zeroed bytes, or opens
+     * it when @a bytes is 0.
+     * @throw std::runtime_error when the segment cannot be created (it
+     * exists already) or opened.
+     */
+    ShmMapping(const std::string& name, size_t bytes, bool writable) {
+        int flags = bytes ? O_RDWR | O_CREAT | O_EXCL : writable ? O_RDWR : O_RDONLY;
+        int fd = ::shm_open(name.c_str(), flags, 0600);
+        if (fd < 0) {
+            throw std::runtime_error((bytes ? "Cannot create " : "Cannot open ") + name);
+        }
+        struct stat st;
+        if (bytes ? ::ftruncate(fd, off_t(bytes)) < 0 : ::fstat(fd, &st) < 0) {
+            ::close(fd);
+            if (bytes) {
+                ::shm_unlink(name.c_str());
+            }
+            throw std::runtime_error("Cannot size " + name);
+        }
+        len = bytes ? bytes : size_t(st.st_size);
+        int prot = writable || bytes ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* p = len ? ::mmap(nullptr, len, prot, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            if (bytes) {
+                ::shm_unlink(name.c_str());
+            }
+            throw std::runtime_error("Cannot map " + name);
+        }
+        ptr = static_cast<char*>(p);
+    }
+
+    ShmMapping(const ShmMapping&) = delete;
+    ShmMapping& operator=(const ShmMapping&) = delete;
+
+    ~ShmMapping() {
+        ::munmap(ptr, len);
+    }
+
+    char* data() const {
+        return ptr;
+    }
+
+    size_t size() const {
+        return len;
+    }
+
+private:
+    char* ptr;
+    size_t len;
+};
+
+/**
+ * @brief Returns a tensor over elements of the mapping, which stays mapped
+ * as long as the tensor is used.
+ */
+template <typename T>
+Tensor<T> shm_view(const std::shared_ptr<ShmMapping>& map, size_t offset,
+                   const std::vector<size_t>& shape, const std::vector<long>& strides) {
+    T* ptr = reinterpret_cast<T*>(map->data() + offset);
+    return Tensor<T>(ptr, shape, strides, [map] (T*) {});
+}
+
+/**
+ * @brief Control block of a ring, at the beginning of its segment. The
+ * counters are only written by one side each, on their own cache lines.
+ */
+struct ShmRingControl
+{
+    std::atomic<uint32_t> magic;
+    uint8_t kind_size[4];
+    uint32_t ndim;
+    uint32_t reserved;
+    uint64_t capacity;
+    /* Position of the first slot and distance between slots, in bytes. */
+    uint64_t slot_offset;
+    uint64_t slot_bytes;
+    /* Slots published by the producer. */
+    alignas(shm_align) std::atomic<uint64_t> head;
+    /* Slots given back by the consumer. */
+    alignas(shm_align) std::atomic<uint64_t> tail;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free
+              && std::atomic<uint32_t>::is_always_lock_free
+              && sizeof(std::atomic<uint32_t>) == 4,
+              "Shared memory segments need lock free 32 and 64 bit atomics");
+
+}   // namespace internal
+
+/**************************************************
+               Shared memory tensors
+ **************************************************/
+
+/**
+ * @brief Creates the shared memory segment @a name holding a zeroed tensor
+ * of shape @a shape, and returns it. Other processes get the same elements
+ * from TL::shm_attach(). The segment lives until TL::shm_remove().
+ * @throw std::runtime_error when the segment exists already or cannot be
+ * created.
+ */
+template <typename T>
+Tensor<T> shm_create(const std::string& name, const std::vector<size_t>& shape) {
+    size_t ndim = shape.size();
+    size_t size = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+    size_t offset = internal::shm_round(16 + 16 * ndim);
+    auto map = std::make_shared<internal::ShmMapping>(name, offset + size * sizeof(T), true);
+
+    std::vector<long> strides(ndim, 1);
+    for (size_t d = ndim; d-- > 1;) {
+        strides[d - 1] = strides[d] * long(shape[d]);
+    }
+    char* h = map->data();
+    uint8_t kind_size[4] = {uint8_t(internal::dtype_kind<T>()), uint8_t(sizeof(T)), 0, 0};
+    uint32_t n = uint32_t(ndim);
+    std::memcpy(h + 4, kind_size, 4);
+    std::memcpy(h + 8, &n, 4);
+    for (size_t d = 0; d < ndim; ++d) {
+        uint64_t s = shape[d];
+        int64_t st = strides[d];
+        std::memcpy(h + 16 + 8 * d, &s, 8);
+        std::memcpy(h + 16 + 8 * (ndim + d), &st, 8);
+    }
+    /* The magic last: a segment is valid once it is written. */
+    internal::shm_publish(internal::shm_magic(h), internal::shm_tensor_magic);
+    return internal::shm_view<T>(map, offset, shape, strides);
+}
+
+/**
+ * @brief Returns the tensor of the shared memory segment @a name, created
+ * by TL::shm_create() possibly in another process, without copying it.
+ * Unless @a writable, the elements are mapped read only and writing them
+ * crashes the process.
+ * @throw std::runtime_error when the segment cannot be opened, isn't a
+ * tensor or doesn't hold elements of type T.
+ */
+template <typename T>
+Tensor<T> shm_attach(const std::string& name, bool writable = false) {
+    auto map = std::make_shared<internal::ShmMapping>(name, 0, writable);
+    const char* h = map->data();
+    uint32_t ndim;
+    if (map->size() < 16 || !internal::shm_published(internal::shm_magic(h), internal::shm_tensor_magic)) {
+        throw std::runtime_error(name + " isn't a shared memory tensor");
+    }
+    std::memcpy(&ndim, h + 8, 4);
+    if (char(h[4]) != internal::dtype_kind<T>() || uint8_t(h[5]) != sizeof(T)) {
+        throw std::runtime_error("Type of the shared memory tensor mismatch");
+    }
+    size_t offset = internal::shm_round(16 + 16 * size_t(ndim));
+    if (map->size() < offset) {
+        throw std::runtime_error(name + " isn't a shared memory tensor");
+    }
+
+    std::vector<size_t> shape(ndim);
+    std::vector<long> strides(ndim);
+    long high = 0;
+    for (size_t d = 0; d < ndim; ++d) {
+        uint64_t s;
+        int64_t st;
+        std::memcpy(&s, h + 16 + 8 * d, 8);
+        std::memcpy(&st, h + 16 + 8 * (ndim + d), 8);
+        shape[d] = size_t(s);
+        strides[d] = long(st);
+        if (st < 0) {
+            throw std::runtime_error(name + " isn't a shared memory tensor");
+        }
+        high += s ? long(s - 1) * st : 0;
+    }
+    if (offset + size_t(high + 1) * sizeof(T) > map->size()) {
+        throw std::runtime_error(name + " isn't a shared memory tensor");
+    }
+    return internal::shm_view<T>(map, offset, shape, strides);
+}
+
+/**
+ * @brief Removes the shared memory segment @a name. Processes using it keep
+ * their mappings.
+ */
+inline void shm_remove(const std::string& name) {
+    ::shm_unlink(name.c_str());
+}
+
+/**************************************************
+               ShmRing declaration
+ **************************************************/
+
+/**
+ * @brief Lock free ring of tensors of a fixed shape in shared memory, from
+ * one producer to one consumer, possibly in different processes.
+ *
+ * The producer fills the slot given by write_slot() in place and publishes
+ * it with push(); the consumer reads the slot given by read_slot() in place
+ * and gives it back with pop(). Neither side ever waits for the other: an
+ * empty optional tells that the ring is full, or empty.
+ * @tparam T Type of the elements of the tensors.
+ */
+template <typename T>
+class ShmRing
+{
+public:
+    /**
+     * @brief Creates the ring @a name of @a capacity tensors of shape
+     * @a shape. It lives until TL::shm_remove().
+     * @throw std::runtime_error when the segment exists already or cannot
+     * be created.
+     */
+    ShmRing(const std::string& name, size_t capacity, const std::vector<size_t>& shape);
+
+    /**
+     * @brief Opens the ring @a name created by another ShmRing.
+     * @throw std::runtime_error when the segment isn't a ring of tensors of
+     * type T.
+     */
+    explicit ShmRing(const std::string& name);
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    /**
+     * @brief Producer: returns the next slot to fill, or nothing when the
+     * ring is full.
+     */
+    std::optional<Tensor<T>> write_slot() {
+        uint64_t head = ctl->head.load(std::memory_order_relaxed);
+        if (head - ctl->tail.load(std::memory_order_acquire) >= slots.size()) {
+            return std::nullopt;
+        }
+        return slots[head % slots.size()];
+    }
+
+    /**
+     * @brief Producer: publishes the slot returned by write_slot().
+     */
+    void push() {
+        ctl->head.store(ctl->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Producer: copies @a x into the next slot and publishes it.
+     * Returns false, without copying, when the ring is full.
+     * @throw std::runtime_error when @a x isn't of the shape of the slots.
+     */
+    bool try_push(const Tensor<T>& x);
+
+    /**
+     * @brief Consumer: returns the oldest published slot, or nothing when
+     * the ring is empty.
+     */
+    std::optional<Tensor<T>> read_slot() {
+        uint64_t tail = ctl->tail.load(std::memory_order_relaxed);
+        if (tail == ctl->head.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        return slots[tail % slots.size()];
+    }
+
+    /**
+     * @brief Consumer: gives back the slot returned by read_slot().
+     */
+    void pop() {
+        ctl->tail.store(ctl->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+    const std::vector<size_t>& shape() const {
+        return slot_shape;
+    }
+
+private:
+    std::shared_ptr<internal::ShmMapping> map;
+    internal::ShmRingControl* ctl;
+    std::vector<size_t> slot_shape;
+    /* Views over the slots, made once. */
+    std::vector<Tensor<T>> slots;
+
+    void _make_slots();
+};
+
+/**************************************************
+               ShmRing definition
+ **************************************************/
+
+template <typename T>
+ShmRing<T>::ShmRing(const std::string& name, size_t capacity, const std::vector<size_t>& shape)
+: slot_shape(shape) {
+    if (!capacity) {
+        throw std::runtime_error("Ring capacity should be positive");
+    }
+    size_t size = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+    size_t slot_offset = internal::shm_round(sizeof(internal::ShmRingControl) + 8 * shape.size());
+    size_t slot_bytes = internal::shm_round(size * sizeof(T));
+    map = std::make_shared<internal::ShmMapping>(name, slot_offset + capacity * slot_bytes, true);
+
+    ctl = new (map->data()) internal::ShmRingControl{};
+    ctl->kind_size[0] = uint8_t(internal::dtype_kind<T>());
+    ctl->kind_size[1] = uint8_t(sizeof(T));
+    ctl->ndim = uint32_t(shape.size());
+    ctl->capacity = capacity;
+    ctl->slot_offset = slot_offset;
+    ctl->slot_bytes = slot_bytes;
+    for (size_t d = 0; d < shape.size(); ++d) {
+        uint64_t s = shape[d];
+        std::memcpy(map->data() + sizeof(internal::ShmRingControl) + 8 * d, &s, 8);
+    }
+    internal::shm_publish(ctl->magic, internal::shm_ring_magic);
+    _make_slots();
+}
+
+template <typename T>
+ShmRing<T>::ShmRing(const std::string& name)
+: map(std::make_shared<internal::ShmMapping>(name, 0, true)) {
+    ctl = reinterpret_cast<internal::ShmRingControl*>(map->data());
+    if (map->size() < sizeof(internal::ShmRingControl)
+        || !internal::shm_published(ctl->magic, internal::shm_ring_magic)) {
+        throw std::runtime_error(name + " isn't a ring of tensors");
+    }
+    if (char(ctl->kind_size[0]) != internal::dtype_kind<T>() || ctl->kind_size[1] != sizeof(T)) {
+        throw std::runtime_error("Type of the ring of tensors mismatch");
+    }
+    for (size_t d = 0; d < ctl->ndim; ++d) {
+        uint64_t s;
+        std::memcpy(&s, map->data() + sizeof(internal::ShmRingControl) + 8 * d, 8);
+        slot_shape.push_back(size_t(s));
+    }
+    /* A corrupt capacity mustn't reach the modulo of the slot indices. */
+    if (!ctl->capacity || ctl->slot_offset > map->size()
+        || ctl->capacity > (map->size() - ctl->slot_offset) / std::max<uint64_t>(ctl->slot_bytes, 1)) {
+        throw std::runtime_error(name + " isn't a ring of tensors");
+    }
+    _make_slots();
+}
+
+template <typename T>
+void ShmRing<T>::_make_slots() {
+    std::vector<long> strides(slot_shape.size(), 1);
+    for (size_t d = slot_shape.size(); d-- > 1;) {
+        strides[d - 1] = strides[d] * long(slot_shape[d]);
+    }
+    for (size_t i = 0; i < ctl->capacity; ++i) {
+        size_t offset = ctl->slot_offset + i * ctl->slot_bytes;
+        slots.push_back(internal::shm_view<T>(map, offset, slot_shape, strides));
+    }
+}
+
+template <typename T>
+bool ShmRing<T>::try_push(const Tensor<T>& x) {
+    if (x.shape() != slot_shape) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+    auto slot = write_slot();
+    if (!slot) {
+        return false;
+    }
+    auto c = x.is_contiguous() ? x : x.copy();
+    std::copy_n(c.data_ptr(), c.size(), slot->data_ptr());
+    push();
+    return true;
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_SHARED_MEMORY_H_
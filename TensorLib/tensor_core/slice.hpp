@@ -5,6 +5,7 @@
 #include "utils.hpp"
 
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace TL {
@@ -24,6 +25,12 @@ struct Slice {
     Slice(Dims... dims) {
         put_range(dims...);
     }
+
+    /**
+     * @brief Constructs from one range per dimension, when the number of
+     * dimensions is only known at runtime.
+     */
+    explicit Slice(std::vector<Range> _ranges) : ranges(std::move(_ranges)) {}
     
     std::vector<Range> ranges;
 private:
@@ -44,11 +51,11 @@ private:
                 Slice definition 
  **************************************************/
 
-void Slice::put_range(Range r) {
+inline void Slice::put_range(Range r) {
     ranges.push_back(r);
 }
 
-void Slice::put_range(size_t s) {
+inline void Slice::put_range(size_t s) {
     ranges.push_back(Range(s, s+1));
 }
 
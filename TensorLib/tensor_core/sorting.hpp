@@ -0,0 +1,330 @@
+#ifndef TENSORLIB_SORTING_H_
+#define TENSORLIB_SORTING_H_
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/*
+ * Rows along the sorted axis are gathered from the (possibly strided) input
+ * into a per thread buffer, sorted there and scattered to the contiguous
+ * result. Independent rows are sorted in parallel.
+ *
+ * Ordering is total: NaNs are placed after every other value in both
+ * directions, and equal keys keep the order of their indices, so that the
+ * results don't depend on the algorithm picked for a row.
+ */
+
+/* Rows up to this length are sorted by a sorting network. */
+constexpr size_t sort_network_size = 16;
+/* Elements processed by a chunk of the thread pool at least. */
+constexpr size_t sort_grain = 1 << 13;
+
+template <typename T>
+inline bool is_nan(const T& x) {
+    return !(x == x);
+}
+
+/**
+ * @brief Strict weak ordering of the keys, NaNs last.
+ */
+template <typename T>
+struct Key_less
+{
+    bool descending;
+
+    bool operator()(const T& a, const T& b) const {
+        if (is_nan(a) || is_nan(b)) {
+            return !is_nan(a) && is_nan(b);
+        }
+        return descending ? b < a : a < b;
+    }
+};
+
+/**
+ * @brief Ordering of (key, index) pairs, ties broken by index.
+ */
+template <typename T>
+struct Pair_less
+{
+    Key_less<T> key;
+
+    bool operator()(const std::pair<T, size_t>& a, const std::pair<T, size_t>& b) const {
+        if (key(a.first, b.first)) {
+            return true;
+        }
+        return !key(b.first, a.first) && a.second < b.second;
+    }
+};
+
+/**
+ * @brief Comparators of Batcher's odd-even merge sort for
+ * @a sort_network_size elements.
+ *
+ * A network for n smaller elements is the same network with the comparators
+ * touching indices >= n removed: these behave as elements bigger than all the
+ * others, so their comparators never swap.
+ */
+inline const std::vector<std::pair<uint8_t, uint8_t>>& sort_network() {
+    static const std::vector<std::pair<uint8_t, uint8_t>> net = [] () {
+        std::vector<std::pair<uint8_t, uint8_t>> res;
+        const size_t N = sort_network_size;
+        for (size_t p = 1; p < N; p <<= 1) {
+            for (size_t k = p; k >= 1; k >>= 1) {
+                for (size_t j = k % p; j + k < N; j += 2 * k) {
+                    for (size_t i = 0; i < std::min(k, N - j - k); ++i) {
+                        if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+                            res.emplace_back(i + j, i + j + k);
+                        }
+                    }
+                }
+            }
+        }
+        return res;
+    }();
+    return net;
+}
+
+/**
+ * @brief Sorts up to @a sort_network_size elements with compare-exchanges
+ * that the compiler turns into conditional moves instead of branches.
+ */
+template <typename V, typename Less>
+void network_sort(V* v, size_t n, Less less) {
+    for (auto [a, b] : sort_network()) {
+        if (b >= n) {
+            continue;
+        }
+        V x = v[a], y = v[b];
+        bool swap = less(y, x);
+        v[a] = swap ? y : x;
+        v[b] = swap ? x : y;
+    }
+}
+
+template <typename V, typename Less>
+void sort_row(V* v, size_t n, Less less) {
+    if (n <= sort_network_size) {
+        network_sort(v, n, less);
+    }
+    else {
+        std::sort(v, v + n, less);
+    }
+}
+
+/**
+ * @brief The k first elements of @a v in order, by @a less. Small k keeps a
+ * heap of the current best candidates, so most elements are rejected by a
+ * single comparison with its root; large k partitions with introselect
+ * (std::nth_element) and sorts the head.
+ */
+template <typename V, typename Less>
+void select_row(V* v, size_t n, size_t k, Less less) {
+    if (!k) {
+        return;
+    }
+    if (k * 16 <= n) {
+        /* Max heap by less: the root is the worst of the candidates. */
+        std::make_heap(v, v + k, less);
+        for (size_t i = k; i < n; ++i) {
+            if (less(v[i], v[0])) {
+                std::pop_heap(v, v + k, less);
+                std::swap(v[k - 1], v[i]);
+                std::push_heap(v, v + k, less);
+            }
+        }
+        std::sort_heap(v, v + k, less);
+        return;
+    }
+    if (k < n) {
+        std::nth_element(v, v + k - 1, v + n, less);
+    }
+    sort_row(v, k, less);
+}
+
+/**
+ * @brief Geometry of the rows of a tensor along an axis.
+ */
+struct Axis_rows
+{
+    size_t outer, n, inner;
+    long axis;
+    std::vector<size_t> shape;
+    std::vector<long> strides;
+
+    template <typename T>
+    Axis_rows(const Tensor<T>& x, long _axis)
+    : axis(normalize_axis(_axis, x.ndim())), shape(x.shape()), strides(x.strides()) {
+        split_axis(shape, axis, outer, n, inner);
+    }
+
+    size_t rows() const {
+        return outer * inner;
+    }
+
+    /**
+     * @brief Offset in the input of the first element of row @a r.
+     */
+    long offset(size_t r) const {
+        long off = 0;
+        for (long i = long(shape.size()) - 1; i >= 0; --i) {
+            if (i == axis) {
+                continue;
+            }
+            off += long(r % shape[i]) * strides[i];
+            r /= shape[i];
+        }
+        return off;
+    }
+
+    /**
+     * @brief Offset in a contiguous result whose axis has length @a len of
+     * the first element of row @a r.
+     */
+    size_t out_offset(size_t r, size_t len) const {
+        return (r / inner) * len * inner + r % inner;
+    }
+
+    std::vector<size_t> out_shape(size_t len) const {
+        auto s = shape;
+        s[axis] = len;
+        return s;
+    }
+};
+
+/**
+ * @brief Calls @a func(row, buffer) for every row in parallel, @a buffer
+ * being a per thread vector of @a len elements.
+ */
+template <typename V, typename F>
+void for_each_row(const Axis_rows& g, size_t len, F func) {
+    size_t grain = std::max<size_t>(sort_grain / std::max<size_t>(g.n, 1), 1);
+    ThreadPool::instance().parallel_for(g.rows(), grain, [&] (size_t b, size_t e) {
+        std::vector<V> buf(len);
+        for (size_t r = b; r < e; ++r) {
+            func(r, buf.data());
+        }
+    });
+}
+
+/**
+ * @brief Sorts the (key, index) pairs of every row and writes the first @a k
+ * of them to @a values and/or @a indices, which may be null.
+ */
+template <typename T>
+void sort_pairs(const Tensor<T>& x, const Axis_rows& g, size_t k, bool descending,
+                bool partial, T* values, size_t* indices) {
+    const T* src = x.data_ptr();
+    long step = g.strides[g.axis];
+    Pair_less<T> less{{descending}};
+    for_each_row<std::pair<T, size_t>>(g, g.n, [&] (size_t r, std::pair<T, size_t>* v) {
+        const T* row = src + g.offset(r);
+        for (size_t i = 0; i < g.n; ++i) {
+            v[i] = {row[long(i) * step], i};
+        }
+        if (partial) {
+            select_row(v, g.n, k, less);
+        }
+        else {
+            sort_row(v, g.n, less);
+        }
+
+        size_t o = g.out_offset(r, k);
+        for (size_t i = 0; i < k; ++i) {
+            if (values) {
+                values[o + i * g.inner] = v[i].first;
+            }
+            if (indices) {
+                indices[o + i * g.inner] = v[i].second;
+            }
+        }
+    });
+}
+
+}   // namespace internal
+
+/**************************************************
+                    Sorting
+ **************************************************/
+
+/*
+ * The functions below work along @a axis, negative values counting from the
+ * last axis, and accept non contiguous tensors (slices) without copying them.
+ * NaNs are ordered after every other value.
+ */
+
+/**
+ * @brief Returns a copy of @a x with the elements sorted along @a axis.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<T> sort(const Tensor<T>& x, long axis = -1, bool descending = false) {
+    internal::Axis_rows g(x, axis);
+    internal::Buffer<T> out(x.size());
+    const T* src = x.data_ptr();
+    long step = g.strides[g.axis];
+    internal::Key_less<T> less{descending};
+
+    internal::for_each_row<T>(g, g.n, [&] (size_t r, T* v) {
+        const T* row = src + g.offset(r);
+        for (size_t i = 0; i < g.n; ++i) {
+            v[i] = row[long(i) * step];
+        }
+        internal::sort_row(v, g.n, less);
+
+        T* dst = out.data() + g.out_offset(r, g.n);
+        for (size_t i = 0; i < g.n; ++i) {
+            dst[i * g.inner] = v[i];
+        }
+    });
+    return Tensor<T>(std::move(out), x.shape());
+}
+
+/**
+ * @brief Returns the indices along @a axis that sort @a x along @a axis.
+ * Equal elements keep their relative order.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+template <typename T>
+Tensor<size_t> argsort(const Tensor<T>& x, long axis = -1, bool descending = false) {
+    internal::Axis_rows g(x, axis);
+    internal::Buffer<size_t> out(x.size());
+    internal::sort_pairs<T>(x, g, g.n, descending, false, nullptr, out.data());
+    return Tensor<size_t>(std::move(out), x.shape());
+}
+
+/**
+ * @brief Returns the @a k largest (or smallest when @a largest is false)
+ * elements along @a axis in order, and their indices along @a axis. Among
+ * equal elements the ones with smaller indices come first.
+ * @throw std::out_of_range when the axis doesn't exist or @a k is bigger than
+ * its length.
+ */
+template <typename T>
+std::pair<Tensor<T>, Tensor<size_t>> topk(const Tensor<T>& x, size_t k, long axis = -1,
+                                         bool largest = true) {
+    internal::Axis_rows g(x, axis);
+    if (k > g.n) {
+        throw std::out_of_range("k is bigger than the length of the axis");
+    }
+    internal::Buffer<T> values(g.rows() * k);
+    internal::Buffer<size_t> indices(g.rows() * k);
+    internal::sort_pairs<T>(x, g, k, largest, true, values.data(), indices.data());
+    return {
+        Tensor<T>(std::move(values), g.out_shape(k)),
+        Tensor<size_t>(std::move(indices), g.out_shape(k))
+    };
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_SORTING_H_
@@ -0,0 +1,413 @@
+#ifndef TENSORLIB_SPARSE_H_
+#define TENSORLIB_SPARSE_H_
+
+#include "tensor.hpp"
+#include "range.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace TL {
+
+/**
+ * @brief Storage formats of a SparseTensor.
+ * @a COO - Coordinates of every non zero element, sorted in row major order.
+ * @a CSR - Compressed rows. The tensor is seen as a matrix of shape[0] rows
+ * whose columns are the flattened remaining dimensions.
+ */
+enum class SparseFormat {
+    COO,
+    CSR
+};
+
+/**************************************************
+              SparseTensor declaration
+ **************************************************/
+
+/**
+ * @brief A tensor that stores only its non zero elements, so that memory and
+ * the cost of the kernels scale with the number of non zeros.
+ * @tparam T Type of the elements in the tensor.
+ */
+template <typename T>
+class SparseTensor
+{
+public:
+    /**
+     * @brief Constructs a sparse tensor from the non zero elements of a dense
+     * tensor.
+     * @param _dense The tensor to be converted. Should have at least 1 dimension.
+     * @param _format Format in which the elements would be stored.
+     */
+    explicit SparseTensor(const Tensor<T>&, SparseFormat = SparseFormat::CSR);
+
+    /**
+     * @brief Constructs a COO sparse tensor from coordinates and values.
+     * @param _shape Shape of the tensor.
+     * @param _coords Flattened coordinates, ndim() of them for each element.
+     * Needn't be sorted. Duplicate coordinates are summed up.
+     * @param _values Values of the elements.
+     * @throw std::runtime_error when the number of coordinates and values mismatch.
+     * @throw std::out_of_range when a coordinate goes out of the shape.
+     */
+    SparseTensor(
+        const std::vector<size_t>&, const std::vector<size_t>&, const std::vector<T>&
+    );
+
+    SparseFormat format() const {
+        return fmt;
+    }
+
+    std::vector<size_t> shape() const {
+        return _shape;
+    }
+
+    size_t ndim() const {
+        return _shape.size();
+    }
+
+    /**
+     * @brief Returns the number of elements, including the zeros.
+     */
+    size_t size() const {
+        return std::accumulate(
+            _shape.begin(), _shape.end(), size_t(1), std::multiplies<size_t>()
+        );
+    }
+
+    /**
+     * @brief Returns the number of stored (non zero) elements.
+     */
+    size_t nnz() const {
+        return values.size();
+    }
+
+    /**
+     * @brief Returns the tensor converted to the given format.
+     */
+    SparseTensor to_format(SparseFormat) const;
+
+    /**
+     * @brief Returns the dense version of the tensor.
+     */
+    Tensor<T> to_dense() const;
+
+    /**
+     * @brief Returns the sub tensor [low, high) along the leading axis.
+     * @throw std::out_of_range when the range goes out of shape[0].
+     */
+    SparseTensor slice(Range) const;
+
+    /**
+     * @brief Raw storage of the tensor.
+     * @a COO: indices holds ndim() coordinates for each of the values.
+     * @a CSR: indptr holds shape[0] + 1 row offsets and indices holds the
+     * flattened column of each of the values.
+     */
+    const std::vector<T>& data() const {
+        return values;
+    }
+
+    const std::vector<size_t>& indices() const {
+        return idx;
+    }
+
+    const std::vector<size_t>& indptr() const {
+        return ptr;
+    }
+
+private:
+    SparseFormat fmt;
+    std::vector<size_t> _shape;
+    std::vector<T> values;
+    std::vector<size_t> idx;
+    std::vector<size_t> ptr;
+
+    SparseTensor(SparseFormat _fmt, const std::vector<size_t>& _sh)
+    : fmt(_fmt), _shape(_sh) {}
+
+    /**
+     * @brief Number of columns when the tensor is seen as a matrix.
+     */
+    size_t _cols() const {
+        return _shape.empty() ? 0 : size() / _shape[0];
+    }
+};
+
+/**
+ * @brief Multiplies a 2 dimensional sparse tensor with a dense vector (SpMV)
+ * or a dense matrix (SpMM). Rows of the result are computed in parallel.
+ * @param A Sparse tensor of shape (M, K).
+ * @param B Dense tensor of shape (K) or (K, N).
+ * @return Dense tensor of shape (M) or (M, N).
+ * @throw std::runtime_error when the shapes mismatch.
+ */
+template <typename T>
+Tensor<T> matmul(const SparseTensor<T>&, const Tensor<T>&);
+
+/**************************************************
+              SparseTensor definition
+ **************************************************/
+
+template <typename T>
+SparseTensor<T>::SparseTensor(const Tensor<T>& dense, SparseFormat _fmt)
+: fmt(SparseFormat::CSR), _shape(dense.shape()) {
+    if (!dense.ndim()) {
+        throw std::runtime_error("Sparse tensor should have at least 1 dimension");
+    }
+
+    auto src = dense.is_contiguous() ? dense : dense.copy();
+    const T* in = src.data_ptr();
+    size_t rows = _shape[0], cols = _cols();
+    auto& pool = internal::ThreadPool::instance();
+
+    /* Count the non zeros of each row, then fill the rows in parallel from
+    their offsets. */
+    ptr.assign(rows + 1, 0);
+    pool.parallel_for(rows, 64, [&] (size_t r0, size_t r1) {
+        for (size_t r = r0; r < r1; ++r) {
+            size_t count = 0;
+            for (size_t c = 0; c < cols; ++c) {
+                count += in[r * cols + c] != T();
+            }
+            ptr[r + 1] = count;
+        }
+    });
+    std::partial_sum(ptr.begin(), ptr.end(), ptr.begin());
+
+    values.resize(ptr[rows]);
+    idx.resize(ptr[rows]);
+    pool.parallel_for(rows, 64, [&] (size_t r0, size_t r1) {
+        for (size_t r = r0; r < r1; ++r) {
+            size_t k = ptr[r];
+            for (size_t c = 0; c < cols; ++c) {
+                if (in[r * cols + c] != T()) {
+                    values[k] = in[r * cols + c];
+                    idx[k++] = c;
+                }
+            }
+        }
+    });
+
+    if (_fmt == SparseFormat::COO) {
+        *this = to_format(SparseFormat::COO);
+    }
+}
+
+template <typename T>
+SparseTensor<T>::SparseTensor(
+    const std::vector<size_t>& _sh,
+    const std::vector<size_t>& coords,
+    const std::vector<T>& vals
+)
+: fmt(SparseFormat::COO), _shape(_sh) {
+    size_t N = ndim();
+    if (!N) {
+        throw std::runtime_error("Sparse tensor should have at least 1 dimension");
+    }
+    if (coords.size() != vals.size() * N) {
+        throw std::runtime_error("Number of coordinates and values mismatch");
+    }
+
+    /* Sort by the flat index so that the elements are in row major order. */
+    std::vector<size_t> flat(vals.size());
+    for (size_t k = 0; k < vals.size(); ++k) {
+        size_t f = 0;
+        for (size_t d = 0; d < N; ++d) {
+            if (coords[k * N + d] >= _shape[d]) {
+                throw std::out_of_range("Index out of range");
+            }
+            f = f * _shape[d] + coords[k * N + d];
+        }
+        flat[k] = f;
+    }
+
+    std::vector<size_t> order(vals.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&] (size_t a, size_t b) {
+        return flat[a] < flat[b];
+    });
+
+    for (size_t k = 0; k < order.size(); ++k) {
+        size_t o = order[k];
+        if (k && flat[o] == flat[order[k - 1]]) {
+            values.back() += vals[o];
+            continue;
+        }
+        values.push_back(vals[o]);
+        idx.insert(idx.end(), coords.begin() + o * N, coords.begin() + (o + 1) * N);
+    }
+}
+
+template <typename T>
+SparseTensor<T> SparseTensor<T>::to_format(SparseFormat to) const {
+    if (to == fmt) {
+        return *this;
+    }
+
+    size_t N = ndim(), rows = _shape[0];
+    SparseTensor res(to, _shape);
+    res.values = values;
+
+    if (to == SparseFormat::COO) {
+        /* Unflatten the columns into the coordinates of the trailing axes. */
+        res.idx.resize(nnz() * N);
+        internal::ThreadPool::instance().parallel_for(rows, 64, [&] (size_t r0, size_t r1) {
+            for (size_t r = r0; r < r1; ++r) {
+                for (size_t k = ptr[r]; k < ptr[r + 1]; ++k) {
+                    size_t c = idx[k];
+                    for (size_t d = N - 1; d > 0; --d) {
+                        res.idx[k * N + d] = c % _shape[d];
+                        c /= _shape[d];
+                    }
+                    res.idx[k * N] = r;
+                }
+            }
+        });
+    }
+    else {
+        /* COO is sorted in row major order, so only the row offsets and the
+        flattened columns are to be found. */
+        res.ptr.assign(rows + 1, 0);
+        res.idx.resize(nnz());
+        for (size_t k = 0; k < nnz(); ++k) {
+            size_t c = 0;
+            for (size_t d = 1; d < N; ++d) {
+                c = c * _shape[d] + idx[k * N + d];
+            }
+            res.idx[k] = c;
+            ++res.ptr[idx[k * N] + 1];
+        }
+        std::partial_sum(res.ptr.begin(), res.ptr.end(), res.ptr.begin());
+    }
+
+    return res;
+}
+
+template <typename T>
+Tensor<T> SparseTensor<T>::to_dense() const {
+    internal::Buffer<T> dense(size());
+    if (fmt == SparseFormat::CSR) {
+        size_t cols = _cols();
+        internal::ThreadPool::instance().parallel_for(_shape[0], 64, [&] (size_t r0, size_t r1) {
+            for (size_t r = r0; r < r1; ++r) {
+                for (size_t k = ptr[r]; k < ptr[r + 1]; ++k) {
+                    dense[r * cols + idx[k]] = values[k];
+                }
+            }
+        });
+    }
+    else {
+        size_t N = ndim();
+        for (size_t k = 0; k < nnz(); ++k) {
+            size_t f = 0;
+            for (size_t d = 0; d < N; ++d) {
+                f = f * _shape[d] + idx[k * N + d];
+            }
+            dense[f] = values[k];
+        }
+    }
+    return Tensor<T>(std::move(dense), _shape);
+}
+
+template <typename T>
+SparseTensor<T> SparseTensor<T>::slice(Range r) const {
+    if (r.low >= r.high) {
+        throw std::runtime_error("`low` range should be lesser than the `high` range");
+    }
+    if (r.high > _shape[0]) {
+        throw std::out_of_range("Index out of range");
+    }
+
+    auto sh = _shape;
+    sh[0] = r.high - r.low;
+    SparseTensor res(fmt, sh);
+
+    size_t first, last;
+    if (fmt == SparseFormat::CSR) {
+        first = ptr[r.low];
+        last = ptr[r.high];
+        res.ptr.assign(ptr.begin() + r.low, ptr.begin() + r.high + 1);
+        for (auto& p : res.ptr) {
+            p -= first;
+        }
+        res.idx.assign(idx.begin() + first, idx.begin() + last);
+    }
+    else {
+        /* Elements are sorted by their leading coordinate. */
+        size_t N = ndim();
+        auto lower = [&] (size_t row) {
+            size_t lo = 0, hi = nnz();
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (idx[mid * N] < row) {
+                    lo = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+            return lo;
+        };
+        first = lower(r.low);
+        last = lower(r.high);
+        res.idx.assign(idx.begin() + first * N, idx.begin() + last * N);
+        for (size_t k = 0; k < res.idx.size(); k += N) {
+            res.idx[k] -= r.low;
+        }
+    }
+    res.values.assign(values.begin() + first, values.begin() + last);
+    return res;
+}
+
+template <typename T>
+Tensor<T> matmul(const SparseTensor<T>& A, const Tensor<T>& B) {
+    if (A.ndim() != 2 || !B.ndim() || B.ndim() > 2 || A.shape()[1] != B.shape()[0]) {
+        throw std::runtime_error("Dimensions Mismatch");
+    }
+
+    auto csr = A.format() == SparseFormat::CSR ? A : A.to_format(SparseFormat::CSR);
+    auto dense = B.is_contiguous() ? B : B.copy();
+
+    size_t M = A.shape()[0];
+    size_t N = B.ndim() == 2 ? B.shape()[1] : 1;
+    const auto& ptr = csr.indptr();
+    const auto& col = csr.indices();
+    const auto& val = csr.data();
+    const T* b = dense.data_ptr();
+
+    internal::Buffer<T> out(M * N);
+    /* Grain in rows such that a chunk has work for a few thousand products. */
+    size_t grain = std::max<size_t>(1, 4096 / (N * (csr.nnz() / std::max<size_t>(M, 1) + 1)));
+    internal::ThreadPool::instance().parallel_for(M, grain, [&] (size_t r0, size_t r1) {
+        for (size_t r = r0; r < r1; ++r) {
+            T* c = out.data() + r * N;
+            if (N == 1) {
+                T acc = T();
+                for (size_t k = ptr[r]; k < ptr[r + 1]; ++k) {
+                    acc += val[k] * b[col[k]];
+                }
+                *c = acc;
+                continue;
+            }
+            for (size_t k = ptr[r]; k < ptr[r + 1]; ++k) {
+                const T v = val[k];
+                const T* brow = b + col[k] * N;
+                for (size_t j = 0; j < N; ++j) {
+                    c[j] += v * brow[j];
+                }
+            }
+        }
+    });
+
+    if (B.ndim() == 1) {
+        return Tensor<T>(std::move(out), {M});
+    }
+    return Tensor<T>(std::move(out), {M, N});
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_SPARSE_H_
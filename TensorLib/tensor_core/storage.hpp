@@ -0,0 +1,435 @@
+#ifndef TENSORLIB_STORAGE_H_
+#define TENSORLIB_STORAGE_H_
+
+#include "thread_pool.hpp"
+#include "numa.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace TL {
+
+namespace internal {
+
+/**************************************************
+                  Storage blocks
+ **************************************************/
+
+/*
+ * The elements of a tensor live in a single allocation, a block, made of a
+ * header followed by the elements. The header holds the reference counts of
+ * the block, so that sharing it between tensors costs no other allocation
+ * and reaching an element a single indirection.
+ *
+ * Counts are atomic unless TENSORLIB_NONATOMIC_REFCOUNT is defined, which
+ * is only safe when tensors sharing a block are never copied or destroyed
+ * concurrently, e.g. with TL_NUM_THREADS=1 and no TL::async.
+ */
+
+#if defined(TENSORLIB_NONATOMIC_REFCOUNT)
+using Refcount = size_t;
+#else
+using Refcount = std::atomic<size_t>;
+#endif
+
+inline void ref_acquire(Refcount& r) {
+#if defined(TENSORLIB_NONATOMIC_REFCOUNT)
+    ++r;
+#else
+    r.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+/**
+ * @brief Drops a reference and returns whether it was the last one.
+ */
+inline bool ref_release(Refcount& r) {
+#if defined(TENSORLIB_NONATOMIC_REFCOUNT)
+    return !--r;
+#else
+    return r.fetch_sub(1, std::memory_order_acq_rel) == 1;
+#endif
+}
+
+/**
+ * @brief Takes a reference unless the last one was already dropped, and
+ * returns whether it did.
+ */
+inline bool ref_acquire_live(Refcount& r) {
+#if defined(TENSORLIB_NONATOMIC_REFCOUNT)
+    return r ? (++r, true) : false;
+#else
+    size_t n = r.load(std::memory_order_relaxed);
+    while (n && !r.compare_exchange_weak(n, n + 1, std::memory_order_acq_rel,
+                                         std::memory_order_relaxed)) {}
+    return n != 0;
+#endif
+}
+
+/* Where the memory of a block comes from. */
+enum class BlockKind : uint8_t {
+    Heap,
+    /* Mapped by map_pages(). */
+    Mapped,
+    /* Elements owned by someone else, see ExternalBlock. */
+    External
+};
+
+struct BlockHeader
+{
+    /* References of the Storage handles, which own the elements. */
+    Refcount strong;
+    /* References of the WeakStorage handles, plus one for all the Storage
+    handles together. They own the memory of the block. */
+    Refcount weak;
+    /* Number of elements. */
+    size_t count;
+    /* Length of the allocation, header included. */
+    size_t bytes;
+    BlockKind kind;
+
+    BlockHeader(size_t _count, size_t _bytes, BlockKind _kind)
+    : strong(1), weak(1), count(_count), bytes(_bytes), kind(_kind) {}
+};
+
+/* Position of the elements in a block, aligned on a cache line. */
+constexpr size_t block_data_offset = 64;
+static_assert(sizeof(BlockHeader) <= block_data_offset, "Block header too large");
+
+/**
+ * @brief Block of elements allocated outside of the library, such as the
+ * buffers of other frameworks. The header is allocated on its own and
+ * @a release is called instead of freeing the elements.
+ */
+struct ExternalBlock : BlockHeader
+{
+    void* data;
+    std::function<void()> release;
+
+    ExternalBlock(size_t _count, void* _data, std::function<void()> _release)
+    : BlockHeader(_count, 0, BlockKind::External), data(_data), release(std::move(_release)) {}
+};
+
+template <typename T>
+T* block_data(BlockHeader* block) {
+    if (!block) {
+        return nullptr;
+    }
+    if (block->kind == BlockKind::External) {
+        return static_cast<T*>(static_cast<ExternalBlock*>(block)->data);
+    }
+    return reinterpret_cast<T*>(reinterpret_cast<char*>(block) + block_data_offset);
+}
+
+/**
+ * @brief Allocates a block of @a n zeroed elements. Large blocks are mapped
+ * directly from the system, so that their pages are untouched when they get
+ * the current NumaPolicy and are zeroed in parallel by first_touch().
+ */
+template <typename T>
+BlockHeader* block_allocate(size_t n) {
+    static_assert(alignof(T) <= block_data_offset, "Element type over-aligned");
+    size_t bytes = block_data_offset + n * sizeof(T);
+    void* raw;
+    BlockKind kind = BlockKind::Heap;
+    if (bytes < numa_min_bytes) {
+        raw = ::operator new(bytes, std::align_val_t(block_data_offset));
+        std::memset(static_cast<char*>(raw) + block_data_offset, 0, n * sizeof(T));
+    }
+    else {
+#if defined(__linux__)
+        raw = map_pages(bytes);
+        numa_place(raw, mapping_size(bytes), numa_policy());
+        kind = BlockKind::Mapped;
+#else
+        raw = ::operator new(bytes, std::align_val_t(block_data_offset));
+#endif
+        /* Fresh anonymous pages already read as zeros, but writing them
+        decides where they live. */
+        first_touch(reinterpret_cast<T*>(static_cast<char*>(raw) + block_data_offset), n);
+    }
+    return new (raw) BlockHeader(n, bytes, kind);
+}
+
+/**
+ * @brief Frees the memory of a block whose elements were destroyed.
+ */
+inline void block_free(BlockHeader* block) {
+    if (block->kind == BlockKind::External) {
+        auto* ext = static_cast<ExternalBlock*>(block);
+        if (ext->release) {
+            ext->release();
+        }
+        delete ext;
+        return;
+    }
+    size_t bytes = block->bytes;
+    BlockKind kind = block->kind;
+    block->~BlockHeader();
+#if defined(__linux__)
+    if (kind == BlockKind::Mapped) {
+        munmap(block, mapping_size(bytes));
+        return;
+    }
+#endif
+    (void) bytes;
+    (void) kind;
+    ::operator delete(static_cast<void*>(block), std::align_val_t(block_data_offset));
+}
+
+template <typename T>
+void block_destroy(BlockHeader* block) {
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+        if (block->kind != BlockKind::External) {
+            std::destroy_n(block_data<T>(block), block->count);
+        }
+    }
+}
+
+template <typename T> class Storage;
+template <typename T> class WeakStorage;
+
+/**************************************************
+                Buffer declaration
+ **************************************************/
+
+/**
+ * @brief Fixed size array holding the elements of tensors, in a block owned
+ * alone until a Storage takes it.
+ *
+ * Unlike std::vector, the elements are value-initialized without a serial
+ * pass: trivial ones are zeroed in parallel by block_allocate(), which places
+ * the pages of large buffers on the NUMA nodes of the threads that later
+ * compute on them.
+ */
+template <typename T>
+class Buffer
+{
+public:
+    Buffer() = default;
+
+    explicit Buffer(size_t n) : block(block_allocate<T>(n)) {
+        if constexpr (!std::is_trivially_default_constructible<T>::value) {
+            std::uninitialized_value_construct_n(data(), n);
+        }
+    }
+
+    Buffer(size_t n, const T& value) : block(block_allocate<T>(n)) {
+        T* ptr = data();
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            ThreadPool::instance().parallel_for(n, numa_grain, [&] (size_t b, size_t e) {
+                std::fill(ptr + b, ptr + e, value);
+            });
+        }
+        else {
+            std::uninitialized_fill_n(ptr, n, value);
+        }
+    }
+
+    /**
+     * @brief Copies the @a n elements at @a src, in parallel.
+     */
+    Buffer(const T* src, size_t n) : block(block_allocate<T>(n)) {
+        T* ptr = data();
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            ThreadPool::instance().parallel_for(n, numa_grain, [&] (size_t b, size_t e) {
+                std::copy(src + b, src + e, ptr + b);
+            });
+        }
+        else {
+            std::uninitialized_copy_n(src, n, ptr);
+        }
+    }
+
+    Buffer(const Buffer& other) : Buffer(other.data(), other.size()) {}
+
+    Buffer(Buffer&& other) noexcept : block(other.block) {
+        other.block = nullptr;
+    }
+
+    Buffer& operator=(Buffer other) noexcept {
+        std::swap(block, other.block);
+        return *this;
+    }
+
+    ~Buffer() {
+        if (block) {
+            block_destroy<T>(block);
+            block_free(block);
+        }
+    }
+
+    T* data() { return block_data<T>(block); }
+    const T* data() const { return block_data<T>(block); }
+
+    size_t size() const { return block ? block->count : 0; }
+    bool empty() const { return !size(); }
+
+    T& operator[](size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return data()[i]; }
+
+    T* begin() { return data(); }
+    T* end() { return data() + size(); }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size(); }
+
+private:
+    BlockHeader* block = nullptr;
+
+    friend class Storage<T>;
+};
+
+/**************************************************
+                Storage declaration
+ **************************************************/
+
+/**
+ * @brief Shared handle to the block of a tensor. Copies share the block,
+ * which is destroyed with the last of them. The pointer to the elements is
+ * kept next to the block, so reaching them doesn't load the block.
+ */
+template <typename T>
+class Storage
+{
+public:
+    Storage() = default;
+
+    /**
+     * @brief Takes the block of @a buf, without copying it.
+     */
+    explicit Storage(Buffer<T>&& buf) : block(buf.block), ptr(buf.data()) {
+        buf.block = nullptr;
+    }
+
+    Storage(const Storage& other) : block(other.block), ptr(other.ptr) {
+        if (block) {
+            ref_acquire(block->strong);
+        }
+    }
+
+    Storage(Storage&& other) noexcept : block(other.block), ptr(other.ptr) {
+        other.block = nullptr;
+        other.ptr = nullptr;
+    }
+
+    Storage& operator=(Storage other) noexcept {
+        std::swap(block, other.block);
+        std::swap(ptr, other.ptr);
+        return *this;
+    }
+
+    ~Storage() {
+        if (block && ref_release(block->strong)) {
+            block_destroy<T>(block);
+            if (ref_release(block->weak)) {
+                block_free(block);
+            }
+        }
+    }
+
+    /**
+     * @brief Shares the @a n elements at @a data without copying them.
+     * @a release is called once no tensor uses them anymore; it isn't when
+     * this throws, the elements are then left to the caller.
+     */
+    static Storage external(T* data, size_t n, std::function<void()> release) {
+        return Storage(new ExternalBlock(n, data, std::move(release)));
+    }
+
+    T* data() const { return ptr; }
+    size_t size() const { return block ? block->count : 0; }
+    T& operator[](size_t i) const { return ptr[i]; }
+
+    bool operator==(const Storage& other) const { return block == other.block; }
+    bool operator!=(const Storage& other) const { return block != other.block; }
+
+    /**
+     * @brief Returns the elements as a buffer, taking the block when this is
+     * its only handle and copying it otherwise. Leaves the handle empty.
+     */
+    Buffer<T> take() && {
+        if (!block || block->strong != 1 || block->weak != 1) {
+            Storage dropped(std::move(*this));
+            return Buffer<T>(dropped.ptr, dropped.size());
+        }
+        Buffer<T> buf;
+        buf.block = block;
+        block = nullptr;
+        ptr = nullptr;
+        return buf;
+    }
+
+private:
+    BlockHeader* block = nullptr;
+    T* ptr = nullptr;
+
+    /* Adopts a reference already taken on @a _block. */
+    explicit Storage(BlockHeader* _block) : block(_block), ptr(block_data<T>(_block)) {}
+
+    friend class WeakStorage<T>;
+};
+
+/**
+ * @brief Handle to the block of a tensor that doesn't keep its elements
+ * alive, as used by the iterators.
+ */
+template <typename T>
+class WeakStorage
+{
+public:
+    WeakStorage() = default;
+
+    WeakStorage(const Storage<T>& s) : block(s.block) {
+        if (block) {
+            ref_acquire(block->weak);
+        }
+    }
+
+    WeakStorage(const WeakStorage& other) : block(other.block) {
+        if (block) {
+            ref_acquire(block->weak);
+        }
+    }
+
+    WeakStorage& operator=(WeakStorage other) noexcept {
+        std::swap(block, other.block);
+        return *this;
+    }
+
+    ~WeakStorage() {
+        if (block && ref_release(block->weak)) {
+            block_free(block);
+        }
+    }
+
+    /**
+     * @brief Returns a Storage to the block, or an empty one when the
+     * elements were destroyed.
+     */
+    Storage<T> lock() const {
+        if (block && ref_acquire_live(block->strong)) {
+            return Storage<T>(block);
+        }
+        return Storage<T>();
+    }
+
+private:
+    BlockHeader* block = nullptr;
+};
+
+}   // namespace internal
+
+}   // namespace TL
+
+#endif  // TENSORLIB_STORAGE_H_
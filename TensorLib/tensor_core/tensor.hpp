@@ -6,7 +6,12 @@
 #include "slice.hpp"
 #include "range.hpp"
 #include "utils.hpp"
+#include "storage.hpp"
+#include "nd_loop.hpp"
 
+#include <array>
+#include <cmath>
+#include <functional>
 #include <memory>
 #include <type_traits>
 #include <vector>
@@ -71,14 +76,59 @@ public:
      * @brief Returns the strides of the Tensor. 
      * 
      * Stride of an axis is the number of elements to be moved in the tensor
-     * to move from one axis to other.
+     * to move from one axis to other. Strides are negative along the axes
+     * that a view walks backwards (see TL::Range and Tensor::reverse()).
      * 
-     * @return std::vector<size_t> of size Tensor::ndim()
+     * @return std::vector<long> of size Tensor::ndim()
      */
-    std::vector<size_t> strides() const {
+    std::vector<long> strides() const {
         return desc.stride;
     }
 
+    /**
+     * @brief Returns whether the elements of the Tensor are laid out
+     * contiguously in row major order, i.e. without any gaps in between them.
+     */
+    bool is_contiguous() const;
+
+    /**
+     * @brief Returns the layout the tensor was created with (see
+     * TL::to_layout()). Views keep the layout of their tensor, except views
+     * of a Layout::Blocked one that drop an axis or cut into its channels
+     * or blocks, which are Layout::RowMajor.
+     */
+    Layout layout() const {
+        return desc.layout;
+    }
+
+    /**
+     * @brief Returns the shape of the tensor, or for a Layout::Blocked one,
+     * the shape it represents: (N, C, H, W) for (N, C / 16, H, W, 16).
+     */
+    std::vector<size_t> logical_shape() const {
+        if (desc.layout != Layout::Blocked || ndim() < 3) {
+            return desc.shape;
+        }
+        std::vector<size_t> s(desc.shape.begin(), desc.shape.end() - 1);
+        s[1] = desc.channels;
+        return s;
+    }
+
+    /**
+     * @brief Returns a pointer to the first element of the Tensor. Elements 
+     * of a non contiguous tensor should be reached through Tensor::strides().
+     */
+    T* data_ptr() {
+        return data.data() + desc.start;
+    }
+
+    /**
+     * @brief Constant version of Tensor::data_ptr().
+     */
+    const T* data_ptr() const {
+        return data.data() + desc.start;
+    }
+
     /* ---------- Iterators over the Tensor ---------- */
 
     /**
@@ -128,21 +178,20 @@ public:
      * Constructs a 0 dimensional tensor from an element of tensor type.
      * @param _val The value which will be put in a 0D tensor.
      */
-    Tensor(const T& _val) : data(new std::vector<T>(1, _val)) {}
+    Tensor(const T& _val) : data(internal::Buffer<T>(1, _val)) {}
 
     /**
-     * @brief Constructs tensor from shared_ptr<vector<T>> and TensorDescriptor
-     * @param _data The shared pointer of vector<T> that will be initialized to 
-     * the tensor.
+     * @brief Constructs tensor from a TL::internal::Storage and TensorDescriptor
+     * @param _data The storage of the elements, shared with the tensor.
      * @param _desc @a TL::interal::TensorDescriptor that holds the information 
      * about the tensor like shape and strides.
      */
     Tensor(
-        std::shared_ptr<std::vector<T>> _data,
+        internal::Storage<T> _data,
         const TL::internal::TensorDescriptor& _desc,
         const TL::TensorFormatter& _format
     )
-    : data(_data), desc(_desc), format(_format) {}
+    : data(std::move(_data)), desc(_desc), format(_format) {}
 
     /** 
      * @brief Constructs tensor from vector<T> and shapes. 
@@ -152,18 +201,23 @@ public:
      * @param _shape Shape of the tensor to build.  
      */
     Tensor(const std::vector<T>& _vec, const std::vector<size_t>& _shape, size_t _st = 0)
-    : data(new std::vector<T>(_vec)), desc(_shape, _st) {
+    : data(internal::Buffer<T>(_vec.data(), _vec.size())), desc(_shape, _st) {
         if (size() != _vec.size()) {
             throw std::runtime_error("Number of elements and shapes mismatch");
         }
     }
 
     /**
-     * @brief Move version of the consTensortructor that takes vector and shape. 
-     */
-    Tensor(std::vector<T>&& _vec, const std::vector<size_t>& _shape, size_t _st = 0)
-    : data(new std::vector<T>(_vec)), desc(_shape, _st) {
-        if (size() != _vec.size()) {
+     * @brief Constructs tensor from a TL::internal::Buffer and shapes, taking
+     * the buffer without copying it.
+     *
+     * Only takes a Buffer itself, so that braced lists of elements always
+     * pick the vector constructor.
+     */
+    template <typename B, typename = std::enable_if_t<Is_same<B, internal::Buffer<T>>()>>
+    Tensor(B&& _buf, const std::vector<size_t>& _shape, size_t _st = 0)
+    : data(std::move(_buf)), desc(_shape, _st) {
+        if (size() != data.size()) {
             throw std::runtime_error("Number of elements and shapes mismatch");
         }
     }
@@ -171,11 +225,43 @@ public:
     /**
      * @brief Constructs a tensor with evenly spaced elements withing the given
      * interval and shape of the tensor.
-     * @param _range TL::Range object that takes @a low and @a high. Tensor will 
-     * have elements in range [low, high).
+     * @param _range TL::Range object that takes @a low, @a high and an optional
+     * @a step. Tensor will have the elements of the range, in its order.
      * @param _shape Shape of the tensor to build.
+     *
+     * Only takes a TL::Range itself, so that braced lists of elements always
+     * pick the vector constructors.
+     */
+    template <typename R, typename = std::enable_if_t<Is_same<R, TL::Range>()>>
+    Tensor(R, const std::vector<size_t>&);
+
+    /**
+     * @brief Constructs a tensor over the elements at @a _ptr, laid out with
+     * @a _strides (in elements, possibly negative) from @a _ptr, without
+     * copying them.
+     * @param _deleter Called with @a _ptr once no tensor uses the elements
+     * anymore. When empty, the caller keeps the elements alive instead.
+     * @throw std::runtime_error when @a _shape and @a _strides mismatch; the
+     * elements are then left to the caller.
+     *
+     * Only takes a T* itself, so that a braced list holding a single 0 still
+     * picks the vector constructor.
+     */
+    template <typename P, typename = std::enable_if_t<Is_same<P, T*>()>>
+    Tensor(
+        P _ptr,
+        const std::vector<size_t>& _shape,
+        const std::vector<long>& _strides,
+        std::function<void(T*)> _deleter = nullptr
+    );
+
+    /**
+     * @brief Constructs a tensor over the @a _shape elements at @a _ptr, in
+     * row major order, without copying them.
      */
-    Tensor(TL::Range, const std::vector<size_t>&);
+    template <typename P, typename = std::enable_if_t<Is_same<P, T*>()>>
+    Tensor(P _ptr, const std::vector<size_t>& _shape, std::function<void(T*)> _deleter = nullptr)
+    : Tensor(_ptr, _shape, internal::TensorDescriptor(_shape).stride, std::move(_deleter)) {}
 
     /**
      * @brief Conctructs a new tensor that just refers to the given tensor. No
@@ -186,12 +272,12 @@ public:
 
     /**
      * @brief Assignment operator that increments the reference counter for rhs's and 
-     * decrement for this's (Handled by shared_ptr). 
+     * decrement for this's (Handled by internal::Storage). 
      */
     Tensor& operator=(const Tensor&) = default;
 
     /**
-     * @brief Returns a copy of the tensor.
+     * @brief Returns a contiguous copy of the tensor.
      */
     Tensor copy() const;
 
@@ -215,9 +301,11 @@ public:
     const T& operator()(Dims...) const;
 
     /**
-     * @brief Access tensor from slices.
+     * @brief Access tensor from slices. No copy is made, stepped and reversed
+     * ranges give views with larger or negative strides.
      * @param sl TL::Slice object that takes two params, 1) any type convertible 
-     * to size_t 2) @a TL::Range. @a Range(low,high) access elements as [low, high).
+     * to size_t 2) @a TL::Range. @a Range(low,high) access elements as [low, high),
+     * @a Range(low, high, step) every step-th of them.
      * Any one of the param should be @a Range.
      * @throws @a std::runtime_error when Slice and tensor dimensions mismatch.
      * @throws @a std::out_of_range when Indices passed to slices goes out of range.
@@ -311,6 +399,13 @@ public:
 
     Tensor ravel() const;
 
+    /**
+     * @brief Returns a view of the tensor with the order of the elements
+     * along @a axis reversed. No copy is made.
+     * @throw std::out_of_range when the axis doesn't exist.
+     */
+    Tensor reverse(size_t = 0) const;
+
     /* --------- Printing / Formatting tensor ------------ */
 
     /**
@@ -331,8 +426,13 @@ public:
 private:
     /* Holds the information about the tensor like shape, strides. */
     TL::internal::TensorDescriptor desc;
-    /* Shared pointer to the actual data */
-    std::shared_ptr<std::vector<T>> data;
+    /* Block of the elements, shared with the views of the tensor */
+    internal::Storage<T> data;
+
+    /**
+     * @brief Returns the descriptor of the view selected by the slice.
+     */
+    TL::internal::TensorDescriptor _slice(const Slice&) const;
 };
 
 /**************************************************
@@ -340,19 +440,92 @@ private:
  **************************************************/
 
 template <typename T>
-Tensor<T>::Tensor(Range _range, const std::vector<size_t>& _shape) 
+template <typename R, typename>
+Tensor<T>::Tensor(R _range, const std::vector<size_t>& _shape) 
+: desc(_shape) {
+    internal::Buffer<T> tmp(desc.size());
+    size_t n = std::min(_range.count(), tmp.size());
+    long first = _range.first();
+    for (size_t i = 0; i < n; ++i) {
+        tmp[i] = first + long(i) * _range.step;
+    }
+
+    data = internal::Storage<T>(std::move(tmp));
+}
+
+template <typename T>
+template <typename P, typename>
+Tensor<T>::Tensor(
+    P _ptr,
+    const std::vector<size_t>& _shape,
+    const std::vector<long>& _strides,
+    std::function<void(T*)> _deleter
+)
 : desc(_shape) {
-    std::vector<T> tmp(desc.size());
-    for (size_t i = _range.low; i < _range.high; ++i) {
-        tmp[i] = i;
+    if (_strides.size() != _shape.size()) {
+        throw std::runtime_error("Dimensions Mismatch");
     }
 
-    data = std::make_shared<std::vector<T>>(tmp);
+    /* The block spans the elements reached by the strides, which lie before
+    _ptr along axes of negative strides. */
+    long low = 0, high = 0;
+    for (size_t i = 0; i < _shape.size() && size(); ++i) {
+        long span = long(_shape[i] - 1) * _strides[i];
+        (span < 0 ? low : high) += span;
+    }
+    desc.stride = _strides;
+    desc.start = size_t(-low);
+
+    std::function<void()> release;
+    if (_deleter) {
+        release = [_ptr, _deleter] { _deleter(_ptr); };
+    }
+    size_t count = size() ? size_t(high - low + 1) : 0;
+    data = internal::Storage<T>::external(_ptr + low, count, std::move(release));
+}
+
+template <typename T>
+bool Tensor<T>::is_contiguous() const {
+    long expected = 1;
+    for (long i = ndim() - 1; i >= 0; --i) {
+        /* Strides along an axis of length 1 are never used. */
+        if (desc.shape[i] != 1 && desc.stride[i] != expected) {
+            return false;
+        }
+        expected *= desc.shape[i];
+    }
+    return true;
 }
 
 template <typename T>
 Tensor<T> Tensor<T>::copy() const {
-    Tensor temp(*data, desc.shape, desc.start);
+    internal::Buffer<T> tmp;
+    if (is_contiguous()) {
+        tmp = internal::Buffer<T>(data_ptr(), size());
+    }
+    else {
+        tmp = internal::Buffer<T>(size());
+        std::vector<long> dst_stride = internal::TensorDescriptor(desc.shape).stride;
+        internal::nd_loop<T, 2>(
+            desc.shape, {tmp.data(), const_cast<T*>(data_ptr())}, {&dst_stride, &desc.stride},
+            [] (std::array<T*, 2> p, size_t n, const std::array<long, 2>& s) {
+                if (s[0] == 1 && s[1] == 1) {
+                    std::copy(p[1], p[1] + n, p[0]);
+                    return;
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    p[0][long(i) * s[0]] = p[1][long(i) * s[1]];
+                }
+            }
+        );
+    }
+
+    /* Blocked tensors stay blocked, the others become row major. */
+    Tensor temp(std::move(tmp), desc.shape);
+    if (desc.layout == Layout::Blocked) {
+        temp.desc.layout = Layout::Blocked;
+        temp.desc.channels = desc.channels;
+    }
     temp.format = format;
     return temp;
 }
@@ -362,22 +535,23 @@ Tensor<T> Tensor<T>::copy() const {
 template <typename T>
 template <typename... Dims>
 T& Tensor<T>::operator()(Dims... dims) {
-    return (*data)[desc(dims...)];
+    return data[desc(dims...)];
 }
 
 template <typename T>
 template <typename... Dims>
 const T& Tensor<T>::operator()(Dims... dims) const {
-    return (*data)[desc(dims...)];
+    return data[desc(dims...)];
 }
 
 template <typename T>
-Tensor<T> Tensor<T>::operator()(const Slice& sl) {
+TL::internal::TensorDescriptor Tensor<T>::_slice(const Slice& sl) const {
     if (ndim() != sl.ranges.size()) {
         throw std::runtime_error("Dimensions Mismatch");
     }
 
-    size_t st = 0, _sz = 1;
+    long st = 0;
+    size_t _sz = 1;
 
     TL::internal::TensorDescriptor des(desc);
 
@@ -385,64 +559,50 @@ Tensor<T> Tensor<T>::operator()(const Slice& sl) {
         If a single size_t n is given for a Slice param, then it would be converted
         to Range(n, n+1)
 
-        Start or offset for the new tensor slice would be the product of range's
-        low and its corresponding stride. 
+        Start or offset for the new tensor slice would be the product of the
+        first index of the range and its corresponding stride. That is
+        high - 1 for a negative step, which then walks the axis backwards.
 
-        Shape would be range's high minus low.
+        Shape would be the number of indices in the range and stride the old
+        stride times the step.
     */
     for (size_t i = 0; i < ndim(); ++i) {
-        size_t low = sl.ranges[i].low, high = sl.ranges[i].high;
-        if (low >= high) {
+        const Range& r = sl.ranges[i];
+        if (r.low >= r.high) {
             throw std::runtime_error("`low` range should be lesser than the `high` range");
         }
-        if (high > desc.shape[i]) {
+        if (r.high > desc.shape[i]) {
             throw std::out_of_range("Index out of range");
         }
 
-        st += low * desc.stride[i];
-        des.shape[i] = high - low;
-        _sz *= (high - low);
+        st += long(r.first()) * desc.stride[i];
+        des.shape[i] = r.count();
+        des.stride[i] = desc.stride[i] * r.step;
+        _sz *= des.shape[i];
 
-        if (sl.ranges[i].single()) {
+        if (r.single()) {
             des.stride[i] = 0;
         }
+        /* Part of the channels or of the blocks of a blocked tensor. */
+        bool whole = r.step == 1 && des.shape[i] == desc.shape[i];
+        if (desc.layout == Layout::Blocked && (i == 1 || i == ndim() - 1) && !whole) {
+            des._reset_layout();
+        }
     }
 
     des.start += st;
     des.sz = _sz;
-    return Tensor(data, des, format);
+    return des;
 }
 
 template <typename T>
-const Tensor<T> Tensor<T>::operator()(const Slice& sl) const {
-    if (ndim() != sl.ranges.size()) {
-        throw std::runtime_error("Dimensions Mismatch");
-    }
-
-    size_t st = 0, _sz = 1;
-
-    TL::internal::TensorDescriptor des(desc);
-    for (size_t i = 0; i < ndim(); ++i) {
-        size_t low = sl.ranges[i].low, high = sl.ranges[i].high;
-        if (low >= high) {
-            throw std::runtime_error("`low` range should be lesser than the `high` range");
-        }
-        if (high > desc.shape[i]) {
-            throw std::out_of_range("Index out of range");
-        }
-
-        st += low * desc.stride[i];
-        des.shape[i] = high - low;
-        _sz *= (high - low);
-
-        if (sl.ranges[i].single()) {
-            des.stride[i] = 0;
-        }
-    }
+Tensor<T> Tensor<T>::operator()(const Slice& sl) {
+    return Tensor(data, _slice(sl), format);
+}
 
-    des.start += st;
-    des.sz = _sz;
-    return Tensor(data, des, format);
+template <typename T>
+const Tensor<T> Tensor<T>::operator()(const Slice& sl) const {
+    return Tensor(data, _slice(sl), format);
 }
 
 template <typename T>
@@ -452,12 +612,17 @@ Tensor<T> Tensor<T>::operator[](size_t idx) {
     }
 
     if (ndim() == 1) {
-        return Tensor((*data)[0]);
+        return Tensor(data[desc.start + desc.stride[0] * long(idx)]);
     }
 
-    std::vector<size_t> sh (ndim() - 1);
-    std::copy(desc.shape.begin() + 1, desc.shape.end(), sh.begin());
-    TL::internal::TensorDescriptor tdesc(sh, desc.stride[0] * idx);
+    /* A view on the rest of the axes, starting at the idx-th entry. */
+    TL::internal::TensorDescriptor tdesc(desc);
+    tdesc.start += desc.stride[0] * long(idx);
+    tdesc.shape.erase(tdesc.shape.begin());
+    tdesc.stride.erase(tdesc.stride.begin());
+    tdesc.n_dim -= 1;
+    tdesc.sz /= desc.shape[0];
+    tdesc._reset_layout();
     return Tensor(data, tdesc, format);
 }
 
@@ -468,12 +633,17 @@ const Tensor<T> Tensor<T>::operator[](size_t idx) const {
     }
 
     if (ndim() == 1) {
-        return Tensor((*data)[0]);
+        return Tensor(data[desc.start + desc.stride[0] * long(idx)]);
     }
 
-    std::vector<size_t> sh (ndim() - 1);
-    std::copy(desc.shape.begin() + 1, desc.shape.end(), sh.begin());
-    TL::internal::TensorDescriptor tdesc(sh, desc.stride[0] * idx);
+    /* A view on the rest of the axes, starting at the idx-th entry. */
+    TL::internal::TensorDescriptor tdesc(desc);
+    tdesc.start += desc.stride[0] * long(idx);
+    tdesc.shape.erase(tdesc.shape.begin());
+    tdesc.stride.erase(tdesc.stride.begin());
+    tdesc.n_dim -= 1;
+    tdesc.sz /= desc.shape[0];
+    tdesc._reset_layout();
     return Tensor(data, tdesc, format);
 }
 
@@ -516,10 +686,21 @@ auto Tensor<T>::cend() const -> const_iterator {
 template <typename T>
 template <typename F>
 Tensor<T>& Tensor<T>::_apply(F func) {
-    /* Room for optimization */
-    for (auto& x : *data) {
-        func(x);
-    }
+    /* Only the elements of the view, the buffer may be shared with others. */
+    internal::nd_loop<T, 1>(
+        desc.shape, {data_ptr()}, {&desc.stride},
+        [&] (std::array<T*, 1> p, size_t n, const std::array<long, 1>& s) {
+            if (s[0] == 1) {
+                for (size_t i = 0; i < n; ++i) {
+                    func(p[0][i]);
+                }
+                return;
+            }
+            for (size_t i = 0; i < n; ++i) {
+                func(p[0][long(i) * s[0]]);
+            }
+        }
+    );
     return *this;
 }
 
@@ -530,11 +711,20 @@ Tensor<T>& Tensor<T>::_apply(const Tensor<T>& tensor, F func) {
         throw std::runtime_error("Dimensions Mismatch");
     }
 
-    auto i = begin();
-    auto j = tensor.begin();
-    for (; i != end(); ++i, ++j) {
-        func(*i, *j);
-    }
+    internal::nd_loop<T, 2>(
+        desc.shape, {data_ptr(), const_cast<T*>(tensor.data_ptr())}, {&desc.stride, &tensor.desc.stride},
+        [&] (std::array<T*, 2> p, size_t n, const std::array<long, 2>& s) {
+            if (s[0] == 1 && s[1] == 1) {
+                for (size_t i = 0; i < n; ++i) {
+                    func(p[0][i], p[1][i]);
+                }
+                return;
+            }
+            for (size_t i = 0; i < n; ++i) {
+                func(p[0][long(i) * s[0]], p[1][long(i) * s[1]]);
+            }
+        }
+    );
     return *this;
 }
 
@@ -567,7 +757,14 @@ Tensor<T>& Tensor<T>::operator/=(const T& val) {
 
 template <typename T>
 Tensor<T>& Tensor<T>::operator%=(const T& val) {
-    return _apply([&] (T& elem) {elem %= val;});
+    return _apply([&] (T& elem) {
+        if constexpr (std::is_floating_point<T>::value) {
+            elem = std::fmod(elem, val);
+        }
+        else {
+            elem %= val;
+        }
+    });
 }
 
 /* ----------- Tensor Operations -------------- */
@@ -594,7 +791,14 @@ Tensor<T>& Tensor<T>::operator/=(const Tensor<T>& tensor) {
 
 template <typename T>
 Tensor<T>& Tensor<T>::operator%=(const Tensor<T>& tensor) {
-    return _apply(tensor, [] (T& t1, const T& t2) { t1 %= t2; });
+    return _apply(tensor, [] (T& t1, const T& t2) {
+        if constexpr (std::is_floating_point<T>::value) {
+            t1 = std::fmod(t1, t2);
+        }
+        else {
+            t1 %= t2;
+        }
+    });
 }
 
 /* -------- Binary Operations with a scalar ------------- */
@@ -678,12 +882,11 @@ std::enable_if_t<
     All(Is_convertible<Dims, size_t>()...),
 Tensor<T>> Tensor<T>::reshape(Dims... dims) const {
     std::vector<size_t> _shape { size_t(dims)... };
-    return Tensor(*data, _shape, desc.start);
+    return Tensor(copy().data.take(), _shape);
 }
 
 template <typename T>
 Tensor<T> Tensor<T>::squeeze(long axis) const {
-    Tensor temp = copy();
     // Squeeze out all possible dimensions
     if (axis == -1) {
         std::vector<size_t> _shape;
@@ -693,7 +896,7 @@ Tensor<T> Tensor<T>::squeeze(long axis) const {
             }
         }
 
-        return Tensor(*data, _shape, desc.start);
+        return Tensor(copy().data.take(), _shape);
     }
 
     else {
@@ -707,7 +910,7 @@ Tensor<T> Tensor<T>::squeeze(long axis) const {
         
         auto _shape = shape();
         _shape.erase(_shape.begin() + axis);
-        return Tensor(*data, _shape, desc.start);
+        return Tensor(copy().data.take(), _shape);
     }
 }
 
@@ -719,13 +922,31 @@ Tensor<T> Tensor<T>::expand_dims(size_t axis) const {
 
     auto _shape = shape();
     _shape.insert(_shape.begin() + axis, 1);
-    return Tensor(*data, _shape, desc.start);
+    return Tensor(copy().data.take(), _shape);
 }
 
 template <typename T>
 Tensor<T> Tensor<T>::ravel() const {
     std::vector<size_t> _shape = {size()};
-    return Tensor(*data, _shape, desc.start);
+    return Tensor(copy().data.take(), _shape);
+}
+
+template <typename T>
+Tensor<T> Tensor<T>::reverse(size_t axis) const {
+    if (axis >= ndim()) {
+        throw std::out_of_range("Axis out of bound for reverse");
+    }
+
+    /* Start from the last entry along the axis and walk backwards. */
+    TL::internal::TensorDescriptor des(desc);
+    if (desc.shape[axis]) {
+        des.start += long(desc.shape[axis] - 1) * desc.stride[axis];
+    }
+    des.stride[axis] = -desc.stride[axis];
+    if (axis == 1 || axis == ndim() - 1) {
+        des._reset_layout();
+    }
+    return Tensor(data, des, format);
 }
 
 }   // namespace TL
@@ -745,7 +966,7 @@ void Tensor<T>::print(std::ostream& out) const {
 template <typename T>
 std::ostream& operator<<(std::ostream& out, const Tensor<T>& tensor) {
     if (!tensor.ndim()) {
-        return out << (*tensor.data)[0] << "\n";
+        return out << tensor.data[0] << "\n";
     }
 
     tensor.print(out);
@@ -13,6 +13,22 @@ namespace TL {
 template <typename T>
 class TensorIterator;
 
+/**
+ * @brief Arrangement of the elements of a tensor in memory.
+ */
+enum class Layout {
+    /* C order, the last axis contiguous. */
+    RowMajor,
+    /* Fortran order, the first axis contiguous. */
+    ColumnMajor,
+    /* Axis 1 contiguous, then the last axes: NHWC for an NCHW tensor. */
+    ChannelsLast,
+    /* Axis 1 split into blocks of channels stored innermost, e.g. NCHW16c.
+    The tensor has the physical shape (N, C / block, H, W, block), with C
+    padded by zeros to a multiple of the block. */
+    Blocked
+};
+
 template <typename T>
 class Tensor;
 
@@ -43,6 +59,40 @@ public:
      */
     TensorDescriptor(const std::vector<size_t>&, size_t = 0);
 
+    /**
+     * @brief Constructs the descriptor of a tensor of shape @a _shape with
+     * the strides of @a _layout. For Layout::Blocked, @a _shape is the
+     * physical shape, whose elements are in row major order, and
+     * @a _channels the number of channels without the padding.
+     */
+    TensorDescriptor(const std::vector<size_t>& _shape, Layout _layout, size_t _channels = 0)
+    : TensorDescriptor(_shape) {
+        layout = _layout;
+        channels = _channels;
+        if (ndim() < 2 || _layout == Layout::RowMajor || _layout == Layout::Blocked) {
+            return;
+        }
+        /* Axes from the innermost. */
+        std::vector<size_t> order;
+        if (_layout == Layout::ColumnMajor) {
+            for (size_t i = 0; i < ndim(); ++i) {
+                order.push_back(i);
+            }
+        }
+        else {
+            order.push_back(1);
+            for (size_t i = ndim() - 1; i >= 2; --i) {
+                order.push_back(i);
+            }
+            order.push_back(0);
+        }
+        long st = 1;
+        for (size_t i : order) {
+            stride[i] = st;
+            st *= long(shape[i]);
+        }
+    }
+
     /** 
      * @brief Constructs from shapes only.
      * @param dims... The shape of the Tensor along each dimension.
@@ -80,12 +130,23 @@ public:
         return n_dim;
     }
 
+    /**
+     * @brief Returns the strides along each dimension, in elements.
+     */
+    const std::vector<long>& strides() const {
+        return stride;
+    }
+
 private:
     size_t sz;
     size_t n_dim;
     size_t start = 0;   /* offset for subtensors */
+    Layout layout = Layout::RowMajor;
+    /* Channels of a Layout::Blocked tensor, without the padding. */
+    size_t channels = 0;
     std::vector<size_t> shape;
-    std::vector<size_t> stride;
+    /* Signed, so that views can walk an axis backwards. */
+    std::vector<long> stride;
     
     /**
      * @brief A utility function that calculates and updates the stride information
@@ -93,6 +154,15 @@ private:
      */
     void _calculate_stride();
 
+    /**
+     * @brief Makes the descriptor Layout::RowMajor, for views that no longer
+     * hold whole blocks of channels of a Layout::Blocked tensor.
+     */
+    void _reset_layout() {
+        layout = Layout::RowMajor;
+        channels = 0;
+    }
+
     /** @brief A utility function that checks whether the given indices are within the
     * shape bounds. 
     * @param dims... Indices along each dimension.
@@ -106,7 +176,7 @@ private:
             TensorDescriptor definition 
  **************************************************/
 
-void TensorDescriptor::_calculate_stride() {
+inline void TensorDescriptor::_calculate_stride() {
     /* Logic:
         The strides of a N-dimensional tensor of shape (s_0, s_1, ..., s_n-1) and
         strides (t_0, t_1, ..., t_n-2, t_n-1) have the value of 
@@ -118,13 +188,16 @@ void TensorDescriptor::_calculate_stride() {
         .
         t_n-i = t_n-i-1 * s_n-i-1
     */
+    if (!ndim()) {
+        return;
+    }
     stride[ndim() - 1] = 1;
     for (long i = ndim()-2; i >= 0; --i) {
-        stride[i] = stride[i+1] * shape[i+1]; 
+        stride[i] = stride[i+1] * long(shape[i+1]); 
     }
 }
 
-TensorDescriptor::TensorDescriptor(
+inline TensorDescriptor::TensorDescriptor(
     const std::vector<size_t>& _shape, size_t _st
 ) 
 : shape(_shape), stride(_shape.size(), 1), start(_st), n_dim(_shape.size()) {
@@ -171,11 +244,11 @@ size_t> TensorDescriptor::operator()(Dims... dims) const {
         throw std::out_of_range("Index out of range");
     }
 
-    std::vector<size_t> indices { size_t(dims)... };
+    std::vector<long> indices { long(dims)... };
     /* Index in the flat vector is just inner product of strides and given indices
     plus the start. */
     return start + std::inner_product(
-        indices.begin(), indices.end(), stride.begin(), size_t(0)
+        indices.begin(), indices.end(), stride.begin(), long(0)
     );
 }
 
@@ -0,0 +1,157 @@
+#ifndef TENSORLIB_TENSOR_IO_H_
+#define TENSORLIB_TENSOR_IO_H_
+
+#include "tensor.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/*
+ * Tensor files hold a header followed by the elements in row major order,
+ * in the byte order of the machine:
+ *
+ *     "TLTN"              4 bytes   magic
+ *     kind                1 byte    'f' floating point, 'i' signed, 'u' unsigned
+ *     element size        1 byte
+ *     reserved            2 bytes
+ *     ndim                uint32
+ *     shape               ndim x uint64
+ *     elements
+ */
+
+constexpr char tensor_file_magic[4] = {'T', 'L', 'T', 'N'};
+
+template <typename T>
+constexpr char dtype_kind() {
+    static_assert(std::is_arithmetic<T>::value, "Tensor files hold arithmetic types");
+    return std::is_floating_point<T>::value ? 'f' : std::is_signed<T>::value ? 'i' : 'u';
+}
+
+/**
+ * @brief Header of a tensor file.
+ */
+struct TensorFileHeader
+{
+    char kind;
+    uint8_t elem_size;
+    std::vector<size_t> shape;
+    /* Position of the first element in the file. */
+    size_t data_offset;
+
+    size_t size() const {
+        return std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+    }
+
+    /**
+     * @brief Reads the header at the beginning of @a in.
+     * @throw std::runtime_error when it isn't a tensor file.
+     */
+    static TensorFileHeader read(std::istream& in) {
+        char magic[4];
+        uint8_t kind_size[4];
+        uint32_t ndim;
+        in.read(magic, 4);
+        in.read(reinterpret_cast<char*>(kind_size), 4);
+        in.read(reinterpret_cast<char*>(&ndim), sizeof(ndim));
+        if (!in || std::memcmp(magic, tensor_file_magic, 4)) {
+            throw std::runtime_error("Not a tensor file");
+        }
+
+        TensorFileHeader h;
+        h.kind = char(kind_size[0]);
+        h.elem_size = kind_size[1];
+        for (uint32_t d = 0; d < ndim; ++d) {
+            uint64_t s;
+            in.read(reinterpret_cast<char*>(&s), sizeof(s));
+            h.shape.push_back(size_t(s));
+        }
+        if (!in) {
+            throw std::runtime_error("Not a tensor file");
+        }
+        h.data_offset = 12 + 8 * size_t(ndim);
+        return h;
+    }
+
+    /**
+     * @brief Checks that the elements of the file are of type T.
+     * @throw std::runtime_error when they aren't.
+     */
+    template <typename T>
+    void check_type() const {
+        if (kind != dtype_kind<T>() || elem_size != sizeof(T)) {
+            throw std::runtime_error("Type of the tensor file mismatch");
+        }
+    }
+};
+
+}   // namespace internal
+
+/**************************************************
+                Tensor files
+ **************************************************/
+
+/**
+ * @brief Writes the tensor to the file @a path.
+ * @throw std::runtime_error when the file cannot be written.
+ */
+template <typename T>
+void save(const std::string& path, const Tensor<T>& x) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    uint8_t kind_size[4] = {uint8_t(internal::dtype_kind<T>()), uint8_t(sizeof(T)), 0, 0};
+    uint32_t ndim = uint32_t(x.ndim());
+    out.write(internal::tensor_file_magic, 4);
+    out.write(reinterpret_cast<const char*>(kind_size), 4);
+    out.write(reinterpret_cast<const char*>(&ndim), sizeof(ndim));
+    for (auto s : x.shape()) {
+        uint64_t d = s;
+        out.write(reinterpret_cast<const char*>(&d), sizeof(d));
+    }
+
+    auto c = x.is_contiguous() ? x : x.copy();
+    out.write(reinterpret_cast<const char*>(c.data_ptr()), std::streamsize(c.size() * sizeof(T)));
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+/**
+ * @brief Reads the tensor saved in the file @a path.
+ * @throw std::runtime_error when the file cannot be read or doesn't hold
+ * elements of type T.
+ */
+template <typename T>
+Tensor<T> load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    auto h = internal::TensorFileHeader::read(in);
+    h.check_type<T>();
+
+    internal::Buffer<T> buf(h.size());
+    in.read(reinterpret_cast<char*>(buf.data()), std::streamsize(buf.size() * sizeof(T)));
+    if (!in) {
+        throw std::runtime_error("Unexpected end of tensor file");
+    }
+    if (h.shape.empty()) {
+        return Tensor<T>(buf[0]);
+    }
+    return Tensor<T>(std::move(buf), h.shape);
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_TENSOR_IO_H_
@@ -75,16 +75,16 @@ public:
     bool operator!=(const TensorIterator&) const;
 
 private:
-    std::weak_ptr<std::vector<T>> data;
+    internal::WeakStorage<T> data;
     TL::internal::TensorDescriptor desc;
     size_t offset;
 
     /**
      * @brief Check whether the iterator is bounded to a tensor. If its bounded
-     * return a shared pointer to the location.
+     * return a storage handle keeping the elements alive.
      * @throw std::runtime_error When the iterator is not bounded to a tensor.
      */
-    std::shared_ptr<std::vector<T>> _check() const;
+    internal::Storage<T> _check() const;
 };
 
 /**************************************************
@@ -93,9 +93,9 @@ private:
 
 template <typename T>
 template <bool Const>
-std::shared_ptr<std::vector<T>> Tensor<T>::TensorIterator<Const>::_check() const {
+internal::Storage<T> Tensor<T>::TensorIterator<Const>::_check() const {
     auto ptr = data.lock();
-    if (!ptr) {
+    if (!ptr.data()) {
         throw std::runtime_error("Unbounded Iterator");
     }
 
@@ -190,7 +190,8 @@ std::enable_if_t<!Q, T&>
 Tensor<T>::TensorIterator<Const>::operator*() {
     auto ret = _check();
     
-    size_t x = 1, idx = 0;
+    size_t x = 1;
+    long idx = 0;
     for (int i = desc.ndim()-1; i >= 0; --i) {
         /* Logic:
             There are total of x elements in the sliced tensor to move from one 
@@ -200,13 +201,13 @@ Tensor<T>::TensorIterator<Const>::operator*() {
             shape.
 
             Had to move desc.stride[i] elements once the correct position in the
-            sliced tensor is known.
+            sliced tensor is known, backwards when the stride is negative.
          */
-        idx += ((offset / x) % desc.shape[i]) * desc.stride[i];
+        idx += long((offset / x) % desc.shape[i]) * desc.stride[i];
         x *= desc.shape[i]; 
     }
 
-    return (*ret)[desc.start + idx];
+    return ret[desc.start + idx];
 }
 
 template <typename T>
@@ -216,13 +217,14 @@ std::enable_if_t<Q, const T&>
 Tensor<T>::TensorIterator<Const>::operator*() const {
     auto ret = _check();
     
-    size_t x = 1, idx = 0;
+    size_t x = 1;
+    long idx = 0;
     for (int i = desc.ndim()-1; i >= 0; --i) {
-        idx += ((offset / x) % desc.shape[i]) * desc.stride[i];
+        idx += long((offset / x) % desc.shape[i]) * desc.stride[i];
         x *= desc.shape[i]; 
     }
 
-    return (*ret)[desc.start + idx];
+    return ret[desc.start + idx];
 }
 
 template <typename T>
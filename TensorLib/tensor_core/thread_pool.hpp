@@ -0,0 +1,255 @@
+#ifndef TENSORLIB_THREAD_POOL_H_
+#define TENSORLIB_THREAD_POOL_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TL {
+
+namespace internal {
+
+/**************************************************
+              ThreadPool declaration
+ **************************************************/
+
+/**
+ * @brief A pool of worker threads shared by all the parallel kernels in the
+ * library.
+ *
+ * Work given through @a parallel_for is statically partitioned: chunk @a k of
+ * a range always goes to worker @a k (chunk 0 runs on the calling thread), so
+ * two loops over the same range touch the same elements from the same threads.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @brief Returns the process wide pool. Number of threads defaults to
+     * std::thread::hardware_concurrency() and can be overridden by the
+     * @a TL_NUM_THREADS environment variable.
+     */
+    static ThreadPool& instance();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        _stop_workers();
+    }
+
+    /**
+     * @brief Returns the number of threads that takes part in a parallel loop,
+     * including the calling thread.
+     */
+    size_t size() const {
+        return workers.size() + 1;
+    }
+
+    /**
+     * @brief Stops the current workers and spawns @a n - 1 new ones. Shouldn't
+     * be called while some work is running on the pool.
+     */
+    void resize(size_t);
+
+    /**
+     * @brief Splits [0, n) into at most size() contiguous chunks of at least
+     * @a grain elements and calls @a func(begin, end) on each of them in parallel.
+     * Runs serially when called from inside another parallel region.
+     * @throw Rethrows the first exception thrown by any of the chunks.
+     */
+    template <typename F>
+    void parallel_for(size_t, size_t, F&&);
+
+    /**
+     * @brief Enqueues a task to be run by any of the workers. Runs the task
+     * in the calling thread when the pool has no workers.
+     */
+    void submit(std::function<void()>);
+
+    /**
+     * @brief Returns whether the calling thread is a worker of the pool or is
+     * currently running a parallel region.
+     */
+    static bool in_parallel() {
+        return _depth() > 0;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    /* Per worker queues for statically partitioned chunks. */
+    std::vector<std::deque<std::function<void()>>> local;
+    /* Queue for the tasks that any worker can pick. */
+    std::deque<std::function<void()>> shared;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stop = false;
+
+    explicit ThreadPool(size_t _n) {
+        resize(_n);
+    }
+
+    static int& _depth() {
+        thread_local int depth = 0;
+        return depth;
+    }
+
+    void _worker_loop(size_t);
+    void _stop_workers();
+};
+
+/**************************************************
+              ThreadPool definition
+ **************************************************/
+
+inline ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool([] {
+        const char* env = std::getenv("TL_NUM_THREADS");
+        long n = env ? std::atol(env) : 0;
+        if (n <= 0) {
+            n = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return static_cast<size_t>(n);
+    }());
+    return pool;
+}
+
+inline void ThreadPool::resize(size_t n) {
+    _stop_workers();
+
+    n = std::max<size_t>(n, 1);
+    stop = false;
+    local.assign(n - 1, {});
+    for (size_t i = 0; i + 1 < n; ++i) {
+        workers.emplace_back(&ThreadPool::_worker_loop, this, i);
+    }
+}
+
+inline void ThreadPool::_stop_workers() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+    workers.clear();
+}
+
+inline void ThreadPool::_worker_loop(size_t id) {
+    /* Workers are always inside a parallel region, so that the loops started
+    from a task runs serially instead of waiting on the other workers. */
+    ++_depth();
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] {
+                return stop || !local[id].empty() || !shared.empty();
+            });
+            if (!local[id].empty()) {
+                task = std::move(local[id].front());
+                local[id].pop_front();
+            }
+            else if (!shared.empty()) {
+                task = std::move(shared.front());
+                shared.pop_front();
+            }
+            else {
+                return;
+            }
+        }
+        task();
+    }
+}
+
+inline void ThreadPool::submit(std::function<void()> task) {
+    if (workers.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        shared.push_back(std::move(task));
+    }
+    cv.notify_one();
+}
+
+template <typename F>
+void ThreadPool::parallel_for(size_t n, size_t grain, F&& func) {
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = std::min(size(), (n + grain - 1) / grain);
+    if (chunks <= 1 || in_parallel()) {
+        if (n) {
+            func(size_t(0), n);
+        }
+        return;
+    }
+
+    std::mutex done_mtx;
+    std::condition_variable done_cv;
+    size_t remaining = chunks - 1;
+    std::exception_ptr error;
+
+    auto run = [&] (size_t k) {
+        try {
+            func(n * k / chunks, n * (k + 1) / chunks);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(done_mtx);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (size_t k = 1; k < chunks; ++k) {
+            local[k - 1].push_back([&, k] {
+                run(k);
+                std::lock_guard<std::mutex> lock(done_mtx);
+                if (--remaining == 0) {
+                    done_cv.notify_one();
+                }
+            });
+        }
+    }
+    cv.notify_all();
+
+    ++_depth();
+    run(0);
+    --_depth();
+
+    std::unique_lock<std::mutex> lock(done_mtx);
+    done_cv.wait(lock, [&] { return remaining == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}   // namespace internal
+
+/**
+ * @brief Sets the number of threads used by the parallel kernels.
+ */
+inline void set_num_threads(size_t n) {
+    internal::ThreadPool::instance().resize(n);
+}
+
+/**
+ * @brief Returns the number of threads used by the parallel kernels.
+ */
+inline size_t get_num_threads() {
+    return internal::ThreadPool::instance().size();
+}
+
+}   // namespace TL
+
+#endif  // TENSORLIB_THREAD_POOL_H_
@@ -2,6 +2,7 @@
 #define TENSORLIB_TENSOR_UTILS_H_
 
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 #include <type_traits>
 
@@ -76,6 +77,42 @@ std::ostream& operator<<(std::ostream& out, const std::vector<T>& vec) {
     return out << "\b\b]";
 }
 
+namespace internal {
+
+/**
+ * @brief Returns @a axis as an index into the shape, negative values counting
+ * from the last axis.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+inline size_t normalize_axis(long axis, size_t ndim) {
+    long nd = ndim;
+    if (axis < -nd || axis >= nd) {
+        throw std::out_of_range("Axis out of bound");
+    }
+    return axis < 0 ? axis + nd : axis;
+}
+
+/**
+ * @brief Splits @a shape around @a axis (negative counts from the end) into
+ * the number of rows before it, its length and the distance between two of
+ * its elements.
+ * @throw std::out_of_range when the axis doesn't exist.
+ */
+inline void split_axis(const std::vector<size_t>& shape, long axis,
+                       size_t& outer, size_t& n, size_t& inner) {
+    size_t a = normalize_axis(axis, shape.size());
+    outer = inner = 1;
+    for (size_t i = 0; i < a; ++i) {
+        outer *= shape[i];
+    }
+    for (size_t i = a + 1; i < shape.size(); ++i) {
+        inner *= shape[i];
+    }
+    n = shape[a];
+}
+
+}   // namespace internal
+
 }   // namespace TL
 
 #endif  // TENSORLIB_TENSOR_UTILS_H_
\ No newline at end of file
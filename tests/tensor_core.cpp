@@ -1,9 +1,19 @@
 #include <vector>
 #include <iostream>
 #include <cassert>
+#include <cmath>
+#include <sstream>
+#include <fstream>
+#include <thread>
 
 #include "TensorLib/tensor_core.hpp"
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 using R = TL::Range;
@@ -178,6 +188,1180 @@ void test_reshape_squeeze()
     assert(E.ndim() == 1);
 }
 
+void test_step_slicing()
+{
+    TL::Tensor<int> A(R(24), {4, 6});
+
+    // Every other column, rows backwards
+    auto B = A(Slice(R(0, 4, -1), R(1, 6, 2)));
+    assert(B.shape() == vector<size_t>({4, 3}) && !B.is_contiguous());
+    assert(B.strides() == vector<long>({-6, 2}));
+    assert(B(0, 0) == 19 && B(0, 2) == 23 && B(3, 1) == 3);
+    auto C = B.copy();
+    assert(C.is_contiguous() && C(1, 1) == 15 && C(3, 0) == 1);
+
+    // Writes and _apply go through the view only
+    B += 100;
+    assert(A(0, 1) == 101 && A(0, 0) == 0 && A(3, 5) == 123);
+    B -= 100;
+
+    // Slicing a view, operator[] and printing follow the strides
+    auto D = B(Slice(R(1, 4, 2), R(0, 3, -1)));
+    assert(D.shape() == vector<size_t>({2, 3}) && D(0, 0) == 17 && D(1, 2) == 1);
+    assert(B[1](2) == 17 && B[3].shape() == vector<size_t>({3}));
+    std::stringstream ss;
+    ss << A(Slice(1, R(0, 6, -3)));
+    assert(ss.str() == "[[11,  8]]\n");
+
+    // reverse() is a view on the same buffer
+    auto E = A.reverse(1);
+    assert(E(0, 0) == 5 && E(3, 5) == 18);
+    E(0, 0) = -1;
+    assert(A(0, 5) == -1);
+    assert(TL::Tensor<int>(R(0, 10, -3), {4})(1) == 6);
+}
+
+void test_lazy()
+{
+    TL::Tensor<int> A(R(12), {3, 4});
+    TL::Tensor<int> B({2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2}, {3, 4});
+    auto a = TL::lazy(A), b = TL::lazy(B);
+
+    // Common subexpressions and commuted operands are computed once.
+    auto x = (a + b) * (b + a) - a % 5;
+    auto X = x.eval();
+    auto expected = ((A + B) * (A + B)) - (A % 5);
+    assert(X.shape() == expected.shape());
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 4; ++j) {
+            assert(X(i, j) == expected(i, j));
+        }
+    }
+
+    // The same graph built by hand, to look at the compiled program.
+    using Node = TL::internal::LazyNode<int>;
+    using TL::internal::LazyOp;
+    auto leaf = [] (const TL::Tensor<int>& t) {
+        auto n = std::make_shared<Node>();
+        n->op = LazyOp::Leaf;
+        n->shape = t.shape();
+        n->leaf = std::make_shared<const TL::Tensor<int>>(t);
+        return std::shared_ptr<const Node>(n);
+    };
+    auto node = [] (LazyOp op, std::shared_ptr<const Node> l, std::shared_ptr<const Node> r) {
+        auto n = std::make_shared<Node>();
+        n->op = op;
+        n->shape = l->shape;
+        n->inputs = {l};
+        if (r) {
+            n->inputs.push_back(r);
+        }
+        else {
+            n->scalar_rhs = true;
+            n->value = 5;
+        }
+        return std::shared_ptr<const Node>(n);
+    };
+    auto la = leaf(A), lb = leaf(B);
+    auto graph = node(LazyOp::Sub,
+                      node(LazyOp::Mul, node(LazyOp::Add, la, lb), node(LazyOp::Add, lb, la)),
+                      node(LazyOp::Mod, la, nullptr));
+    TL::internal::LazyProgram<int> program({graph});
+    // a, b, a + b once, its square, a % 5 and the difference, in 2 blocks.
+    assert(program.num_instructions() == 6);
+    assert(program.num_slots() == 2);
+    assert(program.run()[0](2, 3) == expected(2, 3));
+
+    // Non contiguous leaves and several outputs evaluated together.
+    TL::Tensor<double> C(R(60), {3, 4, 5});
+    auto sl = C(Slice(R(1, 3), R(3), 2));
+    auto c = TL::lazy(sl);
+    auto outs = TL::eval(std::vector<TL::LazyTensor<double>>{c * 2.0, -c + 1.0});
+    assert(outs[0](1, 2, 0) == sl(1, 2, 0) * 2.0);
+    assert(outs[1](0, 1, 0) == 1.0 - sl(0, 1, 0));
+}
+
+void test_async()
+{
+    TL::Tensor<int> A(R(6), {2, 3});
+    TL::AsyncTensor<int> a(A);
+
+    // Chained operations run on the thread pool without blocking here.
+    auto b = (a * 2 + a).copy();
+    auto c = TL::async([] (TL::Tensor<int> x, TL::Tensor<int> y) {
+        return x - y;
+    }, b, a);
+    auto C = c.get();
+    assert(c.ready());
+    assert(C(1, 2) == 10);
+
+    // Errors are propagated to the dependent operations.
+    TL::AsyncTensor<int> bad = a + TL::Tensor<int>(R(4), {2, 2});
+    auto worse = bad * 2;
+    try {
+        worse.get();
+        assert(false);
+    } catch (std::runtime_error& e) {}
+}
+
+void test_sparse()
+{
+    TL::Tensor<int> A({0, 2, 0, 0, 0, 0, 1, 0, 3, 0, 0, 4}, {3, 2, 2});
+    TL::SparseTensor<int> csr(A);
+    assert(csr.nnz() == 4);
+    assert(csr.indptr() == vector<size_t>({0, 1, 2, 4}));
+
+    // Conversions both ways
+    auto coo = csr.to_format(TL::SparseFormat::COO);
+    assert(coo.indices() == vector<size_t>({0, 0, 1, 1, 1, 0, 2, 0, 0, 2, 1, 1}));
+    auto back = coo.to_format(TL::SparseFormat::CSR).to_dense();
+    for (size_t i = 0; i < A.size(); ++i) {
+        assert(*(back.begin() + i) == *(A.begin() + i));
+    }
+
+    // Slicing on the leading axis
+    auto rows = coo.slice(R(1, 3)).to_dense();
+    assert(rows.shape() == vector<size_t>({2, 2, 2}));
+    assert(rows(0, 1, 0) == 1 && rows(1, 0, 0) == 3);
+
+    // SpMV and SpMM, duplicate coordinates are summed up
+    TL::SparseTensor<int> S({2, 3}, {1, 2, 0, 0, 1, 2}, {5, 7, 1});
+    TL::Tensor<int> v({1, 2, 3}, {3});
+    auto Sv = TL::matmul(S, v);
+    assert(Sv(0) == 7 && Sv(1) == 18);
+
+    auto SM = TL::matmul(S, TL::Tensor<int>(R(6), {3, 2}));
+    assert(SM.shape() == vector<size_t>({2, 2}));
+    assert(SM(0, 1) == 7 && SM(1, 0) == 24);
+}
+
+// Naive convolution used as reference for TL::conv2d
+TL::Tensor<double> conv2d_reference(
+    const TL::Tensor<double>& x, const TL::Tensor<double>& w,
+    size_t s, size_t p, size_t d, size_t g)
+{
+    auto xs = x.shape(), ws = w.shape();
+    size_t OH = (xs[2] + 2 * p - d * (ws[2] - 1) - 1) / s + 1;
+    size_t OW = (xs[3] + 2 * p - d * (ws[3] - 1) - 1) / s + 1;
+    size_t cg = xs[1] / g, kg = ws[0] / g;
+    TL::Tensor<double> out(vector<double>(xs[0] * ws[0] * OH * OW), {xs[0], ws[0], OH, OW});
+    for (size_t n = 0; n < xs[0]; ++n)
+    for (size_t k = 0; k < ws[0]; ++k)
+    for (size_t oy = 0; oy < OH; ++oy)
+    for (size_t ox = 0; ox < OW; ++ox) {
+        double acc = 0;
+        for (size_t c = 0; c < cg; ++c)
+        for (size_t ky = 0; ky < ws[2]; ++ky)
+        for (size_t kx = 0; kx < ws[3]; ++kx) {
+            long iy = long(oy * s + ky * d) - long(p), ix = long(ox * s + kx * d) - long(p);
+            if (iy >= 0 && ix >= 0 && iy < long(xs[2]) && ix < long(xs[3])) {
+                acc += x(n, (k / kg) * cg + c, size_t(iy), size_t(ix)) * w(k, c, ky, kx);
+            }
+        }
+        out(n, k, oy, ox) = acc;
+    }
+    return out;
+}
+
+void test_conv()
+{
+    auto check = [] (size_t C, size_t K, size_t s, size_t p, size_t d, size_t g) {
+        TL::Tensor<double> x(R(2 * C * 9 * 7), {2, C, 9, 7});
+        TL::Tensor<double> w(R(K * (C / g) * 9), {K, C / g, 3, 3});
+        x *= 0.01;
+        w -= 20.0;
+        auto y = TL::conv2d(x, w, {s, s}, {p, p}, {d, d}, g);
+        auto ref = conv2d_reference(x, w, s, p, d, g);
+        assert(y.shape() == ref.shape());
+        for (auto i = y.begin(), j = ref.begin(); i != y.end(); ++i, ++j) {
+            assert(std::abs(*i - *j) < 1e-9 * (1 + std::abs(*j)));
+        }
+    };
+    check(2, 3, 2, 1, 1, 1);    // direct
+    check(8, 8, 1, 1, 2, 1);    // im2col + GEMM
+    check(4, 4, 1, 1, 1, 4);    // depthwise
+    check(16, 16, 2, 0, 1, 2);  // grouped GEMM
+
+    // A single image, split into tiles of outputs across the threads
+    TL::Tensor<double> x1(R(8 * 30 * 29), {1, 8, 30, 29});
+    TL::Tensor<double> w1(R(16 * 8 * 9), {16, 8, 3, 3});
+    x1 *= 0.01;
+    w1 -= 500.0;
+    auto yt = TL::conv2d(x1, w1, TL::Tensor<double>(R(16), {16}), {1, 1}, {1, 1});
+    auto rt = conv2d_reference(x1, w1, 1, 1, 1, 1);
+    assert(yt.shape() == rt.shape());
+    for (size_t k = 0; k < 16; ++k)
+        for (size_t i = 0; i < 30; ++i)
+            for (size_t j = 0; j < 29; ++j)
+                assert(std::abs(yt(0, k, i, j) - k - rt(0, k, i, j)) < 1e-9 * (1 + std::abs(rt(0, k, i, j))));
+
+    // 1-d convolution with bias
+    TL::Tensor<int> seq({1, 2, 3, 4}, {1, 1, 4});
+    TL::Tensor<int> k(vector<int>{1, 1}, {1, 1, 2});
+    auto y1 = TL::conv1d(seq, k, TL::Tensor<int>(vector<int>{10}, {1}));
+    assert(y1.shape() == vector<size_t>({1, 1, 3}));
+    assert(y1(0, 0, 0) == 13 && y1(0, 0, 2) == 17);
+
+    // Pooling, padded elements are ignored
+    TL::Tensor<double> img(R(16), {1, 1, 4, 4});
+    auto mp = TL::max_pool2d(img, {2, 2});
+    assert(mp.shape() == vector<size_t>({1, 1, 2, 2}));
+    assert(mp(0, 0, 1, 1) == 15);
+    auto ap = TL::avg_pool2d(img, {3, 3}, {2, 2}, {1, 1});
+    assert(ap(0, 0, 0, 0) == (0 + 1 + 4 + 5) / 4.0);
+    auto ap1 = TL::avg_pool1d(TL::Tensor<double>({1, 3, 5, 7}, {1, 1, 4}), 2);
+    assert(ap1(0, 0, 1) == 6);
+
+    // Dense matmul
+    TL::Tensor<int> M(R(6), {2, 3});
+    auto MM = TL::matmul(M, TL::Tensor<int>(R(6), {3, 2}));
+    assert(MM(0, 0) == 10 && MM(1, 1) == 40);
+    // Reversed views walk the operands with negative strides
+    TL::Tensor<int> N3(R(6), {3, 2});
+    auto MR = TL::matmul(M.reverse(1), N3);
+    assert(MR(0, 1) == 5 && MR(1, 0) == 20);
+    assert(TL::matmul(M, N3.reverse(0))(0, 0) == 2);
+}
+
+void test_math()
+{
+    TL::Tensor<float> A({-20.0f, -1.5f, 0.0f, 1e-3f, 0.5f, 2.0f, 100.0f, 1e30f}, {2, 4});
+    auto close = [] (double got, double expected) {
+        return std::abs(got - expected) <= 4e-7 * std::abs(expected) || got == expected;
+    };
+
+    auto E = TL::exp(A), T = TL::tanh(A), S = TL::sigmoid(A);
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t j = 0; j < 4; ++j) {
+            float x = A(i, j);
+            assert(close(E(i, j), std::exp(x)));
+            assert(close(T(i, j), std::tanh(x)));
+            assert(close(S(i, j), 1 / (1 + std::exp(-double(x)))));
+        }
+    }
+    assert(std::isinf(E(1, 3)));
+
+    // In-place on a slice, log and sqrt of exp are back to x
+    TL::Tensor<double> B({0.5, 1.0, 2.0, 3.0}, {2, 2});
+    auto col = B(Slice(R(2), 1));
+    TL::exp(col, col);
+    assert(close(B(1, 1), std::exp(3.0)) && B(0, 0) == 0.5);
+    TL::log(col, col);
+    assert(close(B(1, 1), 3.0));
+    assert(close(TL::sqrt(B)(1, 0), std::sqrt(2.0)));
+
+    auto L = TL::log(TL::Tensor<float>({0.0f, -1.0f, 1.0f}, {3}));
+    assert(std::isinf(L(0)) && std::isnan(L(1)) && L(2) == 0.0f);
+
+    auto P = TL::pow(TL::Tensor<float>({-2.0f, 3.0f, 0.0f}, {3}), 3.0f);
+    assert(P(0) == -8.0f && close(P(1), 27.0) && P(2) == 0.0f);
+    assert(TL::pow(TL::Tensor<double>({10.0}, {1}), 300.0)(0) == std::pow(10.0, 300.0));
+    for (float y : {INFINITY, -INFINITY}) {
+        assert(TL::pow(TL::Tensor<float>({-1.0f}, {1}), y)(0) == 1.0f);
+        assert(TL::pow(TL::Tensor<double>({-1.0}, {1}), double(y))(0) == 1.0);
+    }
+    assert(TL::pow(TL::Tensor<float>({-2.0f}, {1}), INFINITY)(0) == INFINITY);
+    auto Z = TL::pow(TL::Tensor<float>({-0.0f, 0.0f}, {2}), -1.0f);
+    assert(Z(0) == -INFINITY && Z(1) == INFINITY);
+    assert(TL::pow(TL::Tensor<double>({-0.0}, {1}), -1.0)(0) == -INFINITY);
+    assert(std::signbit(TL::pow(TL::Tensor<float>({-0.0f}, {1}), 3.0f)(0)));
+    assert(TL::pow(TL::Tensor<float>({-0.0f}, {1}), -2.0f)(0) == INFINITY);
+}
+
+void test_normalization()
+{
+    // Rows longer than a block of the online softmax, along both axes
+    size_t n = 3000;
+    vector<double> vec(2 * n);
+    for (size_t i = 0; i < vec.size(); ++i) {
+        vec[i] = double(i % 97) / 7 + (i < n ? 500.0 * i / n : 0.0);
+    }
+    vector<double> vec_t(2 * n);
+    for (size_t i = 0; i < n; ++i) {
+        vec_t[2 * i] = vec[i];
+        vec_t[2 * i + 1] = vec[n + i];
+    }
+    TL::Tensor<double> A(vec, {2, n}), AT(vec_t, {n, 2});
+
+    auto S = TL::softmax(A), ST = TL::softmax(AT, 0);
+    auto L = TL::log_softmax(A, 1), LSE = TL::logsumexp(A);
+    for (size_t r = 0; r < 2; ++r) {
+        double m = -1e300, sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            m = std::max(m, vec[r * n + i]);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            sum += std::exp(vec[r * n + i] - m);
+        }
+        assert(std::abs(LSE(r) - (m + std::log(sum))) < 1e-10 * std::abs(LSE(r)));
+        for (size_t i = 0; i < n; i += 7) {
+            double expected = std::exp(vec[r * n + i] - m) / sum;
+            assert(std::abs(S(r, i) - expected) < 1e-12);
+            assert(std::abs(ST(i, r) - expected) < 1e-12);
+            assert(std::abs(L(r, i) - (vec[r * n + i] - m - std::log(sum))) < 1e-9);
+        }
+    }
+    assert(std::abs(TL::logsumexp(TL::Tensor<float>(vector<float>{1000.0f, 1000.0f}, {2}))()
+        - (1000.0f + std::log(2.0f))) < 1e-3);
+
+    // Layer and RMS norm of the columns and of the rows
+    TL::Tensor<float> B({1.0f, 2.0f, 3.0f, 4.0f, 10001.0f, 10003.0f}, {3, 2});
+    auto LN = TL::layer_norm(B, 0, 0.0f);
+    for (size_t j = 0; j < 2; ++j) {
+        double mean = (B(0, j) + B(1, j) + B(2, j)) / 3.0, var = 0;
+        for (size_t i = 0; i < 3; ++i) {
+            var += (B(i, j) - mean) * (B(i, j) - mean) / 3;
+        }
+        for (size_t i = 0; i < 3; ++i) {
+            assert(std::abs(LN(i, j) - (B(i, j) - mean) / std::sqrt(var)) < 1e-4);
+        }
+    }
+    TL::Tensor<float> w(vector<float>{2.0f, 3.0f}, {2}), b(vector<float>{1.0f, -1.0f}, {2});
+    auto LNW = TL::layer_norm(B, w, b, -1, 0.0f);
+    assert(std::abs(LNW(2, 0) + 1.0f) < 1e-3 && std::abs(LNW(2, 1) - 2.0f) < 1e-3);
+    auto RN = TL::rms_norm(B, w, 1, 0.0f);
+    assert(std::abs(RN(0, 0) - 2.0f / std::sqrt(2.5f)) < 1e-5);
+    assert(std::abs(RN(0, 1) - 6.0f / std::sqrt(2.5f)) < 1e-5);
+}
+
+void test_sorting()
+{
+    // Small rows (sorting network) and long rows, on a non contiguous slice
+    TL::Tensor<int> A(R(200), {4, 50});
+    for (size_t i = 0; i < 4; ++i) {
+        for (size_t j = 0; j < 50; ++j) {
+            A(i, j) = int((j * 37 + i * 11) % 50);
+        }
+    }
+    for (size_t cols : {5, 16, 50}) {
+        auto V = A(Slice(R(0, 4), R(0, cols)));
+        auto S = TL::sort(V), SD = TL::sort(V, 1, true);
+        auto I = TL::argsort(V);
+        for (size_t i = 0; i < 4; ++i) {
+            vector<int> row;
+            for (size_t j = 0; j < cols; ++j) {
+                row.push_back(V(i, j));
+            }
+            std::sort(row.begin(), row.end());
+            for (size_t j = 0; j < cols; ++j) {
+                assert(S(i, j) == row[j] && SD(i, cols - 1 - j) == row[j]);
+                assert(V(i, I(i, j)) == row[j]);
+            }
+        }
+    }
+
+    // Along the first axis, ties keep their order, NaNs go last
+    TL::Tensor<double> B(vector<double>{3, NAN, NAN, 2, 1, 5, 1, 0}, {4, 2});
+    auto SB = TL::sort(B, 0);
+    assert(SB(0, 0) == 1 && SB(1, 0) == 1 && SB(2, 0) == 3 && std::isnan(SB(3, 0)));
+    auto IB = TL::argsort(B, 0);
+    assert(IB(0, 0) == 2 && IB(1, 0) == 3 && IB(2, 0) == 0 && IB(3, 0) == 1);
+    assert(IB(0, 1) == 3 && IB(1, 1) == 1 && IB(3, 1) == 0);
+
+    // Heap (small k) and introselect (large k) paths
+    TL::Tensor<int> C(R(1000), {1000});
+    for (size_t i = 0; i < 1000; ++i) {
+        C(i) = int((i * 613) % 1000);
+    }
+    for (size_t k : {3, 700}) {
+        auto [values, indices] = TL::topk(C, k);
+        auto [low, low_idx] = TL::topk(C, k, 0, false);
+        for (size_t i = 0; i < k; ++i) {
+            assert(values(i) == int(999 - i) && C(indices(i)) == values(i));
+            assert(low(i) == int(i) && C(low_idx(i)) == low(i));
+        }
+    }
+}
+
+void test_indexing()
+{
+    TL::Tensor<int> A(R(12), {4, 3});
+    TL::Tensor<size_t> rows(vector<size_t>{3, 0, 3}, {3});
+
+    auto S = TL::index_select(A, 0, rows);
+    assert(S.shape() == vector<size_t>({3, 3}) && S(0, 2) == 11 && S(1, 0) == 0 && S(2, 1) == 10);
+    auto SC = TL::index_select(A, -1, TL::Tensor<size_t>(vector<size_t>{2, 1}, {2}));
+    assert(SC.shape() == vector<size_t>({4, 2}) && SC(3, 0) == 11 && SC(0, 1) == 1);
+
+    auto T = TL::take(A, TL::Tensor<size_t>(vector<size_t>{11, 0, 5, 6}, {2, 2}));
+    assert(T(0, 0) == 11 && T(0, 1) == 0 && T(1, 0) == 5 && T(1, 1) == 6);
+
+    // take_along_axis style gather and its inverse
+    TL::Tensor<size_t> idx(vector<size_t>{2, 0, 1, 1, 0, 0, 2, 2}, {4, 2});
+    auto G = TL::gather(A, 1, idx);
+    assert(G(0, 0) == 2 && G(0, 1) == 0 && G(1, 0) == 4 && G(3, 1) == 11);
+
+    TL::Tensor<int> Z(vector<int>(12, 0), {4, 3});
+    TL::scatter(Z, 1, idx, G);
+    assert(Z(0, 2) == 2 && Z(0, 1) == 0 && Z(1, 1) == 4 && Z(3, 2) == 11);
+    TL::scatter_add(Z, 1, idx, G);
+    assert(Z(1, 1) == 12 && Z(2, 0) == 18 && Z(0, 0) == 0);
+
+    // Repeated destinations accumulate in index_add, also on a slice
+    TL::Tensor<int> E(vector<int>(8, 0), {4, 2});
+    auto view = E(Slice(R(4), 1));
+    TL::index_add(view, 0, rows, TL::Tensor<int>(vector<int>{1, 2, 3}, {3, 1}));
+    assert(E(3, 1) == 4 && E(0, 1) == 2 && E(0, 0) == 0);
+
+    bool thrown = false;
+    try {
+        TL::take(A, TL::Tensor<size_t>(vector<size_t>{12}, {1}));
+    } catch (std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // An index of fewer dimensions is rejected before its shape is read
+    thrown = false;
+    try {
+        TL::gather(A, 1, TL::Tensor<size_t>(vector<size_t>{0, 1}, {2}));
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Boolean masks
+    TL::Tensor<uint8_t> mask(vector<uint8_t>(12, 0), {4, 3});
+    mask(1, 1) = mask(3, 0) = 1;
+    auto M = TL::masked_select(A, mask);
+    assert(M.size() == 2 && M(0) == 4 && M(1) == 9);
+    TL::Tensor<bool> bmask(TL::internal::Buffer<bool>(12), {4, 3});
+    bmask(0, 2) = true;
+    assert(TL::masked_select(A, bmask).size() == 1 && TL::masked_select(A, bmask)(0) == 2);
+    TL::masked_fill(A, mask, -1);
+    assert(A(1, 1) == -1 && A(3, 0) == -1 && A(1, 2) == 5);
+}
+
+void test_concatenate()
+{
+    TL::Tensor<int> A(R(6), {2, 3}), B(R(4), {2, 2});
+
+    auto C = TL::concatenate<int>({A, B}, 1);
+    assert(C.shape() == vector<size_t>({2, 5}));
+    assert(C(0, 2) == 2 && C(0, 3) == 0 && C(1, 0) == 3 && C(1, 4) == 3);
+
+    // Non contiguous inputs, along the first axis
+    auto R0 = TL::concatenate<int>({A, A.reverse(0)}, 0);
+    assert(R0.shape() == vector<size_t>({4, 3}) && R0(2, 0) == 3 && R0(3, 2) == 2);
+
+    auto S = TL::stack<int>({A, A * 10}, 1);
+    assert(S.shape() == vector<size_t>({2, 2, 3}) && S(1, 0, 2) == 5 && S(1, 1, 2) == 50);
+
+    // Splits are views
+    auto parts = TL::split(C, {3, 2}, 1);
+    assert(parts.size() == 2 && parts[0].shape() == vector<size_t>({2, 3}));
+    assert(parts[1](1, 1) == 3);
+    parts[1](0, 0) = -7;
+    assert(C(0, 3) == -7);
+    auto chunks = TL::chunk(C, 2, -1);
+    assert(chunks.size() == 2 && chunks[1].shape() == vector<size_t>({2, 2}));
+    assert(TL::split(A, 2, 0)[1](0, 2) == 5);
+    // Another axis of length 0 gives empty parts
+    TL::Tensor<int> Z(TL::internal::Buffer<int>(0), {4, 0});
+    auto zs = TL::split(Z, {1, 3}, 0);
+    assert(zs.size() == 2 && zs[1].shape() == vector<size_t>({3, 0}) && !zs[1].size());
+    assert(TL::chunk(Z, 2, 0)[0].shape() == vector<size_t>({2, 0}));
+
+    // Appending batches keeps the already stored ones
+    TL::ChunkedTensor<int> L(A);
+    L.append(A(Slice(R(0, 2, -1), R(3))));
+    assert(L.shape() == vector<size_t>({4, 3}) && L.num_chunks() == 2 && L.size() == 12);
+    assert(&L.chunk(0).data_ptr()[0] == &A.data_ptr()[0]);
+    assert(L[2](0) == 3 && L[3](2) == 2);
+    auto all = L.to_tensor();
+    assert(all.shape() == vector<size_t>({4, 3}) && all(3, 1) == 1);
+    L.compact();
+    assert(L.num_chunks() == 1 && L[2](2) == 5);
+}
+
+void test_scan()
+{
+    TL::Tensor<int> A(R(1, 13), {3, 4});
+
+    auto C = TL::cumsum(A);
+    assert(C(0, 3) == 10 && C(2, 0) == 9 && C(2, 3) == 42);
+    auto C0 = TL::cumsum(A, 0);
+    assert(C0(1, 0) == 6 && C0(2, 3) == 24);
+    assert(TL::cumprod(A, -1)(0, 3) == 24);
+
+    // Views, along the first axis
+    auto M = TL::cummax(A.reverse(0), 0);
+    assert(M(0, 0) == 9 && M(2, 0) == 9 && M(2, 3) == 12);
+    auto m = TL::cummin(A.reverse(1), 1);
+    assert(m(1, 0) == 8 && m(1, 3) == 5);
+
+    // NaNs propagate
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    TL::Tensor<double> N(vector<double>{1, nan, 3}, {3});
+    auto NM = TL::cummax(N);
+    assert(NM(0) == 1 && NM(1) != NM(1) && NM(2) != NM(2));
+
+    // Long rows take the blocked paths
+    size_t n = 100003;
+    TL::Tensor<long> L(vector<long>(2 * n, 1), {2, n});
+    auto LS = TL::cumsum(L);
+    for (size_t i = 0; i < n; i += 997) {
+        assert(LS(0, i) == long(i + 1) && LS(1, i) == long(i + 1));
+    }
+    assert(LS(1, n - 1) == long(n));
+    auto LT = TL::cumsum(TL::Tensor<long>(vector<long>(2 * n, 1), {n, 2}), 0);
+    assert(LT(n - 1, 1) == long(n) && LT(500, 0) == 501);
+}
+
+void test_einsum()
+{
+    TL::Tensor<double> A(R(6), {2, 3}), B(R(12), {3, 4});
+
+    // Matrix product, against matmul
+    auto C = TL::einsum("ij,jk->ik", A, B);
+    auto D = TL::matmul(A, B);
+    assert(C.shape() == vector<size_t>({2, 4}));
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t k = 0; k < 4; ++k) {
+            assert(C(i, k) == D(i, k));
+        }
+    }
+    // Transposed output, implicit output and views
+    auto Ct = TL::einsum("ij,jk->ki", A, B);
+    assert(Ct.shape() == vector<size_t>({4, 2}) && Ct(3, 1) == D(1, 3));
+    auto Ci = TL::einsum("jk,ij", B.reverse(1), A);
+    assert(Ci.shape() == vector<size_t>({2, 4}) && Ci(1, 0) == D(1, 3));
+
+    // Batched products
+    TL::Tensor<double> X(R(24), {2, 3, 4}), Y(R(16), {2, 4, 2});
+    auto Z = TL::einsum("bij,bjk->bik", X, Y);
+    assert(Z.shape() == vector<size_t>({2, 3, 2}));
+    double z = 0;
+    for (size_t j = 0; j < 4; ++j) {
+        z += X(1, 2, j) * Y(1, j, 1);
+    }
+    assert(Z(1, 2, 1) == z);
+
+    // Traces, diagonals, sums and outer products
+    TL::Tensor<int> S(R(9), {3, 3});
+    assert(TL::einsum("ii->", S)() == 12);
+    auto diag = TL::einsum("ii->i", S);
+    assert(diag.shape() == vector<size_t>({3}) && diag(2) == 8);
+    auto col = TL::einsum("ij->j", S);
+    assert(col(0) == 9 && col(2) == 15);
+    auto T = TL::einsum("ij->ji", S);
+    assert(T(0, 2) == 6);
+    auto O = TL::einsum("i,j->ij", diag, col);
+    assert(O(1, 2) == 4 * 15);
+
+    // Chains of operands, contracted in a cheap order
+    TL::Tensor<double> u(R(2), {2}), v(R(4), {4});
+    auto q = TL::einsum("i,ij,jk,k->", u, A, B, v);
+    double ref = 0;
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            for (size_t k = 0; k < 4; ++k) {
+                ref += u(i) * A(i, j) * B(j, k) * v(k);
+            }
+        }
+    }
+    assert(q() == ref);
+
+    bool thrown = false;
+    try {
+        TL::einsum("ij,kl->ik", A, A.reverse(0), B);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    thrown = false;
+    try {
+        TL::einsum("ij,ij->i", A, B);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_random()
+{
+    // Known answer of Philox4x32-10 for a zero counter and key
+    uint32_t w[4];
+    TL::internal::philox_blocks(0, 1, 0, w);
+    assert(w[0] == 0x6627e8d5 && w[1] == 0xe169c58d && w[2] == 0xbc57ac4c && w[3] == 0x9b00dbd8);
+
+    size_t n = 100001;
+    auto U = TL::uniform<float>({n}, 42, -1, 1);
+    double mean = 0;
+    for (size_t i = 0; i < n; ++i) {
+        assert(U(i) >= -1 && U(i) < 1);
+        mean += U(i);
+    }
+    assert(std::abs(mean / n) < 0.01);
+
+    // Same seed, same bits; the tail of a bigger tensor is the same sequence
+    auto U2 = TL::uniform<float>({n + 5}, 42, -1, 1);
+    assert(U2(n - 1) == U(n - 1) && TL::uniform<float>({n}, 43, -1, 1)(7) != U(7));
+
+    auto N = TL::normal<double>({1000, 100}, 7, 2, 3);
+    double m = 0, v = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+        for (size_t j = 0; j < 100; ++j) {
+            m += N(i, j);
+            v += N(i, j) * N(i, j);
+        }
+    }
+    m /= 100000;
+    v = v / 100000 - m * m;
+    assert(std::abs(m - 2) < 0.05 && std::abs(v - 9) < 0.2);
+
+    auto B = TL::bernoulli<int>({10, 1000}, 1, 0.25);
+    int ones = 0;
+    for (auto x : B) {
+        assert(x == 0 || x == 1);
+        ones += x;
+    }
+    assert(std::abs(ones - 2500) < 200);
+    assert(TL::bernoulli<int>({3}, 1, 1.0)(2) == 1 && TL::bernoulli<int>({3}, 1, 0.0)(0) == 0);
+}
+
+void test_numa()
+{
+    assert(TL::numa_num_nodes() >= 1);
+
+    // Large buffers are mapped, zeroed in parallel by their first touch
+    size_t n = 1 << 20;
+    TL::internal::Buffer<double> Z(n);
+    assert(Z.size() == n && Z[0] == 0 && Z[n / 2] == 0 && Z[n - 1] == 0);
+    TL::internal::Buffer<int> F(n, 3), S(10, 4);
+    auto G = F;
+    assert(G[n - 1] == 3 && S[9] == 4 && G.data() != F.data());
+    auto H = std::move(G);
+    assert(G.empty() && H.size() == n);
+
+    for (auto placement : {TL::NumaPlacement::Interleave, TL::NumaPlacement::Bind}) {
+        TL::set_numa_policy({placement, 0});
+        TL::Tensor<float> A(R(n), {n / 4, 4});
+        auto B = A + A;
+        assert(B(n / 4 - 1, 3) == 2.f * (n - 1) && TL::cumsum(A * 0 + 1, 0)(n / 4 - 1, 0) == n / 4);
+    }
+
+    // The policy reaches the kernel, checked where it reports policies
+    for (auto placement : {TL::NumaPlacement::Interleave, TL::NumaPlacement::Bind}) {
+        TL::set_numa_policy({placement, TL::internal::numa_online_nodes().empty()
+                                        ? 0 : TL::internal::numa_online_nodes().back()});
+        TL::internal::Buffer<float> P(n);
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+        // MPOL_F_ADDR gives the policy of the page holding the address
+        int mode = -1;
+        if (syscall(SYS_get_mempolicy, &mode, nullptr, 0, P.data(), 2) == 0) {
+            assert(mode == (placement == TL::NumaPlacement::Interleave ? 3 : 2));
+        }
+#endif
+    }
+    // Nodes that aren't online are refused before asking the kernel
+    assert(!TL::internal::numa_place(nullptr, 0, {TL::NumaPlacement::Bind, 1 << 20}));
+    assert(!TL::internal::numa_place(nullptr, 0, {TL::NumaPlacement::Bind, -1}));
+
+    TL::set_numa_policy({});
+    assert(TL::get_numa_policy().placement == TL::NumaPlacement::FirstTouch);
+}
+
+void test_huge_pages()
+{
+    size_t n = (3 << 20) / sizeof(double);
+    for (auto mode : {TL::HugePages::Transparent, TL::HugePages::Explicit, TL::HugePages::None}) {
+        TL::set_huge_pages(mode);
+        TL::internal::Buffer<double> B(n, 1.5);
+        assert(B[n - 1] == 1.5);
+        if (mode == TL::HugePages::Transparent) {
+            uintptr_t block = reinterpret_cast<uintptr_t>(B.data()) - TL::internal::block_data_offset;
+            assert(block % TL::internal::huge_page_size == 0);
+        }
+    }
+    TL::set_huge_pages(TL::HugePages::Transparent);
+
+    // Column slices of a large tensor
+    TL::Tensor<float> A(R(1 << 20), {1 << 10, 1 << 10});
+    auto col = A(Slice(R(1 << 10), R(5, 6)));
+    assert(col(1023, 0) == 1023 * 1024 + 5);
+}
+
+void test_batch_stream()
+{
+    std::string path = "/tmp/tensorlib_test_batches.tlt";
+    TL::Tensor<int> A(R(30), {10, 3});
+    TL::save(path, A);
+    auto L = TL::load<int>(path);
+    assert(L.shape() == A.shape() && L(9, 2) == 29);
+    bool thrown = false;
+    try {
+        TL::load<float>(path);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    TL::BatchStream<int> S(path, 4);
+    assert(S.num_batches() == 3);
+    vector<size_t> sizes;
+    int expected = 0;
+    while (auto batch = S.next()) {
+        sizes.push_back(batch->shape()[0]);
+        for (size_t i = 0; i < batch->shape()[0]; ++i) {
+            assert((*batch)(i, 0) == expected);
+            expected += 3;
+        }
+    }
+    assert(sizes == vector<size_t>({4, 4, 2}) && !S.next());
+
+    // Shuffled by blocks of 2 rows with a single buffer: every row once
+    TL::BatchStreamOptions opts;
+    opts.prefetch = 1;
+    opts.shuffle = true;
+    opts.shuffle_block = 2;
+    opts.seed = 5;
+    opts.drop_last = true;
+    TL::BatchStream<int> H(path, 3, opts);
+    for (int epoch = 0; epoch < 2; ++epoch) {
+        vector<int> seen;
+        while (auto batch = H.next()) {
+            assert(batch->shape() == vector<size_t>({3, 3}));
+            for (size_t i = 0; i < 3; ++i) {
+                seen.push_back((*batch)(i, 1));
+            }
+        }
+        assert(seen.size() == 9);
+        std::sort(seen.begin(), seen.end());
+        assert(std::unique(seen.begin(), seen.end()) == seen.end() && seen[0] >= 1);
+        H.reset();
+    }
+    assert(H.epoch() == 2);
+
+    // A failing constructor closes the file it opened
+    int probe = ::open("/dev/null", O_RDONLY);
+    ::close(probe);
+    thrown = false;
+    try {
+        TL::BatchStream<int> huge(path, size_t(1) << 50);
+    }
+    catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    int again = ::open("/dev/null", O_RDONLY);
+    ::close(again);
+    assert(thrown && again == probe);
+
+    // Rows without elements, the last batch smaller
+    TL::save(path, TL::Tensor<int>(TL::internal::Buffer<int>(0), {5, 0, 2}));
+    TL::BatchStream<int> E(path, 2);
+    sizes.clear();
+    while (auto batch = E.next()) {
+        assert(!batch->size());
+        sizes.push_back(batch->shape()[0]);
+    }
+    assert(sizes == vector<size_t>({2, 2, 1}));
+    std::remove(path.c_str());
+}
+
+void test_disk_tensor()
+{
+    std::string path = "/tmp/tensorlib_test_chunked.tltc";
+    TL::Tensor<int> A(R(6 * 7 * 5), {6, 7, 5});
+    TL::save_chunked(path, A, {4, 3, 5});
+    TL::DiskTensor<int> D(path, 1 << 20);
+    assert(D.shape() == A.shape());
+    auto all = D.read();
+    assert(all.shape() == A.shape() && D.chunks_read() == 2 * 3 * 1);
+    for (size_t i = 0; i < 6; ++i)
+        for (size_t j = 0; j < 7; ++j)
+            for (size_t k = 0; k < 5; ++k)
+                assert(all(i, j, k) == A(i, j, k));
+
+    // Slices with steps and single indices, served by the cache
+    auto s = D(Slice(R(1, 6, 2), 4, R(0, 5, -2)));
+    auto e = A(Slice(R(1, 6, 2), 4, R(0, 5, -2)));
+    assert(s.shape() == e.shape());
+    for (size_t i = 0; i < 3; ++i)
+        for (size_t k = 0; k < 3; ++k)
+            assert(s(i, 0, k) == e(i, 0, k));
+    assert(D.chunks_read() == 6);
+
+    // A small cache reads only the overlapping chunks
+    TL::DiskTensor<int> small(path, 0);
+    auto one = small(Slice(R(4, 6), R(3, 6), R(5)));
+    assert(one(1, 2, 4) == A(5, 5, 4) && small.chunks_read() == 1);
+
+    // Compressible data round trips through the codec
+    TL::Tensor<double> Z(vector<double>(512 * 64), {512, 64});
+    for (size_t i = 0; i < 512; ++i)
+        Z(i, i % 64) = double(i);
+    TL::save_chunked(path, Z, {100, 64});
+    TL::DiskTensor<double> DZ(path);
+    auto z = DZ(Slice(R(90, 210), R(64)));
+    for (size_t i = 0; i < 120; ++i)
+        for (size_t j = 0; j < 64; ++j)
+            assert(z(i, j) == Z(i + 90, j));
+
+    bool thrown = false;
+    try {
+        DZ(Slice(R(510, 513), R(64)));
+    }
+    catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Chunks whose size wouldn't fit in the index are rejected
+    thrown = false;
+    try {
+        double one = 1;
+        TL::Tensor<double> big(&one, {size_t(1) << 29, 2}, vector<long>({0, 0}));
+        TL::save_chunked(path, big, {size_t(1) << 29, 1});
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // A 0 dimensional tensor
+    TL::save_chunked(path, TL::Tensor<float>(3.5f), {});
+    auto scalar = TL::DiskTensor<float>(path).read();
+    assert(scalar.ndim() == 0 && scalar() == 3.5f);
+    std::remove(path.c_str());
+}
+
+void test_csv()
+{
+    std::string path = "/tmp/tensorlib_test.csv";
+    {
+        std::ofstream out(path);
+        out << "a,b,c\n1, 2.5,-3\r\n\n4,5e1,+6\n";
+        for (int i = 0; i < 20000; ++i)
+            out << i << "," << i * 0.5 << "," << -i << "\n";
+        out << "7,8,9";
+    }
+    TL::CsvOptions opts;
+    opts.skip_rows = 1;
+    auto X = TL::load_csv<double>(path, opts);
+    assert(X.shape() == vector<size_t>({20003, 3}));
+    assert(X(0, 1) == 2.5 && X(0, 2) == -3 && X(1, 1) == 50 && X(1, 2) == 6);
+    for (size_t i = 0; i < 20000; ++i)
+        assert(X(i + 2, 0) == double(i) && X(i + 2, 1) == i * 0.5);
+    assert(X(20002, 2) == 9);
+
+    // Ragged rows and bad numbers are errors
+    for (const char* text : {"1,2\n3\n", "1,x\n"}) {
+        {
+            std::ofstream out(path);
+            out << text;
+        }
+        bool thrown = false;
+        try {
+            TL::load_csv<int>(path);
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    std::remove(path.c_str());
+}
+
+void test_storage()
+{
+    // Views share the block of their tensor, copies don't
+    TL::Tensor<int> A(R(12), {3, 4});
+    auto V = A(Slice(R(1, 3), R(4)));
+    auto C = A.copy();
+    assert(V.data_ptr() == A.data_ptr() + 4 && C.data_ptr() != A.data_ptr());
+    assert(reinterpret_cast<uintptr_t>(A.data_ptr()) % TL::internal::block_data_offset == 0);
+
+    // Iterators don't keep the elements alive
+    TL::Tensor<int>::iterator it;
+    {
+        TL::Tensor<int> B(R(4), {4});
+        it = B.begin();
+        assert(*it == 0);
+        auto B2 = B;
+        B = C;
+        assert(*++it == 1);
+    }
+    bool thrown = false;
+    try {
+        *it;
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Reshaping a fresh copy takes its block, a shared one is copied
+    auto S = A.reshape(4, 3);
+    assert(S(3, 2) == 11 && S.data_ptr() != A.data_ptr());
+    TL::internal::Storage<int> st(TL::internal::Buffer<int>(5, 7));
+    auto shared = st;
+    auto buf = std::move(shared).take();
+    assert(buf.data() != st.data() && buf[4] == 7 && !shared.data());
+    auto own = std::move(st).take();
+    assert(own.size() == 5 && !st.data());
+}
+
+void test_external()
+{
+    // Wrapping external memory, released by the last tensor using it
+    int released = 0;
+    auto* raw = new double[6]{0, 1, 2, 3, 4, 5};
+    {
+        TL::Tensor<double> A(raw, {2, 3}, [&] (double* p) { delete[] p; ++released; });
+        auto V = A(Slice(R(2), 1));
+        A = V;
+        assert(V(1, 0) == 4 && released == 0);
+        raw[4] = 9;
+        assert(V(1, 0) == 9);
+    }
+    assert(released == 1);
+
+    // Negative strides reach the elements before the pointer
+    int buf[6] = {0, 1, 2, 3, 4, 5};
+    TL::Tensor<int> T(buf + 5, {2, 3}, {-3, -1});
+    assert(T(0, 0) == 5 && T(1, 2) == 0 && !T.is_contiguous());
+    assert(T.copy()(1, 0) == 2);
+
+    // DLPack round trip shares the elements both ways
+    TL::Tensor<float> F(R(12), {3, 4});
+    auto G = F(Slice(R(3), R(1, 4, 2)));
+    DLManagedTensor* m = TL::to_dlpack(G);
+    assert(m->dl_tensor.ndim == 2 && m->dl_tensor.shape[1] == 2 && m->dl_tensor.strides[1] == 2);
+    assert(m->dl_tensor.dtype.code == kDLFloat && m->dl_tensor.dtype.bits == 32);
+    bool thrown = false;
+    try {
+        TL::from_dlpack<int>(m);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    auto H = TL::from_dlpack<float>(m);
+    assert(H.data_ptr() == G.data_ptr() && H(2, 1) == 11);
+    H(0, 0) = -1;
+    assert(F(0, 1) == -1);
+}
+
+void test_shared_memory()
+{
+    std::string name = "/tensorlib_test_shm";
+    TL::shm_remove(name);
+    {
+        auto A = TL::shm_create<float>(name, {3, 4});
+        A(1, 2) = 5;
+        auto B = TL::shm_attach<float>(name);
+        auto W = TL::shm_attach<float>(name, true);
+        assert(B.shape() == A.shape() && B(1, 2) == 5 && B.data_ptr() != A.data_ptr());
+        W(2, 3) = 7;
+        assert(A(2, 3) == 7 && B(2, 3) == 7);
+        bool thrown = false;
+        try {
+            TL::shm_create<float>(name, {1});
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+        thrown = false;
+        try {
+            TL::shm_attach<int>(name);
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    TL::shm_remove(name);
+
+    // A producer and a consumer streaming through a ring of 2 tensors
+    std::string ring = "/tensorlib_test_ring";
+    TL::shm_remove(ring);
+    TL::ShmRing<int> P(ring, 2, {2, 3});
+    TL::ShmRing<int> C(ring);
+    assert(C.capacity() == 2 && C.shape() == vector<size_t>({2, 3}) && !C.read_slot());
+    const int n = 1000;
+    std::thread producer([&] {
+        for (int i = 0; i < n;) {
+            if (P.try_push(TL::Tensor<int>(R(i, i + 6), {2, 3}))) {
+                ++i;
+            }
+        }
+    });
+    for (int i = 0; i < n;) {
+        if (auto t = C.read_slot()) {
+            assert((*t)(0, 0) == i && (*t)(1, 2) == i + 5);
+            C.pop();
+            ++i;
+        }
+    }
+    producer.join();
+    assert(!C.read_slot() && P.write_slot());
+
+    // A corrupt capacity is rejected when opening the ring
+    {
+        TL::internal::ShmMapping raw(ring, 0, true);
+        reinterpret_cast<TL::internal::ShmRingControl*>(raw.data())->capacity = 0;
+        bool thrown = false;
+        try {
+            TL::ShmRing<int> Z(ring);
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    TL::shm_remove(ring);
+}
+
+void test_nd_loop()
+{
+    // Whole rows of a matrix merge into a single contiguous loop
+    TL::Tensor<int> A(R(200 * 1000), {200, 1000});
+    auto rows = A(Slice(R(0, 100), R(1000)));
+    auto st = rows.strides();
+    auto dims = TL::internal::loop_dims<1>(rows.shape(), {&st});
+    assert(dims.size() == 1 && dims[0].n == 100000 && dims[0].s[0] == 1);
+
+    // Column blocks keep two loops, a transposed layout is reordered
+    auto block = A(Slice(R(3, 7), R(10, 20)));
+    st = block.strides();
+    dims = TL::internal::loop_dims<1>(block.shape(), {&st});
+    assert(dims.size() == 2 && dims[0].n == 4 && dims[1].n == 10 && dims[1].s[0] == 1);
+    auto strides = vector<long>({1, 1000});
+    dims = TL::internal::loop_dims<1>({1000, 200}, {&strides});
+    assert(dims.size() == 1 && dims[0].n == 200000 && dims[0].s[0] == 1);
+
+    block += 1;
+    assert(A(3, 10) == 3011 && A(6, 19) == 6020 && A(7, 10) == 7010 && A(3, 20) == 3020);
+    auto rev = block.reverse(1).reverse(0);
+    auto back = rev.copy();
+    assert(back(0, 0) == 6020 && back(3, 9) == 3011 && back.is_contiguous());
+    rev -= back;
+    assert(A(6, 19) == 0 && A(3, 10) == 0 && A(3, 9) == 3009);
+
+    // Operands of different layouts, and an element-wise op over a step slice
+    TL::Tensor<double> B(R(24), {2, 3, 4}), C(R(24), {2, 3, 4});
+    auto odd = C(Slice(R(2), R(3), R(1, 4, 2)));
+    auto even = B(Slice(R(2), R(3), R(0, 4, 2)));
+    odd *= even;
+    assert(C(1, 2, 3) == 23 * 22 && C(1, 2, 2) == 22 && C(0, 0, 1) == 0);
+}
+
+void test_layout()
+{
+    // NCHW tensor with a number of channels that isn't a multiple of the block
+    TL::Tensor<float> X(R(2 * 20 * 5 * 7), {2, 20, 5, 7});
+    auto F = TL::to_layout(X, TL::Layout::ColumnMajor);
+    assert(F.layout() == TL::Layout::ColumnMajor && F.strides() == vector<long>({1, 2, 40, 200}));
+    assert(F(1, 13, 4, 6) == X(1, 13, 4, 6) && F(0, 19, 2, 3) == X(0, 19, 2, 3));
+    assert(TL::to_layout(F, TL::Layout::ColumnMajor).data_ptr() == F.data_ptr());
+
+    auto N = TL::to_layout(F, TL::Layout::ChannelsLast);
+    assert(N.strides() == vector<long>({700, 1, 140, 20}));
+    assert(N(1, 13, 4, 6) == X(1, 13, 4, 6) && N(0, 7, 3, 0) == X(0, 7, 3, 0));
+
+    // Blocks of 8 channels: (2, 3, 5, 7, 8), the last 4 lanes zero
+    auto B = TL::to_layout(N, TL::Layout::Blocked, 8);
+    assert(B.layout() == TL::Layout::Blocked && B.shape() == vector<size_t>({2, 3, 5, 7, 8}));
+    assert(B.logical_shape() == vector<size_t>({2, 20, 5, 7}));
+    assert(B(1, 1, 4, 6, 5) == X(1, 13, 4, 6) && B(0, 2, 2, 3, 3) == X(0, 19, 2, 3));
+    assert(B(1, 2, 4, 6, 4) == 0 && B(0, 2, 0, 0, 7) == 0);
+    assert(B.copy().layout() == TL::Layout::Blocked);
+
+    auto B4 = TL::to_layout(B, TL::Layout::Blocked, 4);
+    assert(B4.shape() == vector<size_t>({2, 5, 5, 7, 4}) && B4(1, 3, 4, 6, 1) == X(1, 13, 4, 6));
+    auto back = TL::to_layout(B4, TL::Layout::RowMajor);
+    assert(back.is_contiguous() && back.shape() == X.shape());
+    assert(std::equal(back.data_ptr(), back.data_ptr() + back.size(), X.data_ptr()));
+
+    // Views dropping an axis or cutting into the channels are plain tensors
+    TL::Tensor<float> Y(R(2 * 20 * 3 * 3), {2, 20, 3, 3});
+    auto YB = TL::to_layout(Y, TL::Layout::Blocked, 8);
+    assert(YB[1].layout() == TL::Layout::RowMajor && YB[1].logical_shape() == vector<size_t>({3, 3, 3, 8}));
+    assert(YB[0][0][0][0].logical_shape() == vector<size_t>({8}));
+    auto first = TL::to_layout(YB[0], TL::Layout::RowMajor);
+    assert(first.shape() == vector<size_t>({3, 3, 3, 8}) && first(2, 1, 0, 3) == Y(0, 19, 1, 0));
+    auto part = YB(Slice(R(2), R(1, 3), R(3), R(3), R(8)));
+    assert(part.layout() == TL::Layout::RowMajor && YB.reverse(4).layout() == TL::Layout::RowMajor);
+
+    // Batches and spatial slices stay blocked
+    auto batch = YB(Slice(R(1, 2), R(3), R(1, 3), R(3), R(8)));
+    assert(batch.layout() == TL::Layout::Blocked && batch.logical_shape() == vector<size_t>({1, 20, 2, 3}));
+    auto bt = TL::to_layout(batch, TL::Layout::RowMajor);
+    assert(bt(0, 19, 1, 2) == Y(1, 19, 2, 2) && bt(0, 0, 0, 0) == Y(1, 0, 1, 0));
+
+    // Large transposes go through tiles
+    TL::Tensor<int> A(R(300 * 257), {300, 257});
+    auto At = TL::to_layout(A, TL::Layout::ColumnMajor);
+    auto Ar = TL::to_layout(At, TL::Layout::RowMajor);
+    assert(At(299, 256) == A(299, 256) && At(17, 200) == A(17, 200));
+    assert(std::equal(Ar.data_ptr(), Ar.data_ptr() + Ar.size(), A.data_ptr()));
+
+    bool thrown = false;
+    try {
+        TL::to_layout(TL::Tensor<int>(R(4), {4}), TL::Layout::Blocked);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_dynamic_tensor()
+{
+    TL::DynamicTensor A = TL::Tensor<int32_t>(R(6), {2, 3});
+    TL::DynamicTensor B = TL::Tensor<float>(vector<float>({0.5, 1.5, 2.5, 3.5, 4.5, 5.5}), {2, 3});
+    assert(A.dtype() == TL::DType::Int32 && A.holds<int32_t>() && !A.holds<float>());
+    assert(A.shape() == vector<size_t>({2, 3}) && A.size() == 6);
+    assert(TL::dtype_of<uint16_t>() == TL::DType::UInt16 && TL::dtype_name(B.dtype()) == "float32");
+
+    // Promotion follows the usual rules
+    assert(TL::promote_types(TL::DType::Int32, TL::DType::Float32) == TL::DType::Float64);
+    assert(TL::promote_types(TL::DType::Int8, TL::DType::Float32) == TL::DType::Float32);
+    assert(TL::promote_types(TL::DType::UInt8, TL::DType::Int8) == TL::DType::Int16);
+    assert(TL::promote_types(TL::DType::UInt32, TL::DType::Int64) == TL::DType::Int64);
+    assert(TL::promote_types(TL::DType::UInt64, TL::DType::Int64) == TL::DType::Float64);
+
+    auto C = A + B;
+    assert(C.dtype() == TL::DType::Float64 && C.get<double>()(1, 2) == 10.5);
+    auto D = A * A;
+    assert(D.dtype() == TL::DType::Int32 && D.get<int32_t>()(1, 1) == 16);
+    auto M = TL::matmul(A, TL::DynamicTensor(TL::Tensor<int8_t>(R(6), {3, 2})));
+    assert(M.dtype() == TL::DType::Int32 && M.shape() == vector<size_t>({2, 2}) && M.get<int32_t>()(1, 1) == 40);
+
+    bool thrown = false;
+    try {
+        A.get<double>();
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Conversions keep the values, and work on views
+    auto col = TL::DynamicTensor(B.get<float>()(Slice(R(2), R(1, 2))));
+    auto H = col.astype(TL::DType::Int64);
+    assert(H.get<int64_t>()(0, 0) == 1 && H.get<int64_t>()(1, 0) == 4 && H.is_contiguous());
+    assert(TL::DynamicTensor(TL::DType::UInt8, {4}).get<uint8_t>()(3) == 0);
+
+    // Files and DLPack tensors of a type known at run time
+    string path = "/tmp/tensorlib_test_dynamic.tl";
+    TL::save(path, TL::DynamicTensor(TL::Tensor<uint16_t>(R(12), {3, 4})));
+    auto L = TL::load_dynamic(path);
+    assert(L.dtype() == TL::DType::UInt16 && L.get<uint16_t>()(2, 3) == 11);
+    std::remove(path.c_str());
+    auto X = TL::from_dlpack(TL::to_dlpack(B));
+    assert(X.dtype() == TL::DType::Float32 && X.get<float>().data_ptr() == B.get<float>().data_ptr());
+
+    std::ostringstream out;
+    out << D;
+    assert(!out.str().empty());
+}
+
 int main()
 {   
     test_constructs();
@@ -187,6 +1371,30 @@ int main()
     test_const_iterator();
     test_print();
     test_reshape_squeeze();   
+    test_step_slicing();
+    test_lazy();
+    test_async();
+    test_sparse();
+    test_conv();
+    test_math();
+    test_normalization();
+    test_sorting();
+    test_indexing();
+    test_concatenate();
+    test_scan();
+    test_einsum();
+    test_random();
+    test_numa();
+    test_huge_pages();
+    test_batch_stream();
+    test_disk_tensor();
+    test_csv();
+    test_storage();
+    test_external();
+    test_shared_memory();
+    test_nd_loop();
+    test_layout();
+    test_dynamic_tensor();
 
     cout << "End of testing!\n" <<  string(30, '-') << "\n";
 }
\ No newline at end of file